@@ -1,6 +1,7 @@
-from setuptools import setup, Extension
+from setuptools import setup, Extension, Command
 import sys
 import os
+import sysconfig
 
 # --- Cross-Platform OpenMP Setup ---
 # Default flags
@@ -42,19 +43,117 @@ link_args.extend(openmp_link_args)
 # --- End Cross-Platform Setup ---
 
 
+# The engine and the sources it links against, shared by every target
+core_sources = ['warp_core.c', 'lz4.c', 'lz4frame.c', 'lz4hc.c', 'xxhash.c']
+
+
 module = Extension(
     'warphybrid',
-    # These are the lz4 source files
-    sources=['warp_compress.c', 'lz4.c', 'lz4frame.c', 'lz4hc.c', 'xxhash.c'],
+    # The bindings include warp_core.c, the engine; then the lz4 and xxHash sources
+    sources=['warp_compress.c'] + core_sources[1:],
     include_dirs=['.'],
+    # Included by warp_compress.c, so setuptools can't see it on its own
+    depends=['warp_core.c', 'warphybrid.h'],
     # Add the platform-specific flags
     extra_compile_args=compile_args,
     extra_link_args=link_args,
 )
 
+
+
+class build_bench(Command):
+    """Build ./warp_bench, the native benchmark, from the engine's sources."""
+    description = 'build the native benchmark (warp_bench) next to the extension'
+    user_options = []
+
+    def initialize_options(self):
+        pass
+
+    def finalize_options(self):
+        pass
+
+    def run(self):
+        from distutils.ccompiler import new_compiler
+        from distutils.sysconfig import customize_compiler
+
+        compiler = new_compiler()
+        customize_compiler(compiler)
+        # A client of the C API: the engine is built exactly as for libwarphybrid
+        sources = ['warp_bench.c'] + core_sources
+        objects = compiler.compile(sources, output_dir='build/bench', include_dirs=['.'],
+                                   extra_postargs=compile_args)
+        compiler.link_executable(objects, 'warp_bench',
+                                 extra_postargs=link_args + ['-lm'] if sys.platform != 'win32' else link_args)
+
+
+class build_lib(Command):
+    """Build libwarphybrid, the engine as a C library (see warphybrid.h)."""
+    description = 'build libwarphybrid as a shared and a static library in build/lib'
+    user_options = []
+
+    def initialize_options(self):
+        pass
+
+    def finalize_options(self):
+        pass
+
+    def run(self):
+        from distutils.ccompiler import new_compiler
+        from distutils.sysconfig import customize_compiler
+
+        compiler = new_compiler()
+        customize_compiler(compiler)
+        # Position-independent objects serve both libraries; only the C API
+        # in warphybrid.h is exported from the shared one, not the bundled LZ4
+        postargs = list(compile_args)
+        if sys.platform == 'win32':
+            macros = [('WH_BUILD_DLL', None)]
+        else:
+            postargs += ['-fPIC', '-fvisibility=hidden']
+            macros = [('LZ4LIB_VISIBILITY', ''), ('LZ4FLIB_VISIBILITY', '')]
+        objects = compiler.compile(core_sources, output_dir='build/libobj', include_dirs=['.'],
+                                   macros=macros, extra_postargs=postargs)
+        compiler.create_static_lib(objects, 'warphybrid_static' if sys.platform == 'win32' else 'warphybrid',
+                                   output_dir='build/lib')
+        compiler.link_shared_lib(objects, 'warphybrid', output_dir='build/lib',
+                                 extra_postargs=link_args + ['-lm'] if sys.platform != 'win32' else link_args)
+
+
+class test_capi(Command):
+    """Build libwarphybrid, link test_capi.c against it and run it."""
+    description = 'build and run the C API smoke test against libwarphybrid'
+    user_options = []
+
+    def initialize_options(self):
+        pass
+
+    def finalize_options(self):
+        pass
+
+    def run(self):
+        import subprocess
+        from distutils.ccompiler import new_compiler
+        from distutils.errors import DistutilsError
+        from distutils.sysconfig import customize_compiler
+
+        self.run_command('build_lib')
+        compiler = new_compiler()
+        customize_compiler(compiler)
+        lib_dir = os.path.abspath('build/lib')
+        objects = compiler.compile(['test_capi.c'], output_dir='build/test', include_dirs=['.'],
+                                   macros=[('WH_USE_DLL', None)] if sys.platform == 'win32' else None)
+        # Linked against the shared library, so only its exported API is reachable
+        compiler.link_executable(objects, 'build/test/test_capi', libraries=['warphybrid'], library_dirs=[lib_dir],
+                                 runtime_library_dirs=[lib_dir] if sys.platform != 'win32' else None,
+                                 extra_postargs=link_args)
+        if subprocess.call([compiler.executable_filename('build/test/test_capi')]) != 0:
+            raise DistutilsError('test_capi failed')
+
+
 setup(
     name='warphybrid',
     version='1.2.0', # Updated version for cross-platform
     description='A cross-platform, high-speed, multithreaded LZ4 compressor',
     ext_modules=[module],
+    cmdclass={'build_bench': build_bench, 'build_lib': build_lib, 'test_capi': test_capi},
 )
@@ -0,0 +1,140 @@
+/* Smoke test of the C API, linked against libwarphybrid. Build and run it
+   with `python setup.py test_capi`. Every case round-trips a frame through
+   wh_* calls only; the first failure is printed and exits non-zero. */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "warphybrid.h"
+
+#define TEST_SIZE (3 * 1024 * 1024 + 12345)
+
+static int failures = 0;
+
+#define CHECK(cond, what)                                              \
+    do {                                                               \
+        if (!(cond)) {                                                 \
+            fprintf(stderr, "FAIL %s:%d: %s\n", __FILE__, __LINE__, what); \
+            failures++;                                                \
+            goto done;                                                 \
+        }                                                              \
+    } while (0)
+
+#define CHECK_OK(call)                                                        \
+    do {                                                                      \
+        int check_err = (call);                                               \
+        if (check_err != WH_OK) {                                             \
+            fprintf(stderr, "FAIL %s:%d: %s: %s\n", __FILE__, __LINE__, #call, \
+                    wh_error_string(check_err));                              \
+            failures++;                                                       \
+            goto done;                                                        \
+        }                                                                     \
+    } while (0)
+
+/* Log-like text: compressible, but not trivially. */
+static unsigned char* make_input(size_t size) {
+    unsigned char* data = malloc(size);
+    uint64_t x = 0x9E3779B97F4A7C15ULL;
+    for (size_t i = 0; data && i < size;) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        i += (size_t)snprintf((char*)data + i, size - i, "t=%llu id=%u path=/v1/items/%u status=200\n",
+                              (unsigned long long)(i / 64), (unsigned)(x % 1000), (unsigned)(x >> 40) % 97);
+    }
+    return data;
+}
+
+/* Compress `data` with `opts`, then check every way of reading it back. */
+static void round_trip(const char* name, const unsigned char* data, size_t size, const wh_compress_options* opts) {
+    wh_cctx* cctx = NULL;
+    wh_dctx* dctx = NULL;
+    unsigned char* comp = NULL;
+    unsigned char* back = malloc(size);
+    size_t comp_size, back_size, total, bad_block, bad_offset;
+    fprintf(stderr, "%s\n", name);
+
+    CHECK_OK(wh_cctx_create(opts, &cctx));
+    CHECK_OK(wh_dctx_create(opts->dict, 0, &dctx));
+    size_t bound = wh_compress_bound(cctx, size);
+    comp = malloc(bound);
+    CHECK(comp && back, "out of memory");
+    CHECK_OK(wh_compress(cctx, data, size, comp, bound, &comp_size));
+    CHECK(comp_size < size, "frame is no smaller than the input");
+
+    CHECK_OK(wh_decompressed_size(comp, comp_size, &total));
+    CHECK(total == size, "wrong decompressed size");
+    CHECK_OK(wh_decompress(dctx, comp, comp_size, back, size, &back_size));
+    CHECK(back_size == size && memcmp(back, data, size) == 0, "round trip mismatch");
+    CHECK(wh_decompress(dctx, comp, comp_size, back, size - 1, &back_size) == WH_ERR_DST_SIZE,
+          "short destination accepted");
+
+    CHECK_OK(wh_decompress_range(dctx, comp, comp_size, 1000000, 70000, back, &back_size));
+    CHECK(back_size == 70000 && memcmp(back, data + 1000000, 70000) == 0, "range mismatch");
+
+    CHECK_OK(wh_verify(dctx, comp, comp_size, &bad_block, &bad_offset));
+    CHECK(bad_block == SIZE_MAX, "intact frame reported bad");
+    if (opts->checksum) {
+        comp[comp_size / 2] ^= 0x55;  // Somewhere inside a block's payload
+        CHECK(wh_verify(dctx, comp, comp_size, &bad_block, &bad_offset) != WH_OK && bad_block != SIZE_MAX,
+              "damaged frame verified");
+    }
+
+done:
+    wh_cctx_free(cctx);
+    wh_dctx_free(dctx);
+    free(comp);
+    free(back);
+}
+
+int main(void) {
+    unsigned char* data = make_input(TEST_SIZE);
+    wh_dict* dict = NULL;
+    if (!data) return 1;
+
+    wh_compress_options opts;
+    wh_compress_options_init(&opts);
+    round_trip("default", data, TEST_SIZE, &opts);
+
+    wh_compress_options_init(&opts);
+    opts.block_size = 256 * 1024;
+    opts.seekable = 1;
+    opts.checksum = 1;
+    round_trip("seekable, checksum", data, TEST_SIZE, &opts);
+
+    wh_compress_options_init(&opts);
+    opts.linked = 1;
+    opts.level = 9;
+    round_trip("linked, level 9", data, TEST_SIZE, &opts);
+
+    wh_compress_options_init(&opts);
+    opts.format = 2;
+    opts.dedup = 1;
+    opts.typesize = 4;
+    round_trip("format 2, dedup, typesize 4", data, TEST_SIZE, &opts);
+
+    CHECK_OK(wh_dict_create(data, 64 * 1024, &dict));
+    wh_compress_options_init(&opts);
+    opts.dict = dict;
+    opts.seekable = 1;
+    round_trip("dictionary", data, TEST_SIZE, &opts);
+
+    wh_compress_options_init(&opts);
+    opts.level = 13;
+    wh_cctx* cctx = NULL;
+    CHECK(wh_cctx_create(&opts, &cctx) == WH_ERR_ARG, "level 13 accepted");
+    wh_compress_options_init(&opts);
+    opts.target_mbps = HUGE_VAL;
+    CHECK(wh_cctx_create(&opts, &cctx) == WH_ERR_ARG, "infinite target_mbps accepted");
+
+done:
+    wh_dict_free(dict);
+    free(data);
+    if (failures) {
+        fprintf(stderr, "%d failure(s)\n", failures);
+        return 1;
+    }
+    fprintf(stderr, "all C API checks passed\n");
+    return 0;
+}
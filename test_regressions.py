@@ -0,0 +1,280 @@
+"""Regression tests for the warphybrid module.
+
+Run after building the extension in place:
+
+    python3 -m unittest test_regressions
+"""
+import asyncio
+import os
+import random
+import struct
+import tempfile
+import threading
+import unittest
+import warnings
+
+import warphybrid
+
+MB = 1024 * 1024
+
+
+def seekable_payload_frame():
+    """A valid plain frame whose data ends in a seekable frame's footer."""
+    inner = warphybrid.compress_hybrid(os.urandom(3_000_000), MB, seekable=True)
+    return inner, warphybrid.compress_hybrid(inner, MB)
+
+
+class FooterDetectionTest(unittest.TestCase):
+    def test_plain_frame_of_seekable_frame(self):
+        inner, outer = seekable_payload_frame()
+        self.assertEqual(warphybrid.decompress_hybrid(outer), inner)
+        self.assertEqual(warphybrid.decompress_range(outer, 1000, 5000), inner[1000:6000])
+        with tempfile.NamedTemporaryFile() as f:
+            f.write(outer)
+            f.flush()
+            self.assertEqual(b"".join(warphybrid.iter_decompress(f.name)), inner)
+
+    def test_seekable_frames_still_seekable(self):
+        data = os.urandom(100) * 30000
+        for kwargs in ({"seekable": True}, {"linked": True}, {"checksum": True, "format": 2},
+                       {"dedup": True, "seekable": True}):
+            frame = warphybrid.compress_hybrid(data, 64 * 1024, **kwargs)
+            self.assertTrue(warphybrid.frame_info(frame)["seekable"], kwargs)
+            self.assertEqual(warphybrid.decompress_hybrid(frame), data)
+
+
+class StreamingObjectsTest(unittest.TestCase):
+    DATA = b"".join(b"id=%d level=info msg=request served\n" % i for i in range(40_000)) + os.urandom(50_000)
+
+    def compressed(self, chunks):
+        c = warphybrid.Compressor(block_size=64 * 1024)
+        return b"".join([c.compress(chunk) for chunk in chunks] + [c.flush()])
+
+    def decompressed(self, frame, sizes):
+        d = warphybrid.Decompressor()
+        out, pos = [], 0
+        for size in sizes:
+            out.append(d.decompress(frame[pos:pos + size]))
+            pos += size
+        out.append(d.decompress(frame[pos:]))
+        out.append(d.flush())
+        return b"".join(out)
+
+    def random_sizes(self, rng, total):
+        sizes = []
+        while sum(sizes) < total:
+            sizes.append(rng.choice((1, 3, 7, 8, 9, 1000, 65_536, 100_000)))
+        return sizes
+
+    def test_round_trip_in_random_chunks(self):
+        rng = random.Random(4)
+        frame = self.compressed([self.DATA[i:i + 30_000] for i in range(0, len(self.DATA), 30_000)])
+        self.assertEqual(frame, warphybrid.compress_hybrid(self.DATA, 64 * 1024))
+        for _ in range(5):
+            self.assertEqual(self.decompressed(frame, self.random_sizes(rng, len(frame))), self.DATA)
+
+    def test_byte_by_byte(self):
+        data = self.DATA[:300_000]
+        frame = self.compressed([data])
+        self.assertEqual(self.decompressed(frame, [1] * len(frame)), data)
+
+    def test_corrupt_headers(self):
+        for header in (struct.pack("<II", 5, 0), struct.pack("<II", 5, 0xFFFFFFF0),
+                       struct.pack("<II", 0xFFFFFFFF, 5)):
+            frame = header + b"abcdef"
+            for split in range(1, len(frame)):
+                d = warphybrid.Decompressor()
+                with self.assertRaises(RuntimeError, msg=(header, split)):
+                    d.decompress(frame[:split])
+                    d.decompress(frame[split:])
+                    d.flush()
+
+    def test_truncated_stream(self):
+        frame = self.compressed([self.DATA])
+        d = warphybrid.Decompressor()
+        d.decompress(frame[:-1])
+        with self.assertRaises(RuntimeError):
+            d.flush()
+
+
+class FooterEntryTest(unittest.TestCase):
+    def test_damaged_middle_entry_is_caught_when_read(self):
+        data = os.urandom(100) * 30000
+        frame = bytearray(warphybrid.compress_hybrid(data, 64 * 1024, seekable=True))
+        num_blocks = warphybrid.frame_info(bytes(frame))["num_blocks"]
+        entry = len(frame) - 32 - num_blocks * 24 + 24 * (num_blocks // 2)
+        frame[entry + 16] ^= 0x01  # Middle entry's comp_size
+        frame = bytes(frame)
+        # Only the first and last entries are checked up front
+        self.assertEqual(warphybrid.frame_info(frame)["num_blocks"], num_blocks)
+        with self.assertRaises(RuntimeError):
+            warphybrid.decompress_hybrid(frame)
+        self.assertEqual(warphybrid.decompress_range(frame, 0, 1000), data[:1000])
+
+
+class PipeStreamTest(unittest.TestCase):
+    DATA = b"".join(b"t=%d status=200 path=/v1/items\n" % i for i in range(200_000))
+
+    def stream_from_pipe(self, frame, **kwargs):
+        """iter_decompress() over a pipe fed `frame` from another thread."""
+        read_fd, write_fd = os.pipe()
+
+        def feed():
+            try:
+                with os.fdopen(write_fd, "wb") as f:
+                    f.write(frame)
+            except BrokenPipeError:
+                pass
+
+        feeder = threading.Thread(target=feed)
+        feeder.start()
+        try:
+            return b"".join(warphybrid.iter_decompress(read_fd, **kwargs))
+        finally:
+            os.close(read_fd)
+            feeder.join()
+
+    def test_footer_at_end_of_pipe(self):
+        for kwargs in ({"seekable": True}, {"checksum": True}, {"format": 2, "seekable": True}):
+            frame = warphybrid.compress_hybrid(self.DATA, 64 * 1024, **kwargs)
+            self.assertEqual(self.stream_from_pipe(frame, max_memory=MB), self.DATA, kwargs)
+
+    def test_checksums_checked_from_pipe(self):
+        data = os.urandom(100_000) + self.DATA
+        for kwargs in ({"checksum": True}, {"checksum": True, "format": 2, "dedup": True}):
+            frame = bytearray(warphybrid.compress_hybrid(data, 64 * 1024, **kwargs))
+            self.assertEqual(self.stream_from_pipe(bytes(frame), max_memory=MB), data, kwargs)
+            frame[100] ^= 0xFF  # Inside block 0, stored raw
+            for max_memory in (MB, 64 * MB):
+                with self.assertRaisesRegex(RuntimeError, "checksum", msg=kwargs):
+                    self.stream_from_pipe(bytes(frame), max_memory=max_memory)
+
+    def test_linked_frame_needs_regular_file(self):
+        for kwargs in ({"linked": True}, {"linked": True, "format": 2}):
+            frame = warphybrid.compress_hybrid(self.DATA, 64 * 1024, **kwargs)
+            with self.assertRaisesRegex(ValueError, "regular file"):
+                self.stream_from_pipe(frame, max_memory=MB)
+
+    def test_seekable_payload_from_pipe(self):
+        inner, outer = seekable_payload_frame()
+        self.assertEqual(self.stream_from_pipe(outer), inner)
+
+
+class TargetMbpsTest(unittest.TestCase):
+    def test_rejects_non_finite(self):
+        data = os.urandom(100) * 3000
+        for value in (float("nan"), float("inf"), -1.0):
+            with self.assertRaises(ValueError, msg=value):
+                warphybrid.compress_hybrid(data, target_mbps=value)
+            with self.assertRaises(ValueError, msg=value):
+                warphybrid.Compressor(target_mbps=value)
+
+
+@unittest.skipUnless(hasattr(warphybrid, "compress_async"), "no asyncio support on this platform")
+class AsyncTest(unittest.TestCase):
+    DATA = b"".join(b"seq=%d op=put key=k%d\n" % (i, i % 977) for i in range(100_000))
+
+    @staticmethod
+    async def round_trips(payloads):
+        frames = await asyncio.gather(*(warphybrid.compress_async(p, 64 * 1024) for p in payloads))
+        return await asyncio.gather(*(warphybrid.decompress_async(f) for f in frames))
+
+    def test_round_trip(self):
+        payloads = [self.DATA[i:] for i in range(0, 50_000, 5_000)]
+        self.assertEqual(asyncio.run(self.round_trips(payloads)), payloads)
+
+    @unittest.skipUnless(hasattr(os, "fork"), "needs fork()")
+    def test_after_fork(self):
+        self.assertEqual(asyncio.run(self.round_trips([self.DATA])), [self.DATA])  # Dispatcher running
+        with warnings.catch_warnings():
+            warnings.simplefilter("ignore", DeprecationWarning)  # fork() with threads running
+            pid = os.fork()
+        if pid == 0:
+            ok = False
+            try:
+                ok = asyncio.run(asyncio.wait_for(self.round_trips([self.DATA]), 10)) == [self.DATA]
+            finally:
+                os._exit(0 if ok else 1)
+        _, status = os.waitpid(pid, 0)
+        self.assertEqual(os.waitstatus_to_exitcode(status), 0)
+        self.assertEqual(asyncio.run(self.round_trips([self.DATA])), [self.DATA])
+
+
+class TypesizeTest(unittest.TestCase):
+    # Slowly varying little-endian floats: shuffling makes them compress
+    DATA = struct.pack("<200000f", *(i * 0.25 for i in range(200_000)))
+
+    def frames(self):
+        for typesize in (2, 4, 8):
+            for kwargs in ({}, {"seekable": True}, {"checksum": True}):
+                yield typesize, kwargs, warphybrid.compress_hybrid(self.DATA, 64 * 1024, typesize=typesize, **kwargs)
+
+    def test_round_trip(self):
+        for typesize, kwargs, frame in self.frames():
+            msg = (typesize, kwargs)
+            self.assertEqual(warphybrid.decompress_hybrid(frame), self.DATA, msg)
+            self.assertEqual(warphybrid.decompress_many([frame, frame]), [self.DATA, self.DATA], msg)
+            self.assertIsNone(warphybrid.verify(frame), msg)
+
+    def test_ranges_inside_shuffled_blocks(self):
+        for typesize, kwargs, frame in self.frames():
+            for offset, length in ((1, 10), (65_530, 20), (100_001, 200_000), (0, len(self.DATA))):
+                self.assertEqual(warphybrid.decompress_range(frame, offset, length),
+                                 self.DATA[offset:offset + length], (typesize, kwargs, offset))
+
+    def test_shuffled_blocks_are_smaller(self):
+        plain = warphybrid.compress_hybrid(self.DATA, 64 * 1024, format=2)
+        shuffled = warphybrid.compress_hybrid(self.DATA, 64 * 1024, typesize=4)
+        self.assertLess(len(shuffled), len(plain))
+
+    def test_files_and_streams(self):
+        frame = warphybrid.compress_hybrid(self.DATA, 64 * 1024, typesize=4, checksum=True)
+        with tempfile.TemporaryDirectory() as tmp:
+            src, dst = os.path.join(tmp, "in.whb"), os.path.join(tmp, "out")
+            with open(src, "wb") as f:
+                f.write(frame)
+            self.assertEqual(warphybrid.decompress_file(src, dst), len(self.DATA))
+            with open(dst, "rb") as f:
+                self.assertEqual(f.read(), self.DATA)
+            self.assertEqual(b"".join(warphybrid.iter_decompress(src, max_memory=MB)), self.DATA)
+
+
+class FrameInfoTest(unittest.TestCase):
+    def test_seekable_payload_reports_outer_frame(self):
+        inner, outer = seekable_payload_frame()
+        info = warphybrid.frame_info(outer)
+        self.assertFalse(info["seekable"])
+        self.assertEqual(info["total_size"], len(inner))
+        self.assertEqual(info["num_blocks"], 3)
+
+    def test_seekable_frame_read_from_footer_alone(self):
+        data = os.urandom(100) * 30000
+        frame = bytearray(warphybrid.compress_hybrid(data, 64 * 1024, seekable=True))
+        frame[len(frame) // 2:len(frame) // 2 + 64] = bytes(64)  # Middle blocks, headers included
+        info = warphybrid.frame_info(bytes(frame))
+        self.assertTrue(info["seekable"])
+        self.assertEqual(info["total_size"], len(data))
+
+    def test_max_output_size_uses_real_size(self):
+        inner, outer = seekable_payload_frame()
+        self.assertEqual(warphybrid.decompress_hybrid(outer, max_output_size=len(inner)), inner)
+        with self.assertRaises(ValueError):
+            warphybrid.decompress_hybrid(outer, max_output_size=len(inner) - 1)
+
+
+class VerifyTest(unittest.TestCase):
+    def test_seekable_payload_verifies(self):
+        inner, outer = seekable_payload_frame()
+        self.assertIsNone(warphybrid.verify(outer))
+
+    def test_reports_first_bad_block(self):
+        data = os.urandom(100) * 30000
+        frame = bytearray(warphybrid.compress_hybrid(data, 64 * 1024, checksum=True))
+        frame[200] ^= 0xFF  # Inside block 0's payload
+        result = warphybrid.verify(bytes(frame))
+        self.assertIsNotNone(result)
+        self.assertEqual(result["block"], 0)
+
+
+if __name__ == "__main__":
+    unittest.main()
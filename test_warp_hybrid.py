@@ -34,27 +34,16 @@ def benchmark(name, comp_func, decomp_func, data, label):
     ratio = 100.0 * len(compressed) / len(data) if len(data) > 0 else 0
     print(f"{name:<10} ✅ Ratio: {ratio:6.2f}%  C:{t1 - t0:.4f}s  D:{t3 - t2:.4f}s")
 
-# --- "Smart" Wrapper (Unchanged) ---
+# --- Module Wrappers ---
 KB = 1024
 MB = 1024 * 1024
 GB = 1024 * 1024 * 1024
-DEFAULT_BLOCK_SIZE = 1 * MB
 
 def compress_hybrid(data, block_size_bytes=None):
-    if block_size_bytes is None:
-        if len(data) < DEFAULT_BLOCK_SIZE:
-            block_size_to_use = len(data)
-        else:
-            block_size_to_use = DEFAULT_BLOCK_SIZE
-    else:
-        block_size_to_use = block_size_bytes
-        
-    if block_size_to_use == 0 and len(data) > 0:
-        block_size_to_use = len(data)
-    elif len(data) == 0:
+    if len(data) == 0:
         return b'' # Handle 0KB file
-
-    return warphybrid.compress_hybrid(data, block_size_to_use)
+    # None lets the module size blocks for the input and the thread count
+    return warphybrid.compress_hybrid(data, block_size_bytes)
 
 def decompress_hybrid(data):
     if len(data) == 0:
@@ -99,9 +88,45 @@ ON_DISK_TESTS = {
 }
 # --- END NEW ---
 
+# Small-block microbenchmark: per-block setup cost dominates here
+SMALL_BLOCK_SIZES = [4 * KB, 16 * KB, 64 * KB]
+SMALL_BLOCK_DATA_SIZE = 64 * MB
+
+def make_log_data(size):
+    line = 0
+    parts = []
+    total = 0
+    while total < size:
+        row = b"2024-05-01T12:%02d:%02d host%d svc=api path=/v1/items/%d status=200 ms=%d\n" % (
+            line // 60 % 60, line % 60, line % 7, line * 37 % 1000, line % 97)
+        parts.append(row)
+        total += len(row)
+        line += 1
+    return b"".join(parts)[:size]
+
+def benchmark_small_blocks():
+    data = make_log_data(SMALL_BLOCK_DATA_SIZE)
+    for level in (0, 9):
+        print(f"\n--- Small blocks, level {level}, {len(data) / MB:.0f} MB, 1 thread ---")
+        for block_size in SMALL_BLOCK_SIZES:
+            best = None
+            for _ in range(3):
+                t0 = time.perf_counter()
+                comp = warphybrid.compress_hybrid(data, block_size, level=level, threads=1)
+                elapsed = time.perf_counter() - t0
+                best = elapsed if best is None else min(best, elapsed)
+            assert warphybrid.decompress_hybrid(comp) == data
+            blocks = (len(data) + block_size - 1) // block_size
+            print(f"{block_size // KB:>3} KB blocks: {len(data) / MB / best:8.1f} MB/s  "
+                  f"{best / blocks * 1e6:7.2f} us/block  ratio {len(comp) / len(data) * 100:6.2f}%")
+
 
 if __name__ == "__main__":
-    
+
+    if "--small-blocks" in sys.argv:
+        benchmark_small_blocks()
+        sys.exit(0)
+
     # --- Run In-Memory Tests ---
     for label, size_bytes in IN_MEMORY_TESTS.items():
         print(f"\n=============================================")
@@ -0,0 +1,349 @@
+/* Native benchmark for the warphybrid engine, without the Python call path.
+   Build with `python setup.py build_bench`, then run e.g.
+
+     ./warp_bench --blocks 64K,1M --threads 1,2,4 --levels 0,9 silesia/
+
+   Every corpus file (directories are expanded one level) is compressed and
+   decompressed `--repeat` times per combination of block size, thread
+   count, level and acceleration, and one row per direction is printed as
+   CSV, or as JSON with --json. With no corpus, built-in text, JSON-like and
+   random corpora are generated.
+
+   p99_ms is only reported from P99_MIN_SAMPLES repeats up (empty, or null in
+   JSON, below that), since with fewer it is just the slowest call.
+   block_us is an estimate, not a per-block measurement: the p50 call time
+   spread over the team and divided by the block count, which assumes the
+   blocks kept every thread busy.
+
+   It is a plain client of the C API in warphybrid.h, linked against the
+   same engine sources as libwarphybrid, so it times exactly what native
+   callers get. */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>     // omp_get_wtime, omp_get_max_threads
+#ifndef _WIN32
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+#include "warphybrid.h"
+
+#define BENCH_MAX_LIST 32
+#define BENCH_MAX_CORPORA 256
+#define BENCH_DEFAULT_REPEAT 5
+#define P99_MIN_SAMPLES 100  // Fewer and the 99th percentile is the maximum
+#define BENCH_SYNTHETIC_SIZE (16 * 1024 * 1024)
+#define BYTES_PER_MB (1024.0 * 1024.0)
+
+typedef struct {
+    char name[256];
+    unsigned char* data;
+    size_t size;
+} Corpus;
+
+typedef struct {
+    size_t values[BENCH_MAX_LIST];
+    int count;
+} SizeList;
+
+typedef struct {
+    double p50, p99, mean;  // p99 < 0: too few samples to tell
+} Latency;
+
+static Corpus corpora[BENCH_MAX_CORPORA];
+static int num_corpora = 0;
+static int json_output = 0;
+static int rows_printed = 0;
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "usage: %s [--blocks LIST] [--threads LIST] [--levels LIST] [--accel LIST]\n"
+            "          [--repeat N] [--format 1|2] [--seekable] [--json] [corpus...]\n"
+            "LIST is comma separated; sizes take K/M suffixes. Defaults: --blocks 64K,1M\n"
+            "--threads 1,<max> --levels 0 --accel 1 --repeat %d --format 1.\n",
+            prog, BENCH_DEFAULT_REPEAT);
+    exit(2);
+}
+
+/* Parse "4K,64K,1M" style lists. */
+static void parse_list(const char* arg, SizeList* list) {
+    list->count = 0;
+    const char* p = arg;
+    while (*p && list->count < BENCH_MAX_LIST) {
+        char* end;
+        unsigned long long v = strtoull(p, &end, 10);
+        if (end == p) usage("warp_bench");
+        if (*end == 'K' || *end == 'k') v <<= 10, end++;
+        else if (*end == 'M' || *end == 'm') v <<= 20, end++;
+        list->values[list->count++] = (size_t)v;
+        p = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',') usage("warp_bench");
+    }
+}
+
+static int add_corpus(const char* name, unsigned char* data, size_t size) {
+    if (num_corpora == BENCH_MAX_CORPORA) {
+        free(data);
+        return -1;
+    }
+    Corpus* c = &corpora[num_corpora++];
+    snprintf(c->name, sizeof(c->name), "%s", name);
+    for (char* p = c->name; *p; ++p) {
+        if (*p == '"' || *p == '\\' || *p == ',' || (unsigned char)*p < 0x20) *p = '_';  // Keep CSV / JSON valid
+    }
+    c->data = data;
+    c->size = size;
+    return 0;
+}
+
+static int load_file(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char* data = malloc(size > 0 ? (size_t)size : 1);
+    if (!data || fread(data, 1, (size_t)size, f) != (size_t)size) {
+        fprintf(stderr, "%s: read failed\n", path);
+        fclose(f);
+        free(data);
+        return -1;
+    }
+    fclose(f);
+    const char* base = strrchr(path, '/');
+    return add_corpus(base ? base + 1 : path, data, (size_t)size);
+}
+
+/* A file, or every regular file directly inside a directory, by name. */
+static int load_path(const char* path) {
+#ifndef _WIN32
+    DIR* dir = opendir(path);
+    if (dir) {
+        struct dirent* entry;
+        int err = 0;
+        char full[4096];
+        while (!err && (entry = readdir(dir))) {
+            struct stat st;
+            snprintf(full, sizeof(full), "%s/%s", path, entry->d_name);
+            if (entry->d_name[0] != '.' && stat(full, &st) == 0 && S_ISREG(st.st_mode)) err = load_file(full);
+        }
+        closedir(dir);
+        return err;
+    }
+#endif
+    return load_file(path);
+}
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+/* Text, JSON-like records and random bytes, so the defaults cover a
+   compressible, a structured and an incompressible input. */
+static void add_synthetic_corpora(void) {
+    static const char* words[] = {"the", "block", "frame", "thread", "index", "value", "compress", "server",
+                                  "request", "latency", "buffer", "stream", "of", "and", "to", "a"};
+    size_t size = BENCH_SYNTHETIC_SIZE;
+
+    unsigned char* text = malloc(size);
+    for (size_t n = 0; n < size;) {
+        const char* w = words[next_random() % 16];
+        size_t len = strlen(w);
+        for (size_t i = 0; i < len && n < size; ++i) text[n++] = (unsigned char)w[i];
+        if (n < size) text[n++] = next_random() % 12 ? ' ' : '\n';
+    }
+    add_corpus("synthetic-text", text, size);
+
+    unsigned char* json = malloc(size + 256);
+    size_t n = 0;
+    for (unsigned long id = 0; n < size; ++id) {
+        n += (size_t)sprintf((char*)json + n,
+                             "{\"id\":%lu,\"user\":\"user%lu\",\"score\":%lu,\"active\":%s,\"tags\":[\"%s\",\"%s\"]}\n",
+                             id, (unsigned long)(next_random() % 100000), (unsigned long)(next_random() % 1000),
+                             next_random() % 2 ? "true" : "false", words[next_random() % 16],
+                             words[next_random() % 16]);
+    }
+    add_corpus("synthetic-json", json, size);
+
+    unsigned char* random = malloc(size);
+    for (size_t i = 0; i + 8 <= size; i += 8) {
+        uint64_t v = next_random();
+        memcpy(random + i, &v, 8);
+    }
+    add_corpus("synthetic-random", random, size);
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static Latency summarize(double* seconds, int count) {
+    Latency l = {0, 0, 0};
+    for (int i = 0; i < count; ++i) l.mean += seconds[i] / count;
+    qsort(seconds, (size_t)count, sizeof(double), compare_doubles);
+    l.p50 = seconds[(count - 1) / 2];
+    l.p99 = count >= P99_MIN_SAMPLES ? seconds[(int)((count - 1) * 0.99 + 0.5)] : -1;
+    return l;
+}
+
+static void print_row(const Corpus* c, const wh_compress_options* opts, int threads, const char* op,
+                      const Latency* l, size_t comp_size, size_t num_blocks) {
+    double mb_s = l->mean > 0 ? c->size / l->mean / BYTES_PER_MB : 0;
+    double ratio = c->size ? (double)comp_size / c->size : 0;
+    // Estimated worker time per block: the p50 call spread over the team
+    double block_us = num_blocks ? l->p50 * 1e6 * threads / num_blocks : 0;
+    char p99[32];
+    if (l->p99 >= 0) snprintf(p99, sizeof(p99), "%.3f", l->p99 * 1e3);
+    else snprintf(p99, sizeof(p99), "%s", json_output ? "null" : "");
+    if (json_output) {
+        printf("%s\n  {\"corpus\": \"%s\", \"bytes\": %zu, \"block_size\": %zu, \"threads\": %d, \"level\": %d, "
+               "\"acceleration\": %d, \"format\": %d, \"op\": \"%s\", \"mb_s\": %.1f, \"ratio\": %.4f, "
+               "\"p50_ms\": %.3f, \"p99_ms\": %s, \"block_us\": %.2f}",
+               rows_printed ? "," : "[", c->name, c->size, opts->block_size, threads, opts->level,
+               opts->acceleration, opts->format, op, mb_s, ratio, l->p50 * 1e3, p99, block_us);
+    } else {
+        if (!rows_printed) {
+            printf("corpus,bytes,block_size,threads,level,acceleration,format,op,mb_s,ratio,p50_ms,p99_ms,block_us\n");
+        }
+        printf("%s,%zu,%zu,%d,%d,%d,%d,%s,%.1f,%.4f,%.3f,%s,%.2f\n", c->name, c->size, opts->block_size, threads,
+               opts->level, opts->acceleration, opts->format, op, mb_s, ratio, l->p50 * 1e3, p99, block_us);
+    }
+    rows_printed++;
+    fflush(stdout);
+}
+
+/* Time one configuration both ways. Returns -1 if the round trip fails. */
+static int bench_one(const Corpus* c, wh_compress_options opts, int repeat) {
+    size_t num_blocks = (c->size + opts.block_size - 1) / opts.block_size;
+    // The budget covers every team asked for, so a call gets its threads,
+    // one per block at most
+    int threads = opts.threads > 0 ? opts.threads : omp_get_max_threads();
+    if ((size_t)threads > num_blocks) threads = num_blocks > 1 ? (int)num_blocks : 1;
+
+    wh_cctx* cctx = NULL;
+    wh_dctx* dctx = NULL;
+    unsigned char* comp = NULL;
+    unsigned char* back = NULL;
+    double* seconds = NULL;
+    int result = -1;
+    int err = wh_cctx_create(&opts, &cctx);
+    if (!err) err = wh_dctx_create(NULL, opts.threads, &dctx);
+    if (err) {
+        fprintf(stderr, "%s: %s\n", c->name, wh_error_string(err));
+        goto done;
+    }
+    size_t bound = wh_compress_bound(cctx, c->size);
+    comp = malloc(bound);
+    back = malloc(c->size ? c->size : 1);
+    seconds = malloc((size_t)repeat * sizeof(double));
+    if (!comp || !back || !seconds) {
+        fprintf(stderr, "out of memory\n");
+        goto done;
+    }
+
+    // The untimed first call faults the buffers in and warms the state pool
+    size_t comp_size = 0, back_size = 0;
+    for (int i = -1; !err && i < repeat; ++i) {
+        double start = omp_get_wtime();
+        err = wh_compress(cctx, c->data, c->size, comp, bound, &comp_size);
+        if (i >= 0) seconds[i] = omp_get_wtime() - start;
+    }
+    if (err) {
+        fprintf(stderr, "%s: compression failed: %s\n", c->name, wh_error_string(err));
+        goto done;
+    }
+    Latency compress_latency = summarize(seconds, repeat);
+    print_row(c, &opts, threads, "compress", &compress_latency, comp_size, num_blocks);
+
+    for (int i = -1; !err && i < repeat; ++i) {
+        double start = omp_get_wtime();
+        err = wh_decompress(dctx, comp, comp_size, back, c->size, &back_size);
+        if (i >= 0) seconds[i] = omp_get_wtime() - start;
+    }
+    if (err || back_size != c->size || memcmp(back, c->data, c->size) != 0) {
+        fprintf(stderr, "%s: round trip failed: %s\n", c->name, wh_error_string(err));
+        goto done;
+    }
+    Latency decompress_latency = summarize(seconds, repeat);
+    print_row(c, &opts, threads, "decompress", &decompress_latency, comp_size, num_blocks);
+    result = 0;
+
+done:
+    wh_cctx_free(cctx);
+    wh_dctx_free(dctx);
+    free(comp);
+    free(back);
+    free(seconds);
+    return result;
+}
+
+int main(int argc, char** argv) {
+    SizeList blocks = {{64 * 1024, 1024 * 1024}, 2};
+    SizeList threads = {{1, (size_t)omp_get_max_threads()}, 2};
+    SizeList levels = {{0}, 1};
+    SizeList accels = {{1}, 1};
+    int repeat = BENCH_DEFAULT_REPEAT;
+    wh_compress_options base;
+    wh_compress_options_init(&base);
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        int has_value = i + 1 < argc;
+        if (!strcmp(arg, "--blocks") && has_value) parse_list(argv[++i], &blocks);
+        else if (!strcmp(arg, "--threads") && has_value) parse_list(argv[++i], &threads);
+        else if (!strcmp(arg, "--levels") && has_value) parse_list(argv[++i], &levels);
+        else if (!strcmp(arg, "--accel") && has_value) parse_list(argv[++i], &accels);
+        else if (!strcmp(arg, "--repeat") && has_value) repeat = atoi(argv[++i]);
+        else if (!strcmp(arg, "--format") && has_value) base.format = atoi(argv[++i]);
+        else if (!strcmp(arg, "--seekable")) base.seekable = 1;
+        else if (!strcmp(arg, "--json")) json_output = 1;
+        else if (arg[0] == '-') usage(argv[0]);
+        else if (load_path(arg) < 0) return 1;
+    }
+    if (repeat < 1 || (base.format != 1 && base.format != 2)) usage(argv[0]);
+    if (threads.count == 2 && threads.values[0] == threads.values[1]) threads.count = 1;
+    if (num_corpora == 0) add_synthetic_corpora();
+
+    // Let the budget cover the largest team asked for
+    int budget = omp_get_max_threads();
+    for (int t = 0; t < threads.count; ++t) {
+        if ((int)threads.values[t] > budget) budget = (int)threads.values[t];
+    }
+    wh_set_max_threads(budget, NULL);
+
+    int failed = 0;
+    for (int c = 0; c < num_corpora; ++c) {
+        for (int b = 0; b < blocks.count; ++b) {
+            if (blocks.values[b] == 0) usage(argv[0]);
+            for (int l = 0; l < levels.count; ++l) {
+                for (int a = 0; a < accels.count; ++a) {
+                    // Acceleration only applies to the fast level
+                    if (levels.values[l] > 0 && a > 0) continue;
+                    for (int t = 0; t < threads.count; ++t) {
+                        wh_compress_options opts = base;
+                        opts.block_size = blocks.values[b];
+                        opts.level = (int)levels.values[l];
+                        opts.acceleration = levels.values[l] > 0 ? 1 : (int)accels.values[a];
+                        opts.threads = (int)threads.values[t];
+                        // Out-of-range settings come back as WH_ERR_ARG
+                        if (bench_one(&corpora[c], opts, repeat) < 0) failed = 1;
+                    }
+                }
+            }
+        }
+    }
+    if (json_output) printf("%s]\n", rows_printed ? "\n" : "[");
+
+    for (int c = 0; c < num_corpora; ++c) free(corpora[c].data);
+    return failed;
+}
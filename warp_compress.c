@@ -1,265 +1,3496 @@
 #include <Python.h>
-#include <stdlib.h>
-#include <string.h>
-#include <omp.h>     // For multithreading
-#include "lz4.h"
-#include "lz4frame.h"
-#include "lz4hc.h"
-
-// Set max to 512MB to allow for large block testing
-#define MAX_BLOCK_SIZE (512 * 1024 * 1024) 
-#define HEADER_SIZE 8  // 4 bytes original block size + 4 bytes compressed size
-
-/* We need a struct to hold block results */
+// Python bindings over the engine in warp_core.c. They include it whole:
+// stats=, streams and the batch calls need block tables and other engine
+// internals that the C API of libwarphybrid (warphybrid.h) doesn't expose
+#define WH_BINDINGS  // Compile the engine parts only the bindings use
+#include "warp_core.c"
+
+// Free-threaded builds (3.13t) lock objects with critical sections; with a
+// GIL, and before 3.13, the GIL already serializes what these guard
+#ifndef Py_BEGIN_CRITICAL_SECTION
+#define Py_BEGIN_CRITICAL_SECTION(op) {
+#define Py_END_CRITICAL_SECTION() }
+#endif
+#ifndef Py_TPFLAGS_IMMUTABLETYPE
+#define Py_TPFLAGS_IMMUTABLETYPE 0
+#endif
+#ifndef Py_TPFLAGS_DISALLOW_INSTANTIATION
+#define Py_TPFLAGS_DISALLOW_INSTANTIATION 0  // Before 3.10 add_type() clears tp_new instead
+#endif
+
+/* Per-module state: the types and Python objects of one interpreter's copy
+   of the module. The engine's state in warp_core.c (thread budget, pooled
+   LZ4 states, counters, the async dispatcher's queue) is C only and stays
+   process-wide on purpose: every interpreter runs on the same cores, so
+   they all share one thread budget, and none of it needs the GIL. */
 typedef struct {
-    size_t offset_in;
-    size_t orig_size;
-    int comp_size;
-    unsigned char* comp_buf; // This will point to the final, exact-sized buffer
-} BlockResult;
+    PyTypeObject* dictionary_type;
+    PyTypeObject* compressor_type;
+    PyTypeObject* decompressor_type;
+    PyTypeObject* buffer_pool_type;
+    PyTypeObject* pooled_buffer_type;
+    PyTypeObject* decompress_iter_type;
+    PyObject* async_loops;     // {loop: AsyncLoop capsule}
+    PyObject* asyncio_module;
+} ModuleState;
 
+static inline ModuleState* module_state(PyObject* module) {
+    return (ModuleState*)PyModule_GetState(module);
+}
 
-/* Compress function (The "Champion" V4 Version) */
-static PyObject* compress_hybrid(PyObject* self, PyObject* args) {
-    Py_buffer input;
-    size_t block_size; 
+/* State of the module that created `type`, one of ours (they can't be
+   subclassed). */
+static inline ModuleState* type_state(PyTypeObject* type) {
+    return module_state(PyType_GetModule(type));
+}
 
-    if (!PyArg_ParseTuple(args, "y*L", &input, &block_size)) {
-        PyErr_SetString(PyExc_TypeError, "Expected bytes and block_size (in bytes)");
-        return NULL;
+/* Translate an error code into a Python exception. Call with the GIL held. */
+static PyObject* raise_error(int err) {
+    switch (err) {
+        case WH_ERR_NOMEM:
+            return PyErr_NoMemory();
+        case WH_ERR_HEADER:
+            return PyErr_Format(PyExc_RuntimeError, "Hybrid decompression failed: invalid block header");
+        case WH_ERR_TRAILING:
+            return PyErr_Format(PyExc_RuntimeError, "Hybrid decompression failed: trailing data");
+        case WH_ERR_CORRUPT:
+            return PyErr_Format(PyExc_RuntimeError, "Hybrid decompression failed: LZ4 size mismatch");
+        case WH_ERR_TRUNCATED:
+            return PyErr_Format(PyExc_RuntimeError, "Hybrid decompression failed: truncated stream");
+        case WH_ERR_CHECKSUM:
+            return PyErr_Format(PyExc_RuntimeError, "Hybrid decompression failed: block checksum mismatch");
+        case WH_ERR_DICT:
+            return PyErr_Format(PyExc_ValueError, "Hybrid decompression failed: frame needs a different dictionary");
+        case WH_ERR_SEEK:
+            return PyErr_Format(PyExc_ValueError, "Hybrid decompression failed: frame can't be streamed from a pipe (read it from a regular file)");
+        default:
+            return PyErr_Format(PyExc_RuntimeError, "Hybrid operation failed (error %d)", err);
     }
+}
 
-    if (block_size > MAX_BLOCK_SIZE) {
-        PyErr_Format(PyExc_ValueError, "Block size %Ld exceeds MAX_BLOCK_SIZE %lld", block_size, (long long)MAX_BLOCK_SIZE);
+/* Finish a call: fold it into the module totals and, with stats=True, turn
+   `result` into (result, stats dict). Steals `result`; NULL passes through
+   (the call failed and counts for nothing). */
+static PyObject* finish_call(PyObject* result, CallStats* stats, int compressing) {
+    if (!result) return NULL;
+    double seconds = stats_end(stats, compressing);
+    if (!stats->requested) return result;
+
+    PyObject* info = Py_BuildValue(
+        "{s:d,s:d,s:d,s:d,s:i,s:n,s:n,s:n,s:n,s:n,s:d,s:d,s:d}",
+        "seconds", seconds,
+        "index_seconds", stats->index_seconds,
+        "work_seconds", stats->work_seconds,
+        "gather_seconds", stats->gather_seconds,
+        "threads", stats->threads,
+        "blocks", (Py_ssize_t)stats->blocks,
+        "raw_blocks", (Py_ssize_t)stats->raw_blocks,
+        "bytes_in", (Py_ssize_t)stats->bytes_in,
+        "bytes_out", (Py_ssize_t)stats->bytes_out,
+        "bytes_allocated", (Py_ssize_t)stats->bytes_allocated,
+        "min_ratio", stats->min_ratio,
+        "max_ratio", stats->max_ratio,
+        "mean_ratio", stats->blocks ? stats->ratio_sum / stats->blocks : 0.0);
+    if (!info) {
+        Py_DECREF(result);
         return NULL;
     }
+    PyObject* pair = PyTuple_Pack(2, result, info);
+    Py_DECREF(result);
+    Py_DECREF(info);
+    return pair;
+}
+
+/* Validate a level argument. Returns -1 with an exception set. */
+static int check_level(int level) {
+    if (level < 0 || level > LZ4HC_CLEVEL_MAX) {
+        PyErr_Format(PyExc_ValueError, "level must be between 0 (fast) and %d, got %d", LZ4HC_CLEVEL_MAX, level);
+        return -1;
+    }
+    return 0;
+}
+
+/* Validate a block_size argument. Returns -1 with an exception set. */
+static int check_block_size(Py_ssize_t block_size) {
+    if (block_size < 0 || block_size > MAX_BLOCK_SIZE) {
+        PyErr_Format(PyExc_ValueError, "Block size %zd exceeds MAX_BLOCK_SIZE %lld", block_size, (long long)MAX_BLOCK_SIZE);
+        return -1;
+    }
     if (block_size == 0) {
         PyErr_SetString(PyExc_ValueError, "Block size cannot be zero");
-        return NULL;
+        return -1;
     }
+    return 0;
+}
 
-    const unsigned char* in_data = input.buf;
-    size_t in_size = input.len;
-    size_t num_blocks = (in_size + block_size - 1) / block_size;
-    
-    BlockResult* results = calloc(num_blocks, sizeof(BlockResult));
-    if (!results) return PyErr_NoMemory();
+/* O& converter for block_size arguments that take None: a validated size,
+   or 0 to size blocks per call with auto_block_size(). */
+static int convert_block_size(PyObject* obj, void* out) {
+    Py_ssize_t block_size = 0;
+    if (obj != Py_None) {
+        block_size = PyNumber_AsSsize_t(obj, PyExc_OverflowError);
+        if ((block_size == -1 && PyErr_Occurred()) || check_block_size(block_size) < 0) return 0;
+    }
+    *(Py_ssize_t*)out = block_size;
+    return 1;
+}
 
-    size_t total_comp_size = 0;
-    PyObject* output = NULL; 
 
-    #pragma omp parallel for schedule(dynamic) reduction(+:total_comp_size)
-    for (size_t i = 0; i < num_blocks; ++i) {
-        size_t offset_in = i * block_size;
-        size_t orig_size = (offset_in + block_size <= in_size) ? block_size : (in_size - offset_in);
-
-        results[i].offset_in = offset_in;
-        results[i].orig_size = orig_size;
-
-        // This is the simpler V4 allocation strategy (malloc-in-loop)
-        // which we proved was just as fast as the complex one.
-        size_t max_comp = LZ4_compressBound((int)orig_size);
-        unsigned char* comp_buf = malloc(max_comp);
-        
-        if (!comp_buf) {
-            #pragma omp critical
-            {
-                if (!PyErr_Occurred()) PyErr_NoMemory();
+/* Validate a threads argument (0 = automatic). Returns -1 with an exception set. */
+static int check_threads(int threads) {
+    if (threads < 0) {
+        PyErr_Format(PyExc_ValueError, "threads must be non-negative (0 = automatic), got %d", threads);
+        return -1;
+    }
+    return 0;
+}
+
+/* Validate a format argument. Returns -1 with an exception set. */
+static int check_format(int format) {
+    if (format != 1 && format != 2) {
+        PyErr_Format(PyExc_ValueError, "format must be 1 or 2, got %d", format);
+        return -1;
+    }
+    return 0;
+}
+
+/* dedup=True needs the v2 block flags, and independent blocks. Returns -1
+   with an exception set. */
+static int use_dedup(CompressOptions* opts) {
+    if (!opts->dedup) return 0;
+    if (opts->linked) {
+        PyErr_SetString(PyExc_ValueError, "dedup can't be combined with linked");
+        return -1;
+    }
+    opts->format = 2;
+    return 0;
+}
+
+
+/* typesize= needs the v2 block flags, and independent blocks. Returns -1
+   with an exception set. */
+static int use_typesize(CompressOptions* opts) {
+    if (opts->typesize < 1 || opts->typesize > MAX_TYPESIZE) {
+        PyErr_Format(PyExc_ValueError, "typesize must be between 1 and %d, got %d", MAX_TYPESIZE, opts->typesize);
+        return -1;
+    }
+    if (opts->typesize == 1) return 0;
+    if (opts->linked) {
+        PyErr_SetString(PyExc_ValueError, "typesize can't be combined with linked");
+        return -1;
+    }
+    opts->format = 2;
+    return 0;
+}
+
+
+// --- Borrowed views of many payloads ---
+
+/* Borrowed views of a batch of payloads: either one buffer per item of a
+   sequence, or slices of one buffer given by an offsets array. `batch` is
+   what the engine reads. */
+typedef struct {
+    PayloadBatch batch;
+    Py_buffer* views;          // Sequence form: one per item
+    Py_buffer blob;            // Offsets form
+    Py_buffer offsets_view;
+    int is_blob;
+} PayloadViews;
+
+static void batch_release(PayloadViews* views) {
+    if (views->is_blob) {
+        PyBuffer_Release(&views->blob);
+        PyBuffer_Release(&views->offsets_view);
+    } else if (views->views) {
+        for (size_t i = 0; i < views->batch.count; ++i) PyBuffer_Release(&views->views[i]);
+    }
+    PyMem_Free(views->views);
+    PyMem_Free(views->batch.data);
+    PyMem_Free(views->batch.sizes);
+    memset(views, 0, sizeof(*views));
+}
+
+// True for a buffer of native unsigned 64-bit integers, e.g. memoryview.cast('Q')
+static int is_u64_format(const Py_buffer* view) {
+    const char* fmt = view->format ? view->format : "B";
+    if (*fmt == '@' || *fmt == '=') fmt++;
+    return view->itemsize == 8 && fmt[1] == '\0' && (fmt[0] == 'Q' || fmt[0] == 'L' || fmt[0] == 'N');
+}
+
+/* Collect the payloads. With `offsets` (a buffer of count + 1 unsigned
+   64-bit offsets, as returned by the concat forms), `items` is one buffer
+   and item i is items[offsets[i]:offsets[i + 1]]. Returns -1 on error. */
+static int batch_collect(PyObject* items, PyObject* offsets, PayloadViews* views) {
+    PayloadBatch* batch = &views->batch;
+    memset(views, 0, sizeof(*views));
+
+    if (offsets && offsets != Py_None) {
+        views->is_blob = 1;
+        if (PyObject_GetBuffer(items, &views->blob, PyBUF_SIMPLE) < 0) return -1;
+        if (PyObject_GetBuffer(offsets, &views->offsets_view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) < 0) {
+            PyBuffer_Release(&views->blob);
+            return -1;
+        }
+        Py_ssize_t n = views->offsets_view.len / 8;
+        if (!is_u64_format(&views->offsets_view) || n < 1) {
+            PyErr_SetString(PyExc_TypeError, "offsets must be a buffer of unsigned 64-bit integers (format 'Q')");
+            PyBuffer_Release(&views->blob);
+            PyBuffer_Release(&views->offsets_view);
+            return -1;
+        }
+        batch->count = (size_t)n - 1;
+        batch->data = PyMem_Malloc((batch->count + 1) * sizeof(*batch->data));
+        batch->sizes = PyMem_Malloc((batch->count + 1) * sizeof(*batch->sizes));
+        if (!batch->data || !batch->sizes) {
+            batch_release(views);
+            PyErr_NoMemory();
+            return -1;
+        }
+
+        const uint64_t* offs = views->offsets_view.buf;
+        for (size_t i = 0; i < batch->count; ++i) {
+            if (offs[i] > offs[i + 1] || offs[i + 1] > (uint64_t)views->blob.len) {
+                PyErr_Format(PyExc_ValueError, "offsets[%zu:%zu] is out of range", i, i + 2);
+                batch_release(views);
+                return -1;
             }
-            continue; 
+            batch->data[i] = (const unsigned char*)views->blob.buf + offs[i];
+            batch->sizes[i] = (size_t)(offs[i + 1] - offs[i]);
         }
+        return 0;
+    }
 
-        int comp_size = LZ4_compress_default(
-            (const char*)(in_data + offset_in),
-            (char*)comp_buf,
-            (int)orig_size,
-            (int)max_comp
-        );
+    PyObject* seq = PySequence_Fast(items, "items must be a sequence of bytes-like objects");
+    if (!seq) return -1;
 
-        if (comp_size > 0 && comp_size < orig_size) {
-            results[i].comp_size = comp_size;
-            unsigned char* realloc_buf = realloc(comp_buf, comp_size);
-            if (realloc_buf) results[i].comp_buf = realloc_buf;
-            else results[i].comp_buf = comp_buf;
-        } else {
-            results[i].comp_size = (int)orig_size;
-            memcpy(comp_buf, in_data + offset_in, orig_size);
-            results[i].comp_buf = comp_buf;
+    batch->count = (size_t)PySequence_Fast_GET_SIZE(seq);
+    views->views = PyMem_Calloc(batch->count + 1, sizeof(Py_buffer));
+    batch->data = PyMem_Malloc((batch->count + 1) * sizeof(*batch->data));
+    batch->sizes = PyMem_Malloc((batch->count + 1) * sizeof(*batch->sizes));
+    if (!views->views || !batch->data || !batch->sizes) {
+        Py_DECREF(seq);
+        batch_release(views);
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    for (size_t i = 0; i < batch->count; ++i) {
+        if (PyObject_GetBuffer(PySequence_Fast_GET_ITEM(seq, i), &views->views[i], PyBUF_SIMPLE) < 0) {
+            batch->count = i; // Release only what we got
+            Py_DECREF(seq);
+            batch_release(views);
+            return -1;
         }
-        total_comp_size += results[i].comp_size + HEADER_SIZE;
+        batch->data[i] = views->views[i].buf;
+        batch->sizes[i] = (size_t)views->views[i].len;
     }
+    Py_DECREF(seq);
+    return 0;
+}
 
-    if (PyErr_Occurred()) { 
-        for (size_t i = 0; i < num_blocks; ++i) free(results[i].comp_buf);
-        free(results);
-        return NULL; 
+
+typedef struct {
+    PyObject_HEAD
+    WarpDict dict;
+} DictionaryObject;
+
+static PyObject* Dictionary_new(PyTypeObject* type, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"data", NULL};
+    Py_buffer content;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*", kwlist, &content)) return NULL;
+
+    DictionaryObject* self = (DictionaryObject*)type->tp_alloc(type, 0);
+    if (!self) {
+        PyBuffer_Release(&content);
+        return NULL;
     }
+    int err = dict_init(&self->dict, content.buf, content.len);
+    PyBuffer_Release(&content);
+    if (err) {
+        Py_DECREF(self);
+        return raise_error(err);
+    }
+    return (PyObject*)self;
+}
+
+static void Dictionary_dealloc(DictionaryObject* self) {
+    dict_free(&self->dict);
+    PyTypeObject* type = Py_TYPE(self);
+    type->tp_free((PyObject*)self);
+    Py_DECREF(type);
+}
+
+static PyObject* Dictionary_train(PyObject* cls, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"samples", "dict_size", NULL};
+    PyObject* samples;
+    Py_ssize_t dict_size = DICT_MAX_SIZE;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|n", kwlist, &samples, &dict_size)) return NULL;
+    if (dict_size <= 0 || dict_size > DICT_MAX_SIZE) {
+        PyErr_Format(PyExc_ValueError, "dict_size must be between 1 and %d", DICT_MAX_SIZE);
+        return NULL;
+    }
+
+    PayloadViews views;
+    const PayloadBatch* batch = &views.batch;
+    if (batch_collect(samples, NULL, &views) < 0) return NULL;
+    if (batch->count == 0) {
+        batch_release(&views);
+        PyErr_SetString(PyExc_ValueError, "train() needs at least one sample");
+        return NULL;
+    }
+
+    unsigned char* trained = malloc(dict_size);
+    size_t trained_size = 0;
+    int err = trained ? WH_OK : WH_ERR_NOMEM;
+    if (!err) {
+        Py_BEGIN_ALLOW_THREADS
+        err = train_dictionary(batch, (size_t)dict_size, trained, &trained_size);
+        Py_END_ALLOW_THREADS
+    }
+    batch_release(&views);
+
+    PyObject* result = NULL;
+    if (err) {
+        raise_error(err);
+    } else {
+        PyObject* content = PyBytes_FromStringAndSize((const char*)trained, trained_size);
+        if (content) result = PyObject_CallOneArg(cls, content);
+        Py_XDECREF(content);
+    }
+    free(trained);
+    return result;
+}
+
+static PyObject* Dictionary_get_id(DictionaryObject* self, void* Py_UNUSED(closure)) {
+    return PyLong_FromUnsignedLong(self->dict.id);
+}
+
+static int Dictionary_getbuffer(DictionaryObject* self, Py_buffer* view, int flags) {
+    return PyBuffer_FillInfo(view, (PyObject*)self, self->dict.data, self->dict.size, 1, flags);
+}
+
+static Py_ssize_t Dictionary_length(DictionaryObject* self) {
+    return (Py_ssize_t)self->dict.size;
+}
+
+static PyMethodDef Dictionary_methods[] = {
+    {"train", (PyCFunction)(void(*)(void))Dictionary_train, METH_VARARGS | METH_KEYWORDS | METH_CLASS, "Dictionary.train(samples, dict_size=65536)\nBuild a dictionary from representative sample payloads (a sequence of bytes-like objects)."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef Dictionary_getset[] = {
+    {"id", (getter)Dictionary_get_id, NULL, "32-bit dictionary id, recorded in seekable frames compressed with it", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyType_Slot Dictionary_slots[] = {
+    {Py_tp_dealloc, Dictionary_dealloc},
+    {Py_tp_doc, "Dictionary(data)\n\nShared LZ4 dictionary for compressing many small, similar payloads.\nOnly the last 64 KB of data are used; bytes(d) gives them back for storage.\nPass the same dictionary to compression and decompression."},
+    {Py_tp_methods, Dictionary_methods},
+    {Py_tp_getset, Dictionary_getset},
+    {Py_bf_getbuffer, Dictionary_getbuffer},
+    {Py_sq_length, Dictionary_length},
+    {Py_tp_new, Dictionary_new},
+    {0, NULL}
+};
+
+static PyType_Spec Dictionary_spec = {
+    .name = "warphybrid.Dictionary",
+    .basicsize = sizeof(DictionaryObject),
+    .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE,
+    .slots = Dictionary_slots,
+};
+
+/* Resolve a dictionary= argument for decoding (None means no dictionary). */
+static int get_dictionary(ModuleState* state, PyObject* obj, const WarpDict** dict) {
+    *dict = NULL;
+    if (!obj || obj == Py_None) return 0;
+    if (!PyObject_TypeCheck(obj, state->dictionary_type)) {
+        PyErr_Format(PyExc_TypeError, "dictionary must be a warphybrid.Dictionary, not %.200s", Py_TYPE(obj)->tp_name);
+        return -1;
+    }
+    *dict = &((DictionaryObject*)obj)->dict;
+    return 0;
+}
+
+/* Resolve a dictionary= argument for compressing with `opts` and load the
+   HC table its level needs. */
+static int use_dictionary(ModuleState* state, PyObject* obj, CompressOptions* opts) {
+    if (get_dictionary(state, obj, &opts->dict) < 0) return -1;
+    if (!opts->dict) return 0;
+
+    int level = opts->level;
+    if (opts->adaptive && level == 0) level = LZ4HC_CLEVEL_DEFAULT;
+    if (level > 0 && dict_prepare_level(&((DictionaryObject*)obj)->dict, level)) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    return 0;
+}
+
+
+/* Validate acceleration= / target_mbps= (already parsed into `opts`) and
+   point `opts` at `tuner` when there is a target. Returns -1 with an
+   exception set. */
+static int use_acceleration(double target_mbps, CompressOptions* opts, AccelTuner* tuner) {
+    if (opts->acceleration < 1) {
+        PyErr_Format(PyExc_ValueError, "acceleration must be at least 1, got %d", opts->acceleration);
+        return -1;
+    }
+    if (!isfinite(target_mbps) || target_mbps < 0) {
+        PyErr_SetString(PyExc_ValueError, "target_mbps must be non-negative (0 = no target)");
+        return -1;
+    }
+    if ((opts->acceleration > 1 || target_mbps > 0) && (opts->level > 0 || opts->adaptive)) {
+        PyErr_SetString(PyExc_ValueError, "acceleration and target_mbps only apply to level 0 without adaptive");
+        return -1;
+    }
+    if (target_mbps > 0) {
+        tuner->target = target_mbps * BYTES_PER_MB;
+        tuner->rate = 0;
+        tuner->acceleration = opts->acceleration;
+        opts->tuner = tuner;
+    }
+    return 0;
+}
+
+
+/* Compress function (The "Champion" V4 Version) */
+static PyObject* compress_hybrid(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"data", "block_size", "seekable", "level", "adaptive", "entropy_threshold", "threads",
+                             "dictionary", "linked", "checksum", "acceleration", "target_mbps", "format", "stats", "dedup",
+                             "typesize", NULL};
+    Py_buffer input;
+    Py_ssize_t block_size_arg = 0;  // None: auto
+    int threads = 0;
+    double target_mbps = 0;
+    PyObject* dictionary = NULL;
+    CompressOptions opts = default_compress_options;
+    AccelTuner tuner;
+    CallStats stats;
+    int want_stats = 0;
 
-    output = PyBytes_FromStringAndSize(NULL, total_comp_size);
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*|O&pipdiOppidippi", kwlist, &input, convert_block_size,
+                                     &block_size_arg, &opts.seekable,
+                                     &opts.level, &opts.adaptive, &opts.entropy_threshold, &threads, &dictionary,
+                                     &opts.linked, &opts.checksum, &opts.acceleration, &target_mbps, &opts.format,
+                                     &want_stats, &opts.dedup, &opts.typesize)) {
+        if (PyErr_ExceptionMatches(PyExc_TypeError)) {
+            PyErr_SetString(PyExc_TypeError, "Expected bytes and block_size (in bytes)");
+        }
+        return NULL;
+    }
+    stats_begin(&stats, want_stats);
+    opts.stats = &stats;
+    if (check_level(opts.level) < 0 || check_threads(threads) < 0 ||
+        check_format(opts.format) < 0 || use_dedup(&opts) < 0 || use_typesize(&opts) < 0 ||
+        use_acceleration(target_mbps, &opts, &tuner) < 0 ||
+        use_dictionary(module_state(self), dictionary, &opts) < 0) {
+        PyBuffer_Release(&input);
+        return NULL;
+    }
+
+    const unsigned char* in_data = input.buf;
+    size_t in_size = input.len;
+    if (opts.linked || opts.checksum) opts.seekable = 1;
+    opts.block_size = block_size_arg ? (size_t)block_size_arg : auto_block_size(in_size, threads, &opts);
+    size_t bound_size = frame_bound(in_size, &opts);
+
+    PyObject* output = PyBytes_FromStringAndSize(NULL, bound_size);
     if (!output) {
-        for (size_t i = 0; i < num_blocks; ++i) free(results[i].comp_buf);
-        free(results);
-        return PyErr_NoMemory();
+        PyBuffer_Release(&input);
+        return NULL;
     }
-    
     unsigned char* out_data = (unsigned char*)PyBytes_AS_STRING(output);
-    size_t out_offset = 0;
 
-    for (size_t i = 0; i < num_blocks; ++i) {
-        uint32_t orig_size_32 = (uint32_t)results[i].orig_size;
-        uint32_t comp_size_32 = (uint32_t)results[i].comp_size;
+    size_t total_comp_size = 0;
+    int err = WH_OK;
+
+    // The input buffer stays exported (and pinned) until PyBuffer_Release,
+    // so it is safe to read it with the GIL released.
+    Py_BEGIN_ALLOW_THREADS
+    opts.threads = acquire_threads(threads, (in_size + opts.block_size - 1) / opts.block_size);
+    err = compress_frame(in_data, in_size, &opts, out_data, &total_comp_size);
+    release_threads(opts.threads);
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&input);
 
-        memcpy(out_data + out_offset, &orig_size_32, 4);
-        memcpy(out_data + out_offset + 4, &comp_size_32, 4);
-        memcpy(out_data + out_offset + HEADER_SIZE, results[i].comp_buf, comp_size_32);
-        
-        out_offset += HEADER_SIZE + comp_size_32;
-        free(results[i].comp_buf); 
+    if (err) {
+        Py_DECREF(output);
+        return raise_error(err);
     }
-    
-    free(results);
+
+    // Give back the unused tail of the bound-sized buffer
+    if (total_comp_size != bound_size && _PyBytes_Resize(&output, total_comp_size) < 0) return NULL;
+    stats.threads = opts.threads;
+    stats.bytes_in = in_size;
+    stats.bytes_out = total_comp_size;
+    stats.bytes_allocated += bound_size;
+    return finish_call(output, &stats, 1);
+}
+
+
+/* compress_hybrid() into a caller-provided writable buffer. */
+static PyObject* compress_into(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"data", "dst", "block_size", "seekable", "level", "adaptive", "entropy_threshold",
+                             "threads", "dictionary", "linked", "checksum", "acceleration", "target_mbps", "format",
+                             "stats", "dedup", "typesize", NULL};
+    Py_buffer input, dst;
+    Py_ssize_t block_size_arg = 0;  // None: auto
+    int threads = 0;
+    double target_mbps = 0;
+    PyObject* dictionary = NULL;
+    CompressOptions opts = default_compress_options;
+    AccelTuner tuner;
+    CallStats stats;
+    int want_stats = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*w*|O&pipdiOppidippi", kwlist, &input, &dst,
+                                     convert_block_size, &block_size_arg,
+                                     &opts.seekable, &opts.level, &opts.adaptive, &opts.entropy_threshold, &threads,
+                                     &dictionary, &opts.linked, &opts.checksum, &opts.acceleration, &target_mbps,
+                                     &opts.format, &want_stats, &opts.dedup, &opts.typesize)) {
+        return NULL;
+    }
+    stats_begin(&stats, want_stats);
+    opts.stats = &stats;
+    if (check_level(opts.level) < 0 || check_threads(threads) < 0 ||
+        check_format(opts.format) < 0 || use_dedup(&opts) < 0 || use_typesize(&opts) < 0 ||
+        use_acceleration(target_mbps, &opts, &tuner) < 0 ||
+        use_dictionary(module_state(self), dictionary, &opts) < 0) {
+        PyBuffer_Release(&input);
+        PyBuffer_Release(&dst);
+        return NULL;
+    }
+
+    size_t in_size = input.len;
+    if (opts.linked || opts.checksum) opts.seekable = 1;
+    opts.block_size = block_size_arg ? (size_t)block_size_arg : auto_block_size(in_size, threads, &opts);
+    size_t bound_size = frame_bound(input.len, &opts);
+    if ((size_t)dst.len < bound_size) {
+        PyErr_Format(PyExc_ValueError, "dst is too small: %zd bytes, compress_bound() says %zu", dst.len, bound_size);
+        PyBuffer_Release(&input);
+        PyBuffer_Release(&dst);
+        return NULL;
+    }
+
+    size_t total_comp_size = 0;
+    int err = WH_OK;
+
+    Py_BEGIN_ALLOW_THREADS
+    opts.threads = acquire_threads(threads, ((size_t)input.len + opts.block_size - 1) / opts.block_size);
+    err = compress_frame(input.buf, input.len, &opts, dst.buf, &total_comp_size);
+    release_threads(opts.threads);
+    Py_END_ALLOW_THREADS
+
     PyBuffer_Release(&input);
-    return output;
+    PyBuffer_Release(&dst);
+
+    if (err) return raise_error(err);
+    stats.threads = opts.threads;
+    stats.bytes_in = in_size;
+    stats.bytes_out = total_comp_size;
+    return finish_call(PyLong_FromSize_t(total_comp_size), &stats, 1);
 }
 
 
-// --- NEW: Block Index struct for parallel decompression ---
-typedef struct {
-    size_t in_offset;   // Start of compressed data
-    size_t out_offset;  // Start of decompressed data
-    uint32_t comp_size;
-    uint32_t orig_size;
-} BlockIndex;
+/* Size a compress_into() destination. */
+static PyObject* compress_bound(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"size", "block_size", "seekable", "dictionary", "linked", "checksum", "format", "dedup",
+                             "typesize", NULL};
+    Py_ssize_t size, block_size_arg = 0;  // None: auto
+    PyObject* dictionary = NULL;
+    CompressOptions opts = default_compress_options;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "n|O&pOppipi", kwlist, &size, convert_block_size, &block_size_arg,
+                                     &opts.seekable,
+                                     &dictionary, &opts.linked, &opts.checksum, &opts.format, &opts.dedup,
+                                     &opts.typesize)) {
+        return NULL;
+    }
+    if (opts.linked || opts.checksum) opts.seekable = 1;
+    if (get_dictionary(module_state(self), dictionary, &opts.dict) < 0) return NULL;
+    if (size < 0) {
+        PyErr_SetString(PyExc_ValueError, "size must be non-negative");
+        return NULL;
+    }
+    if (check_format(opts.format) < 0 || use_dedup(&opts) < 0 ||
+        use_typesize(&opts) < 0) {
+        return NULL;
+    }
+
+    // Auto sizing never picks blocks smaller than this, so it bounds every team
+    opts.block_size = block_size_arg ? (size_t)block_size_arg : auto_block_size(0, 0, &opts);
+    return PyLong_FromSize_t(frame_bound((size_t)size, &opts));
+}
 
 
 /* Decompress function (NEW: Multithreaded) */
-static PyObject* decompress_hybrid(PyObject* self, PyObject* args) {
+static PyObject* decompress_hybrid(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"data", "threads", "dictionary", "stats", "max_output_size", NULL};
     Py_buffer input;
-    if (!PyArg_ParseTuple(args, "y*", &input)) return NULL;
+    int threads = 0;
+    PyObject* dictionary = NULL;
+    const WarpDict* dict;
+    CallStats stats;
+    int want_stats = 0;
+    Py_ssize_t max_output_size = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*|iOpn", kwlist, &input, &threads, &dictionary, &want_stats,
+                                     &max_output_size)) {
+        return NULL;
+    }
+    stats_begin(&stats, want_stats);
+    if (max_output_size < 0) {
+        PyErr_SetString(PyExc_ValueError, "max_output_size must be >= 0");
+        PyBuffer_Release(&input);
+        return NULL;
+    }
+    if (check_threads(threads) < 0 || get_dictionary(module_state(self), dictionary, &dict) < 0) {
+        PyBuffer_Release(&input);
+        return NULL;
+    }
 
     const unsigned char* in_data = input.buf;
     size_t in_size = input.len;
-    size_t in_offset = 0;
-    
-    size_t num_blocks = 0;
-    size_t total_uncompressed_size = 0;
-    BlockIndex* index = NULL;
-    size_t index_capacity = 1024; // Start with capacity for 1024 blocks
-
-    index = malloc(index_capacity * sizeof(BlockIndex));
-    if (!index) return PyErr_NoMemory();
-
-    // --- PASS 1: Build the block index (single-threaded) ---
-    while (in_offset + HEADER_SIZE <= in_size) {
-        uint32_t block_size, comp_size;
-        memcpy(&block_size, in_data + in_offset, 4);
-        memcpy(&comp_size, in_data + in_offset + 4, 4);
-
-        if (block_size > MAX_BLOCK_SIZE || comp_size > in_size - (in_offset + HEADER_SIZE)) {
-            free(index);
-            PyBuffer_Release(&input);
-            return PyErr_Format(PyExc_RuntimeError, "Hybrid decompression failed: invalid block header (size %u)", block_size);
-        }
-
-        // Grow index array if needed
-        if (num_blocks >= index_capacity) {
-            index_capacity *= 2;
-            BlockIndex* new_index = realloc(index, index_capacity * sizeof(BlockIndex));
-            if (!new_index) {
-                free(index);
-                PyBuffer_Release(&input);
-                return PyErr_NoMemory();
-            }
-            index = new_index;
-        }
+    BlockTable table;
+    int err = WH_OK;
 
-        // Store block info
-        index[num_blocks].in_offset = in_offset + HEADER_SIZE;
-        index[num_blocks].out_offset = total_uncompressed_size;
-        index[num_blocks].orig_size = block_size;
-        index[num_blocks].comp_size = comp_size;
+    // --- PASS 1: Build the block index (skipped for seekable frames) ---
+    // With a limit, the walk stops as soon as the blocks exceed it
+    size_t stop_out = max_output_size ? (size_t)max_output_size + 1 : SIZE_MAX;
+    Py_BEGIN_ALLOW_THREADS
+    err = load_block_table(in_data, in_size, stop_out, dict, &table);
+    Py_END_ALLOW_THREADS
+    double t = stats_lap(&stats.index_seconds, stats.start);
 
-        // Move to next block
-        in_offset += HEADER_SIZE + comp_size;
-        total_uncompressed_size += block_size;
-        num_blocks++;
+    if (err) {
+        PyBuffer_Release(&input);
+        return raise_error(err);
     }
-
-    if (in_offset != in_size) {
-        free(index);
+    if (max_output_size && table.total_size > (size_t)max_output_size) {
+        PyErr_Format(PyExc_ValueError, "data decompresses to more than max_output_size (%zd bytes)", max_output_size);
+        free_block_table(&table);
         PyBuffer_Release(&input);
-        return PyErr_Format(PyExc_RuntimeError, "Hybrid decompression failed: trailing data");
+        return NULL;
     }
 
     // --- PASS 2: Decompress all blocks in parallel ---
-    PyObject* out = PyBytes_FromStringAndSize(NULL, total_uncompressed_size); 
+    PyObject* out = PyBytes_FromStringAndSize(NULL, table.total_size); 
     if (!out) {
-        free(index);
+        free_block_table(&table);
         PyBuffer_Release(&input);
-        return PyErr_NoMemory();
+        return NULL;
     }
     
     unsigned char* out_data = (unsigned char*)PyBytes_AS_STRING(out);
-    int error_flag = 0;
+    if (table.total_size >= HUGE_ADVISE_MIN) advise_huge_pages(out_data, table.total_size);
 
-    #pragma omp parallel for schedule(dynamic)
-    for (size_t i = 0; i < num_blocks; ++i) {
-        if (error_flag) continue; // Stop if an error has occurred in another thread
-
-        const BlockIndex* block = &index[i];
-        const unsigned char* in_ptr = in_data + block->in_offset;
-        unsigned char* out_ptr = out_data + block->out_offset;
-        
-        if (block->comp_size == block->orig_size) {
-            // Data was stored uncompressed, just copy it
-            memcpy(out_ptr, in_ptr, block->orig_size);
-        } else {
-            // Data is LZ4 compressed, decompress it
-            int decomp_size = LZ4_decompress_safe(
-                (const char*)in_ptr,
-                (char*)out_ptr,
-                (int)block->comp_size,
-                (int)block->orig_size
-            );
-            if (decomp_size != (int)block->orig_size) {
-                #pragma omp critical
-                {
-                    if (!PyErr_Occurred()) {
-                        PyErr_Format(PyExc_RuntimeError, "Hybrid decompression failed: LZ4 size mismatch");
-                    }
-                    error_flag = 1;
-                }
-            }
-        }
-    } // --- END PARALLEL LOOP ---
+    Py_BEGIN_ALLOW_THREADS
+    threads = acquire_threads(threads, table_tasks(&table));
+    err = decode_table(&table, out_data, threads);
+    release_threads(threads);
+    Py_END_ALLOW_THREADS
+    stats_lap(&stats.work_seconds, t);
 
-    free(index);
+    stats_add_table(&stats, &table, 0, table.num_blocks - 1);
+    stats.threads = threads;
+    stats.bytes_in = in_size;
+    stats.bytes_out = table.total_size;
+    stats.bytes_allocated += table.total_size;
+    free_block_table(&table);
     PyBuffer_Release(&input);
     
-    if (error_flag) {
+    if (err) {
         Py_DECREF(out);
+        return raise_error(err);
+    }
+
+    return finish_call(out, &stats, 0);
+}
+
+
+/* decompress_hybrid() into a caller-provided writable buffer. */
+static PyObject* decompress_into(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"data", "dst", "threads", "dictionary", "stats", NULL};
+    Py_buffer input, dst;
+    int threads = 0;
+    PyObject* dictionary = NULL;
+    const WarpDict* dict;
+    CallStats stats;
+    int want_stats = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*w*|iOp", kwlist, &input, &dst, &threads, &dictionary,
+                                     &want_stats)) {
         return NULL;
     }
-    
-    return out;
+    stats_begin(&stats, want_stats);
+    if (check_threads(threads) < 0 || get_dictionary(module_state(self), dictionary, &dict) < 0) {
+        PyBuffer_Release(&input);
+        PyBuffer_Release(&dst);
+        return NULL;
+    }
+
+    BlockTable table;
+    int err = WH_OK;
+
+    Py_BEGIN_ALLOW_THREADS
+    err = load_block_table(input.buf, input.len, SIZE_MAX, dict, &table);
+    Py_END_ALLOW_THREADS
+    double t = stats_lap(&stats.index_seconds, stats.start);
+
+    if (err) {
+        PyBuffer_Release(&input);
+        PyBuffer_Release(&dst);
+        return raise_error(err);
+    }
+    if ((size_t)dst.len < table.total_size) {
+        PyErr_Format(PyExc_ValueError, "dst is too small: %zd bytes, data decompresses to %zu", dst.len, table.total_size);
+        free_block_table(&table);
+        PyBuffer_Release(&input);
+        PyBuffer_Release(&dst);
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    threads = acquire_threads(threads, table_tasks(&table));
+    err = decode_table(&table, dst.buf, threads);
+    release_threads(threads);
+    Py_END_ALLOW_THREADS
+    stats_lap(&stats.work_seconds, t);
+
+    size_t total_size = table.total_size;
+    stats_add_table(&stats, &table, 0, table.num_blocks - 1);
+    stats.threads = threads;
+    stats.bytes_in = input.len;
+    stats.bytes_out = total_size;
+    free_block_table(&table);
+    PyBuffer_Release(&input);
+    PyBuffer_Release(&dst);
+
+    if (err) return raise_error(err);
+    return finish_call(PyLong_FromSize_t(total_size), &stats, 0);
 }
 
 
-/* Python Module Definitions */
-static PyMethodDef WarpHybridMethods[] = {
-    {"compress_hybrid", compress_hybrid, METH_VARARGS, "Compress using Blocked LZ4 (multithreaded).\nArgs: (data_bytes, block_size_in_bytes)"},
-    {"decompress_hybrid", decompress_hybrid, METH_VARARGS, "Decompress Blocked LZ4 (multithreaded)"},
-    {NULL, NULL, 0, NULL}
+/* Random-access decompress: only the blocks overlapping the range are decoded. */
+static PyObject* decompress_range(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"data", "offset", "length", "threads", "dictionary", "stats", NULL};
+    Py_buffer input;
+    Py_ssize_t offset_arg, length_arg;
+    int threads = 0;
+    PyObject* dictionary = NULL;
+    const WarpDict* dict;
+    CallStats stats;
+    int want_stats = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*nn|iOp", kwlist, &input, &offset_arg, &length_arg, &threads,
+                                     &dictionary, &want_stats)) {
+        return NULL;
+    }
+    stats_begin(&stats, want_stats);
+    if (check_threads(threads) < 0 || get_dictionary(module_state(self), dictionary, &dict) < 0) {
+        PyBuffer_Release(&input);
+        return NULL;
+    }
+    if (offset_arg < 0 || length_arg < 0) {
+        PyBuffer_Release(&input);
+        PyErr_SetString(PyExc_ValueError, "offset and length must be non-negative");
+        return NULL;
+    }
+
+    const unsigned char* in_data = input.buf;
+    size_t in_size = input.len;
+    size_t offset = (size_t)offset_arg;
+    size_t end = (size_t)length_arg > SIZE_MAX - offset ? SIZE_MAX : offset + (size_t)length_arg;
+    BlockTable table;
+    int err = WH_OK;
+
+    // Plain frames are walked only as far as the end of the range
+    Py_BEGIN_ALLOW_THREADS
+    err = load_block_table(in_data, in_size, end, dict, &table);
+    Py_END_ALLOW_THREADS
+    double t = stats_lap(&stats.index_seconds, stats.start);
+
+    if (err) {
+        PyBuffer_Release(&input);
+        return raise_error(err);
+    }
+
+    // Clamp to the data, like a file read past EOF
+    if (end > table.total_size) end = table.total_size;
+    if (offset > end) offset = end;
+
+    PyObject* out = PyBytes_FromStringAndSize(NULL, end - offset);
+    if (!out || offset == end) {
+        stats.bytes_in = in_size;
+        free_block_table(&table);
+        PyBuffer_Release(&input);
+        return finish_call(out, &stats, 0);
+    }
+
+    unsigned char* out_data = (unsigned char*)PyBytes_AS_STRING(out);
+    size_t first = find_block(&table, offset);
+    size_t last = find_block(&table, end - 1);
+
+    Py_BEGIN_ALLOW_THREADS
+    threads = acquire_threads(threads, (last / table.group_blocks - first / table.group_blocks) + 1);
+    if (table.group_blocks > 1) err = decode_linked_range(&table, first, last, offset, end, out_data, threads);
+    else err = decode_blocks_range(&table, first, last, offset, end, out_data, threads);
+    release_threads(threads);
+    Py_END_ALLOW_THREADS
+    stats_lap(&stats.work_seconds, t);
+
+    stats_add_table(&stats, &table, first, last);
+    stats.threads = threads;
+    stats.bytes_in = in_size;
+    stats.bytes_out = end - offset;
+    stats.bytes_allocated += end - offset;
+    free_block_table(&table);
+    PyBuffer_Release(&input);
+
+    if (err) {
+        Py_DECREF(out);
+        return raise_error(err);
+    }
+
+    return finish_call(out, &stats, 0);
+}
+
+
+/* Sizes and layout of a frame, read from its footer or headers; nothing is
+   decoded. */
+static PyObject* frame_info(PyObject* self, PyObject* args) {
+    Py_buffer input;
+    if (!PyArg_ParseTuple(args, "y*", &input)) return NULL;
+
+    FrameInfo info;
+    int err;
+    Py_BEGIN_ALLOW_THREADS
+    err = inspect_frame(input.buf, input.len, &info);
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&input);
+    if (err) return raise_error(err);
+
+    int linked = info.group_blocks > 1 || (info.block_flags & BLOCK_FLAG_LINKED);
+    int dictionary = (info.footer_flags & FOOTER_FLAG_DICT) || (info.block_flags & BLOCK_FLAG_DICT);
+    PyObject* dict_id = Py_None;
+    if (info.footer_flags & FOOTER_FLAG_DICT) {
+        dict_id = PyLong_FromUnsignedLong(info.dict_id);
+        if (!dict_id) return NULL;
+    } else {
+        Py_INCREF(dict_id);
+    }
+    return Py_BuildValue("{s:n,s:n,s:n,s:i,s:N,s:N,s:N,s:N,s:N}",
+                         "total_size", (Py_ssize_t)info.total_size,
+                         "num_blocks", (Py_ssize_t)info.num_blocks,
+                         "block_size", (Py_ssize_t)info.block_size,
+                         "format", info.format,
+                         "seekable", PyBool_FromLong(info.seekable),
+                         "linked", PyBool_FromLong(linked),
+                         "checksum", PyBool_FromLong(info.footer_flags & FOOTER_FLAG_CHECKSUM),
+                         "dictionary", PyBool_FromLong(dictionary),
+                         "dictionary_id", dict_id);
+}
+
+
+
+/* Check a frame without producing its output: headers, every block's LZ4
+   data and, when recorded, checksums. Returns None, or a dict saying why
+   and (for a block failure) where the data first goes bad. */
+static PyObject* verify(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"data", "threads", "dictionary", NULL};
+    Py_buffer input;
+    int threads = 0;
+    PyObject* dictionary = NULL;
+    const WarpDict* dict;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*|iO", kwlist, &input, &threads, &dictionary)) return NULL;
+    if (check_threads(threads) < 0 || get_dictionary(module_state(self), dictionary, &dict) < 0) {
+        PyBuffer_Release(&input);
+        return NULL;
+    }
+
+    BlockTable table;
+    size_t bad_block = SIZE_MAX;
+    size_t bad_offset = 0;
+    int err;
+    Py_BEGIN_ALLOW_THREADS
+    err = load_block_table(input.buf, input.len, SIZE_MAX, dict, &table);
+    if (!err) {
+        threads = acquire_threads(threads, table_tasks(&table));
+        err = verify_table(&table, threads, &bad_block);
+        release_threads(threads);
+        if (err && bad_block != SIZE_MAX) bad_offset = block_out_offset(&table, bad_block);
+        free_block_table(&table);
+    }
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&input);
+
+    // Only damage is reported; a missing dictionary or memory is the caller's problem
+    if (err == WH_OK) Py_RETURN_NONE;
+    if (err == WH_ERR_NOMEM || err == WH_ERR_DICT) return raise_error(err);
+    if (bad_block == SIZE_MAX) return Py_BuildValue("{s:O,s:O,s:s}", "block", Py_None, "offset", Py_None,
+                                                    "error", wh_error_string(err));
+    return Py_BuildValue("{s:n,s:n,s:s}", "block", (Py_ssize_t)bad_block, "offset", (Py_ssize_t)bad_offset,
+                         "error", wh_error_string(err));
+}
+
+// --- Batch API: many small payloads in one call ---
+
+/* Build the (blob, offsets) result: offsets becomes a memoryview of
+   count + 1 unsigned 64-bit integers. Steals `blob`. */
+static PyObject* concat_result(PyObject* blob, const size_t* frame_offsets, Py_ssize_t count) {
+    PyObject* raw = PyBytes_FromStringAndSize(NULL, (count + 1) * 8);
+    if (!raw) {
+        Py_DECREF(blob);
+        return NULL;
+    }
+    uint64_t* offs = (uint64_t*)PyBytes_AS_STRING(raw);
+    for (Py_ssize_t i = 0; i <= count; ++i) offs[i] = frame_offsets[i];
+
+    PyObject* view = PyMemoryView_FromObject(raw);
+    Py_DECREF(raw);
+    PyObject* cast = view ? PyObject_CallMethod(view, "cast", "s", "Q") : NULL;
+    Py_XDECREF(view);
+    if (!cast) {
+        Py_DECREF(blob);
+        return NULL;
+    }
+    return Py_BuildValue("(NN)", blob, cast);
+}
+
+/* Split a blob into one bytes object per frame. */
+static PyObject* split_result(PyObject* blob, const size_t* frame_offsets, Py_ssize_t count) {
+    PyObject* list = PyList_New(count);
+    if (!list) return NULL;
+    const char* base = PyBytes_AS_STRING(blob);
+    for (Py_ssize_t i = 0; i < count; ++i) {
+        PyObject* item = PyBytes_FromStringAndSize(base + frame_offsets[i], frame_offsets[i + 1] - frame_offsets[i]);
+        if (!item) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, i, item);
+    }
+    return list;
+}
+
+
+/* Compress many payloads in one call, spreading all of their blocks across
+   the thread team. */
+static PyObject* compress_many(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"items", "block_size", "level", "adaptive", "entropy_threshold", "concat", "threads",
+                             "dictionary", "acceleration", "target_mbps", "format", "stats", NULL};
+    PyObject* items;
+    Py_ssize_t block_size_arg = DEFAULT_BLOCK_SIZE;
+    int concat = 0, threads = 0;
+    double target_mbps = 0;
+    PyObject* dictionary = NULL;
+    CompressOptions opts = default_compress_options;
+    AccelTuner tuner;
+    CallStats stats;
+    int want_stats = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|nipdpiOidip", kwlist, &items, &block_size_arg, &opts.level,
+                                     &opts.adaptive, &opts.entropy_threshold, &concat, &threads, &dictionary,
+                                     &opts.acceleration, &target_mbps, &opts.format,
+                                     &want_stats)) {
+        return NULL;
+    }
+    stats_begin(&stats, want_stats);
+    opts.stats = &stats;
+    if (check_block_size(block_size_arg) < 0 || check_level(opts.level) < 0 || check_threads(threads) < 0 ||
+        check_format(opts.format) < 0 || use_acceleration(target_mbps, &opts, &tuner) < 0 ||
+        use_dictionary(module_state(self), dictionary, &opts) < 0) {
+        return NULL;
+    }
+    opts.block_size = (size_t)block_size_arg;
+
+    PayloadViews views;
+    const PayloadBatch* batch = &views.batch;
+    if (batch_collect(items, NULL, &views) < 0) return NULL;
+
+    size_t bound_size = 0, total_blocks = 0;
+    for (size_t i = 0; i < batch->count; ++i) {
+        bound_size += frame_prefix_size(opts.format) + blocks_bound(batch->sizes[i], opts.block_size, opts.format);
+        total_blocks += (batch->sizes[i] + opts.block_size - 1) / opts.block_size;
+    }
+
+    size_t* frame_offsets = PyMem_Malloc((batch->count + 1) * sizeof(size_t));
+    PyObject* blob = PyBytes_FromStringAndSize(NULL, bound_size);
+    if (!frame_offsets || !blob) {
+        PyMem_Free(frame_offsets);
+        Py_XDECREF(blob);
+        batch_release(&views);
+        return blob ? PyErr_NoMemory() : NULL;
+    }
+
+    int err = WH_OK;
+    Py_BEGIN_ALLOW_THREADS
+    opts.threads = acquire_threads(threads, total_blocks);
+    err = compress_batch(batch, &opts, (unsigned char*)PyBytes_AS_STRING(blob), frame_offsets);
+    release_threads(opts.threads);
+    Py_END_ALLOW_THREADS
+
+    Py_ssize_t count = (Py_ssize_t)batch->count;
+    for (Py_ssize_t i = 0; i < count; ++i) stats.bytes_in += batch->sizes[i];
+    batch_release(&views);
+    stats.threads = opts.threads;
+    stats.bytes_allocated += bound_size;
+
+    PyObject* result = NULL;
+    if (err) {
+        Py_DECREF(blob);
+        raise_error(err);
+    } else if (frame_offsets[count] != bound_size && _PyBytes_Resize(&blob, frame_offsets[count]) < 0) {
+        // blob is gone
+    } else if (concat) {
+        result = concat_result(blob, frame_offsets, count);
+    } else {
+        result = split_result(blob, frame_offsets, count);
+        Py_DECREF(blob);
+    }
+    if (result) stats.bytes_out = frame_offsets[count];
+    PyMem_Free(frame_offsets);
+    return finish_call(result, &stats, 1);
+}
+
+
+/* Decompress many frames in one call, spreading all of their blocks across
+   the thread team. */
+static PyObject* decompress_many(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"items", "offsets", "concat", "threads", "dictionary", "stats", NULL};
+    PyObject* items;
+    PyObject* offsets = NULL;
+    int concat = 0, threads = 0;
+    PyObject* dictionary = NULL;
+    const WarpDict* dict;
+    CallStats stats;
+    int want_stats = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|OpiOp", kwlist, &items, &offsets, &concat, &threads,
+                                     &dictionary, &want_stats)) {
+        return NULL;
+    }
+    stats_begin(&stats, want_stats);
+    if (check_threads(threads) < 0 || get_dictionary(module_state(self), dictionary, &dict) < 0) return NULL;
+
+    PayloadViews views;
+    const PayloadBatch* batch = &views.batch;
+    if (batch_collect(items, offsets, &views) < 0) return NULL;
+
+    Py_ssize_t count = (Py_ssize_t)batch->count;
+    size_t* first_block = PyMem_Malloc((count + 1) * sizeof(size_t));
+    size_t* frame_sizes = PyMem_Malloc((count + 1) * sizeof(size_t));
+    size_t* out_offsets = PyMem_Malloc((count + 1) * sizeof(size_t));
+    unsigned char** outputs = PyMem_Malloc((count + 1) * sizeof(unsigned char*));
+    PyObject* result = NULL;
+    PyObject* blob = NULL;
+    int err = WH_OK;
+
+    if (!first_block || !frame_sizes || !out_offsets || !outputs) {
+        PyErr_NoMemory();
+        goto done;
+    }
+
+    // Size every frame first (headers only), in parallel
+    Py_BEGIN_ALLOW_THREADS
+    int team = acquire_threads(threads, (size_t)count);
+    #pragma omp parallel for if(team > 1) num_threads(team) schedule(dynamic, 16)
+    for (Py_ssize_t i = 0; i < count; ++i) {
+        if (err) continue;
+        size_t group;
+        const unsigned char* checksums;
+        int frame_err = scan_frame(batch->data[i], batch->sizes[i], dict, NULL, &first_block[i], &frame_sizes[i], &group,
+                                   &checksums);
+        if (frame_err) set_error(&err, frame_err);
+    }
+    release_threads(team);
+    Py_END_ALLOW_THREADS
+    double t = stats_lap(&stats.index_seconds, stats.start);
+    if (err) {
+        raise_error(err);
+        goto done;
+    }
+
+    size_t total_blocks = 0, total_size = 0;
+    for (Py_ssize_t i = 0; i < count; ++i) {
+        size_t n = first_block[i];
+        first_block[i] = total_blocks;
+        out_offsets[i] = total_size;
+        total_blocks += n;
+        total_size += frame_sizes[i];
+    }
+    first_block[count] = total_blocks;
+    out_offsets[count] = total_size;
+
+    // Decode straight into the final objects
+    if (concat) {
+        blob = PyBytes_FromStringAndSize(NULL, total_size);
+        if (!blob) goto done;
+        for (Py_ssize_t i = 0; i < count; ++i) outputs[i] = (unsigned char*)PyBytes_AS_STRING(blob) + out_offsets[i];
+    } else {
+        result = PyList_New(count);
+        if (!result) goto done;
+        for (Py_ssize_t i = 0; i < count; ++i) {
+            PyObject* item = PyBytes_FromStringAndSize(NULL, frame_sizes[i]);
+            if (!item) {
+                Py_CLEAR(result);
+                goto done;
+            }
+            PyList_SET_ITEM(result, i, item);
+            outputs[i] = (unsigned char*)PyBytes_AS_STRING(item);
+        }
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    threads = acquire_threads(threads, total_blocks);
+    err = decode_batch(batch, first_block, total_blocks, dict, outputs, threads, &stats);
+    release_threads(threads);
+    Py_END_ALLOW_THREADS
+    stats_lap(&stats.work_seconds, t);
+    stats.threads = threads;
+    stats.bytes_out = total_size;
+    stats.bytes_allocated += total_size;
+    for (Py_ssize_t i = 0; i < count; ++i) stats.bytes_in += batch->sizes[i];
+
+    if (err) {
+        Py_CLEAR(result);
+        Py_CLEAR(blob);
+        raise_error(err);
+    } else if (concat) {
+        result = concat_result(blob, out_offsets, count);
+        blob = NULL;
+    }
+
+done:
+    Py_XDECREF(blob);
+    PyMem_Free(first_block);
+    PyMem_Free(frame_sizes);
+    PyMem_Free(out_offsets);
+    PyMem_Free(outputs);
+    batch_release(&views);
+    return finish_call(result, &stats, 0);
+}
+
+/* Compress into a standard LZ4 frame with independent blocks, readable by
+   the lz4 CLI and any lz4frame consumer. Blocks are compressed across the
+   team exactly as for compress_hybrid(), then re-framed into the output. */
+static PyObject* compress_lz4_frame(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"data", "block_size", "level", "content_checksum", "block_checksum", "threads",
+                             "acceleration", "target_mbps", "stats", NULL};
+    Py_buffer input;
+    Py_ssize_t block_size_arg = DEFAULT_BLOCK_SIZE;
+    int content_checksum = 1, block_checksum = 0, threads = 0;
+    double target_mbps = 0;
+    CompressOptions opts = default_compress_options;
+    AccelTuner tuner;
+    CallStats stats;
+    int want_stats = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*|nippiidp", kwlist, &input, &block_size_arg, &opts.level,
+                                     &content_checksum, &block_checksum, &threads, &opts.acceleration, &target_mbps,
+                                     &want_stats)) {
+        return NULL;
+    }
+    stats_begin(&stats, want_stats);
+    int block_id = block_size_arg > 0 ? lz4frame_block_id((size_t)block_size_arg) : 0;
+    if (check_level(opts.level) < 0 || check_threads(threads) < 0 || use_acceleration(target_mbps, &opts, &tuner) < 0) {
+        PyBuffer_Release(&input);
+        return NULL;
+    }
+    if (!block_id) {
+        PyErr_Format(PyExc_ValueError, "LZ4 frames need a block_size of 64 KB, 256 KB, 1 MB or 4 MB, got %zd",
+                     block_size_arg);
+        PyBuffer_Release(&input);
+        return NULL;
+    }
+
+    const unsigned char* in_data = input.buf;
+    size_t in_size = input.len;
+    opts.block_size = (size_t)block_size_arg;
+    size_t num_blocks = (in_size + opts.block_size - 1) / opts.block_size;
+    unsigned char* slots = malloc(blocks_bound(in_size, opts.block_size, 1) + 1);
+    BlockResult* results = calloc(num_blocks ? num_blocks : 1, sizeof(BlockResult));
+    if (!slots || !results) {
+        free(slots);
+        free(results);
+        PyBuffer_Release(&input);
+        return PyErr_NoMemory();
+    }
+
+    uint32_t content_hash = 0;
+    size_t slots_size;
+    double t;
+    Py_BEGIN_ALLOW_THREADS
+    opts.threads = acquire_threads(threads, num_blocks);
+    t = omp_get_wtime();
+    compress_to_slots(in_data, in_size, &opts, slots, results, &slots_size, content_checksum ? &content_hash : NULL);
+    t = stats_lap(&stats.work_seconds, t);
+    release_threads(opts.threads);
+    Py_END_ALLOW_THREADS
+
+    // Now that the block sizes are known the frame can be sized exactly:
+    // each block trades our 8-byte header for a 4-byte one (+ checksum)
+    size_t header_len = LZ4FRAME_HEADER_MAX;
+    size_t block_extra = 4 + (block_checksum ? 4 : 0);
+    size_t frame_size = header_len + slots_size - num_blocks * HEADER_SIZE + num_blocks * block_extra + 4 +
+                        (content_checksum ? 4 : 0);
+    PyObject* output = PyBytes_FromStringAndSize(NULL, frame_size);
+    if (!output) {
+        free(slots);
+        free(results);
+        PyBuffer_Release(&input);
+        return NULL;
+    }
+    unsigned char* out_data = (unsigned char*)PyBytes_AS_STRING(output);
+
+    uint32_t magic = LZ4FRAME_MAGIC;
+    uint64_t content_size = in_size;
+    memcpy(out_data, &magic, 4);
+    out_data[4] = LZ4FRAME_FLG_VERSION | LZ4FRAME_FLG_INDEPENDENT | LZ4FRAME_FLG_CONTENT_SIZE |
+                  (block_checksum ? LZ4FRAME_FLG_BLOCK_CHECKSUM : 0) |
+                  (content_checksum ? LZ4FRAME_FLG_CONTENT_CHECKSUM : 0);
+    out_data[5] = (unsigned char)(block_id << 4);
+    memcpy(out_data + 6, &content_size, 8);
+    out_data[14] = (unsigned char)(XXH32(out_data + 4, header_len - 5, 0) >> 8);
+
+    Py_BEGIN_ALLOW_THREADS
+    int team = acquire_threads(threads, num_blocks);
+    #pragma omp parallel for if(team > 1) num_threads(team) schedule(runtime)
+    for (size_t i = 0; i < num_blocks; ++i) {
+        const BlockResult* r = &results[i];
+        unsigned char* dst = out_data + header_len + r->out_offset - i * HEADER_SIZE + i * block_extra;
+        uint32_t comp_size = (uint32_t)r->comp_size;
+        uint32_t block_header = comp_size | ((size_t)comp_size == r->orig_size ? LZ4FRAME_UNCOMPRESSED : 0);
+        memcpy(dst, &block_header, 4);
+        memcpy(dst + 4, slots + r->slot_offset + HEADER_SIZE, comp_size);
+        if (block_checksum) {
+            uint32_t hash = XXH32(dst + 4, comp_size, 0);
+            memcpy(dst + 4 + comp_size, &hash, 4);
+        }
+    }
+    release_threads(team);
+    Py_END_ALLOW_THREADS
+
+    unsigned char* end = out_data + frame_size - 4 - (content_checksum ? 4 : 0);
+    memset(end, 0, 4); // EndMark
+    if (content_checksum) memcpy(end + 4, &content_hash, 4);
+    stats_lap(&stats.gather_seconds, t);
+
+    stats_add_results(&stats, results, num_blocks);
+    stats.threads = opts.threads;
+    stats.bytes_in = in_size;
+    stats.bytes_out = frame_size;
+    stats.bytes_allocated = blocks_bound(in_size, opts.block_size, 1) + num_blocks * sizeof(BlockResult) + frame_size;
+    free(slots);
+    free(results);
+    PyBuffer_Release(&input);
+    return finish_call(output, &stats, 1);
+}
+
+/* Decompress standard LZ4 frames (several back to back are fine). Frames
+   with independent blocks decode across the team; linked ones go through
+   lz4frame on one thread. */
+static PyObject* decompress_lz4_frame(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"data", "threads", "stats", NULL};
+    Py_buffer input;
+    int threads = 0;
+    CallStats stats;
+    int want_stats = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*|ip", kwlist, &input, &threads, &want_stats)) return NULL;
+    stats_begin(&stats, want_stats);
+    if (check_threads(threads) < 0) {
+        PyBuffer_Release(&input);
+        return NULL;
+    }
+
+    const unsigned char* in_data = input.buf;
+    size_t in_size = input.len;
+    Lz4FrameScan scan;
+    PyObject* output = NULL;
+    int err;
+
+    Py_BEGIN_ALLOW_THREADS
+    err = scan_lz4_frames(in_data, in_size, &scan);
+    Py_END_ALLOW_THREADS
+    double t = stats_lap(&stats.index_seconds, stats.start);
+    stats.threads = 1;
+
+    if (!err && scan.serial) {
+        unsigned char* out = NULL;
+        size_t out_size = 0;
+        Py_BEGIN_ALLOW_THREADS
+        err = decode_lz4_frames_serial(in_data, in_size, &out, &out_size);
+        Py_END_ALLOW_THREADS
+        if (!err) {
+            output = PyBytes_FromStringAndSize((const char*)out, out_size);
+            free(out);
+        }
+    } else if (!err) {
+        output = PyBytes_FromStringAndSize(NULL, scan.total_cap);
+        if (output) {
+            size_t out_size = 0;
+            Py_BEGIN_ALLOW_THREADS
+            int team = acquire_threads(threads, scan.num_blocks);
+            err = decode_lz4_frames(in_data, &scan, (unsigned char*)PyBytes_AS_STRING(output), team, &out_size);
+            release_threads(team);
+            stats.threads = team;
+            Py_END_ALLOW_THREADS
+            if (err) Py_CLEAR(output);
+            else if (out_size != scan.total_cap) _PyBytes_Resize(&output, out_size);
+        }
+    }
+
+    stats_lap(&stats.work_seconds, t);
+    if (!err) {
+        // The serial path never looks at blocks one by one
+        for (size_t i = 0; !scan.serial && i < scan.num_blocks; ++i) {
+            const Lz4FrameBlock* block = &scan.blocks[i];
+            if (stats.requested) stats_add_block(&stats, block->size, block->out_size, block->raw);
+            else stats.blocks++;
+        }
+        stats.bytes_in = in_size;
+        stats.bytes_out = output ? (size_t)PyBytes_GET_SIZE(output) : 0;
+        stats.bytes_allocated = scan.blocks_cap * sizeof(Lz4FrameBlock) + scan.frames_cap * sizeof(Lz4Frame) +
+                                (scan.serial ? 2 : 1) * stats.bytes_out;
+    }
+    free_lz4_scan(&scan);
+    PyBuffer_Release(&input);
+    if (err) return raise_error(err);
+    return finish_call(output, &stats, 0);
+}
+
+
+// --- Streaming Compressor / Decompressor ---
+
+/* Serialize access to a stream object across Python threads (the methods
+   drop the GIL while the workers run). Same pattern as zlib's objects. */
+#define ENTER_STREAM(obj) \
+    if (!PyThread_acquire_lock((obj)->lock, NOWAIT_LOCK)) { \
+        Py_BEGIN_ALLOW_THREADS \
+        PyThread_acquire_lock((obj)->lock, WAIT_LOCK); \
+        Py_END_ALLOW_THREADS \
+    }
+#define LEAVE_STREAM(obj) PyThread_release_lock((obj)->lock);
+
+/* Concatenate a list of bytes objects into one. */
+static PyObject* join_pieces(PyObject* pieces) {
+    Py_ssize_t n = PyList_GET_SIZE(pieces);
+    if (n == 1) {
+        PyObject* only = PyList_GET_ITEM(pieces, 0);
+        Py_INCREF(only);
+        return only;
+    }
+
+    Py_ssize_t total = 0;
+    for (Py_ssize_t i = 0; i < n; ++i) total += PyBytes_GET_SIZE(PyList_GET_ITEM(pieces, i));
+
+    PyObject* out = PyBytes_FromStringAndSize(NULL, total);
+    if (!out) return NULL;
+    char* dst = PyBytes_AS_STRING(out);
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        PyObject* piece = PyList_GET_ITEM(pieces, i);
+        memcpy(dst, PyBytes_AS_STRING(piece), PyBytes_GET_SIZE(piece));
+        dst += PyBytes_GET_SIZE(piece);
+    }
+    return out;
+}
+
+
+/* Compressor: input is buffered into batches of whole blocks, and each full
+   batch is compressed by a background thread (which drives the OpenMP team)
+   while the caller keeps feeding the next one. Output uses the plain block
+   framing, so everything returned, concatenated, is a normal frame. */
+typedef struct {
+    PyObject_HEAD
+    CompressOptions opts;
+    AccelTuner tuner;             // Carries the acceleration over from batch to batch
+    size_t batch_size;            // Whole blocks handed over at a time
+    unsigned char* fill;          // Batch being filled by the caller
+    size_t fill_len;
+    unsigned char* work;          // Batch owned by the background thread
+    size_t work_len;
+    int threads;                  // Requested team size, 0 = automatic
+    PyObject* work_out;           // Bound-sized bytes the batch lands in
+    unsigned char* work_out_data;
+    size_t work_out_len;
+    BlockResult* results;
+    int work_err;
+    int busy;                     // A batch is in flight
+    int stop;
+    int thread_running;
+    PyThread_type_lock start_lock;  // Released to hand a batch over
+    PyThread_type_lock done_lock;   // Released by the thread when it's done
+    PyThread_type_lock lock;
+} CompressorObject;
+
+/* Background thread: compress each batch it is handed. Never touches
+   Python objects, so it runs without the GIL. */
+static void compressor_thread(void* arg) {
+    CompressorObject* self = arg;
+    for (;;) {
+        PyThread_acquire_lock(self->start_lock, WAIT_LOCK);
+        if (self->stop) break;
+        self->opts.threads = acquire_threads(self->threads, (self->work_len + self->opts.block_size - 1) / self->opts.block_size);
+        self->work_err = compress_blocks(self->work, self->work_len, &self->opts,
+                                         self->work_out_data, self->results, &self->work_out_len);
+        release_threads(self->opts.threads);
+        PyThread_release_lock(self->done_lock);
+    }
+    PyThread_release_lock(self->done_lock);
+}
+
+/* Hand the batch being filled to the background thread (which must be idle). */
+static int compressor_dispatch(CompressorObject* self) {
+    PyObject* out = PyBytes_FromStringAndSize(NULL, blocks_bound(self->fill_len, self->opts.block_size, 1));
+    if (!out) return -1;
+
+    if (!self->thread_running) {
+        if (PyThread_start_new_thread(compressor_thread, self) == PYTHREAD_INVALID_THREAD_ID) {
+            Py_DECREF(out);
+            PyErr_SetString(PyExc_RuntimeError, "can't start compressor thread");
+            return -1;
+        }
+        self->thread_running = 1;
+    }
+
+    unsigned char* batch = self->work;
+    self->work = self->fill;
+    self->work_len = self->fill_len;
+    self->fill = batch;
+    self->fill_len = 0;
+
+    self->work_out = out;
+    self->work_out_data = (unsigned char*)PyBytes_AS_STRING(out);
+    self->busy = 1;
+    PyThread_release_lock(self->start_lock);
+    return 0;
+}
+
+/* Pick up the batch in flight and append its output to `pieces`. With
+   `wait` unset this only collects a batch that has already finished. */
+static int compressor_collect(CompressorObject* self, int wait, PyObject* pieces) {
+    if (!self->busy) return 0;
+    if (!PyThread_acquire_lock(self->done_lock, NOWAIT_LOCK)) {
+        if (!wait) return 0;
+        Py_BEGIN_ALLOW_THREADS
+        PyThread_acquire_lock(self->done_lock, WAIT_LOCK);
+        Py_END_ALLOW_THREADS
+    }
+    self->busy = 0;
+
+    PyObject* out = self->work_out;
+    self->work_out = NULL;
+    if (self->work_err) {
+        Py_DECREF(out);
+        raise_error(self->work_err);
+        return -1;
+    }
+    if (_PyBytes_Resize(&out, self->work_out_len) < 0) return -1;
+
+    int rc = PyList_Append(pieces, out);
+    Py_DECREF(out);
+    return rc;
+}
+
+static PyObject* Compressor_new(PyTypeObject* type, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"block_size", "level", "adaptive", "entropy_threshold", "threads", "acceleration",
+                             "target_mbps", NULL};
+    Py_ssize_t block_size = DEFAULT_BLOCK_SIZE;
+    int threads = 0;
+    double target_mbps = 0;
+    CompressOptions opts = default_compress_options;
+    AccelTuner tuner;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|nipdiid", kwlist, &block_size, &opts.level, &opts.adaptive,
+                                     &opts.entropy_threshold, &threads, &opts.acceleration, &target_mbps)) {
+        return NULL;
+    }
+    if (check_block_size(block_size) < 0 || check_level(opts.level) < 0 || check_threads(threads) < 0 ||
+        use_acceleration(target_mbps, &opts, &tuner) < 0) {
+        return NULL;
+    }
+    opts.block_size = (size_t)block_size;
+
+    CompressorObject* self = (CompressorObject*)type->tp_alloc(type, 0);
+    if (!self) return NULL;
+
+    size_t batch_blocks = (size_t)(threads ? threads : max_threads_now()) * STREAM_BLOCKS_PER_THREAD;
+    self->opts = opts;
+    self->tuner = tuner;
+    if (opts.tuner) self->opts.tuner = &self->tuner;
+    self->threads = threads;
+    self->batch_size = self->opts.block_size * batch_blocks;
+    self->fill = malloc(self->batch_size);
+    self->work = malloc(self->batch_size);
+    self->results = calloc(batch_blocks, sizeof(BlockResult));
+    self->start_lock = PyThread_allocate_lock();
+    self->done_lock = PyThread_allocate_lock();
+    self->lock = PyThread_allocate_lock();
+
+    if (!self->fill || !self->work || !self->results || !self->start_lock || !self->done_lock || !self->lock) {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+    // Both handoff locks start held: the thread waits on one, we wait on the other
+    PyThread_acquire_lock(self->start_lock, WAIT_LOCK);
+    PyThread_acquire_lock(self->done_lock, WAIT_LOCK);
+    return (PyObject*)self;
+}
+
+static void Compressor_dealloc(CompressorObject* self) {
+    if (self->thread_running) {
+        if (self->busy) PyThread_acquire_lock(self->done_lock, WAIT_LOCK);
+        self->stop = 1;
+        PyThread_release_lock(self->start_lock);
+        PyThread_acquire_lock(self->done_lock, WAIT_LOCK);
+    }
+    Py_XDECREF(self->work_out);
+    free(self->fill);
+    free(self->work);
+    free(self->results);
+    if (self->start_lock) PyThread_free_lock(self->start_lock);
+    if (self->done_lock) PyThread_free_lock(self->done_lock);
+    if (self->lock) PyThread_free_lock(self->lock);
+    PyTypeObject* type = Py_TYPE(self);
+    type->tp_free((PyObject*)self);
+    Py_DECREF(type);
+}
+
+static PyObject* Compressor_compress(CompressorObject* self, PyObject* args) {
+    Py_buffer input;
+    if (!PyArg_ParseTuple(args, "y*", &input)) return NULL;
+
+    PyObject* pieces = PyList_New(0);
+    if (!pieces) {
+        PyBuffer_Release(&input);
+        return NULL;
+    }
+
+    ENTER_STREAM(self);
+    const unsigned char* src = input.buf;
+    size_t left = input.len;
+    int rc = compressor_collect(self, 0, pieces);
+
+    while (rc == 0 && left > 0) {
+        size_t n = self->batch_size - self->fill_len;
+        if (n > left) n = left;
+        memcpy(self->fill + self->fill_len, src, n);
+        self->fill_len += n;
+        src += n;
+        left -= n;
+
+        if (self->fill_len == self->batch_size) {
+            // Only one batch is in flight at a time; that bounds memory
+            rc = compressor_collect(self, 1, pieces);
+            if (rc == 0) rc = compressor_dispatch(self);
+        }
+    }
+    LEAVE_STREAM(self);
+    PyBuffer_Release(&input);
+
+    PyObject* out = rc == 0 ? join_pieces(pieces) : NULL;
+    Py_DECREF(pieces);
+    return out;
+}
+
+static PyObject* Compressor_flush(CompressorObject* self, PyObject* Py_UNUSED(ignored)) {
+    PyObject* pieces = PyList_New(0);
+    if (!pieces) return NULL;
+
+    ENTER_STREAM(self);
+    int rc = compressor_collect(self, 1, pieces);
+    if (rc == 0 && self->fill_len > 0) {
+        rc = compressor_dispatch(self);
+        if (rc == 0) rc = compressor_collect(self, 1, pieces);
+    }
+    LEAVE_STREAM(self);
+
+    PyObject* out = NULL;
+    if (rc == 0) out = PyList_GET_SIZE(pieces) ? join_pieces(pieces) : PyBytes_FromStringAndSize(NULL, 0);
+    Py_DECREF(pieces);
+    return out;
+}
+
+static PyMethodDef Compressor_methods[] = {
+    {"compress", (PyCFunction)Compressor_compress, METH_VARARGS, "Feed data; returns whatever compressed output is ready (possibly b'')."},
+    {"flush", (PyCFunction)Compressor_flush, METH_NOARGS, "Compress all buffered data, including a final partial block, and return it.\nThe compressor can keep being used afterwards."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyType_Slot Compressor_slots[] = {
+    {Py_tp_dealloc, Compressor_dealloc},
+    {Py_tp_doc, "Compressor(block_size=1048576, level=0, adaptive=False, entropy_threshold=7.8, threads=0, acceleration=1, target_mbps=0)\n\nStreaming compressor producing the compress_hybrid() block framing.\nFull blocks are compressed in the background while more data is fed.\nWith target_mbps the tuned acceleration carries over from one batch to the next."},
+    {Py_tp_methods, Compressor_methods},
+    {Py_tp_new, Compressor_new},
+    {0, NULL}
+};
+
+static PyType_Spec Compressor_spec = {
+    .name = "warphybrid.Compressor",
+    .basicsize = sizeof(CompressorObject),
+    .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE,
+    .slots = Compressor_slots,
+};
+
+
+/* Decompressor: decodes every complete block it has been fed (in parallel)
+   and keeps the bytes of an incomplete trailing block until the rest
+   arrives. Reads plain (non-seekable) frames. */
+typedef struct {
+    PyObject_HEAD
+    unsigned char* pending;  // Start of a block whose tail hasn't arrived
+    size_t pending_len;
+    size_t pending_cap;
+    int threads;             // Requested team size, 0 = automatic
+    PyThread_type_lock lock;
+} DecompressorObject;
+
+/* Have room for `need` pending bytes. */
+static int decompressor_reserve(DecompressorObject* self, size_t need) {
+    if (need <= self->pending_cap) return 0;
+    unsigned char* grown = realloc(self->pending, need);
+    if (!grown) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    self->pending = grown;
+    self->pending_cap = need;
+    return 0;
+}
+
+/* Decode the complete blocks at the front of `src` and append the output to
+   `pieces`; *consumed is where the first incomplete block starts. */
+static int decode_complete_blocks(const unsigned char* src, size_t len, int threads, size_t* consumed, PyObject* pieces) {
+    BlockTable table;
+    int err = WH_OK;
+
+    memset(&table, 0, sizeof(table));
+    table.in_data = src;
+    table.group_blocks = 1;
+    Py_BEGIN_ALLOW_THREADS
+    err = build_index(src, len, SIZE_MAX, &table, consumed);
+    Py_END_ALLOW_THREADS
+    if (err) {
+        raise_error(err);
+        return -1;
+    }
+    if (table.num_blocks == 0) {
+        free_block_table(&table);
+        return 0;
+    }
+
+    PyObject* out = PyBytes_FromStringAndSize(NULL, table.total_size);
+    if (!out) {
+        free_block_table(&table);
+        return -1;
+    }
+    unsigned char* out_data = (unsigned char*)PyBytes_AS_STRING(out);
+
+    Py_BEGIN_ALLOW_THREADS
+    threads = acquire_threads(threads, table_tasks(&table));
+    err = decode_table(&table, out_data, threads);
+    release_threads(threads);
+    Py_END_ALLOW_THREADS
+    free_block_table(&table);
+
+    if (err) {
+        Py_DECREF(out);
+        raise_error(err);
+        return -1;
+    }
+    int rc = PyList_Append(pieces, out);
+    Py_DECREF(out);
+    return rc;
+}
+
+static PyObject* Decompressor_new(PyTypeObject* type, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"threads", NULL};
+    int threads = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|i", kwlist, &threads)) return NULL;
+    if (check_threads(threads) < 0) return NULL;
+
+    DecompressorObject* self = (DecompressorObject*)type->tp_alloc(type, 0);
+    if (!self) return NULL;
+    self->threads = threads;
+    self->lock = PyThread_allocate_lock();
+    if (!self->lock) {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+    return (PyObject*)self;
+}
+
+static void Decompressor_dealloc(DecompressorObject* self) {
+    free(self->pending);
+    if (self->lock) PyThread_free_lock(self->lock);
+    PyTypeObject* type = Py_TYPE(self);
+    type->tp_free((PyObject*)self);
+    Py_DECREF(type);
+}
+
+static PyObject* Decompressor_decompress(DecompressorObject* self, PyObject* args) {
+    Py_buffer input;
+    if (!PyArg_ParseTuple(args, "y*", &input)) return NULL;
+
+    PyObject* pieces = PyList_New(0);
+    if (!pieces) {
+        PyBuffer_Release(&input);
+        return NULL;
+    }
+
+    ENTER_STREAM(self);
+    const unsigned char* src = input.buf;
+    size_t left = input.len;
+    int rc = 0;
+
+    // Finish the stashed block first, copying only the bytes it is missing;
+    // everything after it is decoded straight from the caller's buffer. Its
+    // header is checked as soon as it is whole, before room is made for the
+    // payload it announces.
+    while (rc == 0 && self->pending_len > 0) {
+        size_t need = HEADER_SIZE;
+        if (self->pending_len >= HEADER_SIZE) {
+            BlockIndex block;
+            if (read_block_header(self->pending, HEADER_SIZE, 1, &block) < 0) {
+                raise_error(WH_ERR_HEADER);
+                rc = -1;
+                break;
+            }
+            need += block.comp_size;
+            if (self->pending_len == need) {
+                size_t consumed;
+                rc = decode_complete_blocks(self->pending, self->pending_len, self->threads, &consumed, pieces);
+                self->pending_len = 0;
+                break;
+            }
+        }
+        if (left == 0) break;
+
+        size_t take = need - self->pending_len;
+        if (take > left) take = left;
+        rc = decompressor_reserve(self, need);
+        if (rc < 0) break;
+        memcpy(self->pending + self->pending_len, src, take);
+        self->pending_len += take;
+        src += take;
+        left -= take;
+    }
+
+    if (rc == 0 && left > 0) {
+        size_t consumed;
+        rc = decode_complete_blocks(src, left, self->threads, &consumed, pieces);
+        if (rc == 0 && consumed < left) {
+            rc = decompressor_reserve(self, left - consumed);
+            if (rc == 0) {
+                memcpy(self->pending, src + consumed, left - consumed);
+                self->pending_len = left - consumed;
+            }
+        }
+    }
+    LEAVE_STREAM(self);
+    PyBuffer_Release(&input);
+
+    PyObject* out = NULL;
+    if (rc == 0) out = PyList_GET_SIZE(pieces) ? join_pieces(pieces) : PyBytes_FromStringAndSize(NULL, 0);
+    Py_DECREF(pieces);
+    return out;
+}
+
+static PyObject* Decompressor_flush(DecompressorObject* self, PyObject* Py_UNUSED(ignored)) {
+    ENTER_STREAM(self);
+    size_t pending_len = self->pending_len;
+    LEAVE_STREAM(self);
+
+    if (pending_len) return raise_error(WH_ERR_TRUNCATED);
+    return PyBytes_FromStringAndSize(NULL, 0);
+}
+
+static PyMethodDef Decompressor_methods[] = {
+    {"decompress", (PyCFunction)Decompressor_decompress, METH_VARARGS, "Feed compressed data; returns the output of every block completed so far."},
+    {"flush", (PyCFunction)Decompressor_flush, METH_NOARGS, "Check the stream ended on a block boundary (raises RuntimeError if not)."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyType_Slot Decompressor_slots[] = {
+    {Py_tp_dealloc, Decompressor_dealloc},
+    {Py_tp_doc, "Decompressor(threads=0)\n\nStreaming decompressor for the compress_hybrid() / Compressor block framing."},
+    {Py_tp_methods, Decompressor_methods},
+    {Py_tp_new, Decompressor_new},
+    {0, NULL}
+};
+
+static PyType_Spec Decompressor_spec = {
+    .name = "warphybrid.Decompressor",
+    .basicsize = sizeof(DecompressorObject),
+    .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE,
+    .slots = Decompressor_slots,
+};
+
+
+// --- Buffer pool ---
+
+/* BufferPool: keeps large output regions alive across calls, so repeated
+   multi-GB decompressions reuse pages that are already faulted in instead
+   of mapping and first-touching a fresh region every time. Regions are
+   HUGE_PAGE_SIZE-aligned anonymous mappings advised for transparent huge
+   pages, and are faulted in by the team as soon as they are mapped. */
+typedef struct {
+    unsigned char* data;
+    size_t capacity;
+} PoolRegion;
+
+typedef struct {
+    PyObject_HEAD
+    PoolRegion* free_regions;   // Up to max_buffers regions waiting for reuse
+    Py_ssize_t num_free;
+    Py_ssize_t max_buffers;
+    int huge_pages;
+    int prefault;
+} BufferPoolObject;
+
+typedef struct {
+    PyObject_HEAD
+    BufferPoolObject* pool;     // Where the region goes back to
+    PoolRegion region;          // data is NULL once released
+    Py_ssize_t size;            // Bytes exposed, <= region.capacity
+    Py_ssize_t exports;         // Live buffer views
+} PooledBufferObject;
+
+/* Map a region of at least `size` bytes, rounded up to whole huge pages and
+   aligned to one (so THP can back all of it), and fault it in across the
+   team when asked to. Call without the GIL. */
+static int region_map(size_t size, int huge_pages, int prefault, PoolRegion* region) {
+    size_t capacity = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    if (capacity == 0) capacity = HUGE_PAGE_SIZE;
+#ifdef _WIN32
+    unsigned char* data = malloc(capacity);
+    if (!data) return WH_ERR_NOMEM;
+#else
+    size_t mapped = capacity + HUGE_PAGE_SIZE;
+    unsigned char* raw = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return WH_ERR_NOMEM;
+    unsigned char* data = (unsigned char*)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    if (data > raw) munmap(raw, data - raw);
+    if (raw + mapped > data + capacity) munmap(data + capacity, raw + mapped - (data + capacity));
+    if (huge_pages) advise_huge_pages(data, capacity);
+#endif
+
+    if (prefault) {
+        size_t chunks = capacity / HUGE_PAGE_SIZE;
+        int threads = acquire_threads(0, chunks);
+        #pragma omp parallel for if(threads > 1) num_threads(threads) schedule(runtime) copyin(team_slots)
+        for (size_t c = 0; c < chunks; ++c) {
+            place_worker();
+            volatile unsigned char* chunk = data + c * HUGE_PAGE_SIZE;
+            for (size_t p = 0; p < HUGE_PAGE_SIZE; p += 4096) chunk[p] = 0;
+        }
+        release_threads(threads);
+    }
+    region->data = data;
+    region->capacity = capacity;
+    return WH_OK;
+}
+
+static void region_unmap(PoolRegion* region) {
+#ifdef _WIN32
+    free(region->data);
+#else
+    munmap(region->data, region->capacity);
+#endif
+    region->data = NULL;
+}
+
+/* Hand out a region for `size` bytes: the smallest cached one that fits, or
+   a new mapping. The free list is locked; mapping happens outside it. */
+static int pool_take(BufferPoolObject* pool, size_t size, PoolRegion* region) {
+    int found = 0;
+    Py_BEGIN_CRITICAL_SECTION(pool);
+    Py_ssize_t best = -1;
+    for (Py_ssize_t i = 0; i < pool->num_free; ++i) {
+        if (pool->free_regions[i].capacity >= size &&
+            (best < 0 || pool->free_regions[i].capacity < pool->free_regions[best].capacity)) {
+            best = i;
+        }
+    }
+    if (best >= 0) {
+        *region = pool->free_regions[best];
+        pool->free_regions[best] = pool->free_regions[--pool->num_free];
+        found = 1;
+    }
+    Py_END_CRITICAL_SECTION();
+    if (found) return WH_OK;
+
+    int err;
+    Py_BEGIN_ALLOW_THREADS
+    err = region_map(size, pool->huge_pages, pool->prefault, region);
+    Py_END_ALLOW_THREADS
+    return err;
+}
+
+/* Take a region back; beyond max_buffers the smallest cached one is
+   unmapped, after the free list is unlocked again. */
+static void pool_give(BufferPoolObject* pool, PoolRegion* region) {
+    PoolRegion evicted = *region;
+    Py_BEGIN_CRITICAL_SECTION(pool);
+    if (pool->num_free == pool->max_buffers) {
+        Py_ssize_t smallest = -1;
+        for (Py_ssize_t i = 0; i < pool->num_free; ++i) {
+            if (smallest < 0 || pool->free_regions[i].capacity < pool->free_regions[smallest].capacity) smallest = i;
+        }
+        if (smallest >= 0 && pool->free_regions[smallest].capacity <= region->capacity) {
+            evicted = pool->free_regions[smallest];
+            pool->free_regions[smallest] = *region;
+        }
+    } else {
+        pool->free_regions[pool->num_free++] = *region;
+        evicted.data = NULL;
+    }
+    Py_END_CRITICAL_SECTION();
+    region->data = NULL;
+    if (evicted.data) region_unmap(&evicted);
+}
+
+static PyObject* pooled_buffer_new(BufferPoolObject* pool, PoolRegion* region, size_t size) {
+    PooledBufferObject* buf = PyObject_New(PooledBufferObject, type_state(Py_TYPE(pool))->pooled_buffer_type);
+    if (!buf) {
+        pool_give(pool, region);
+        return NULL;
+    }
+    Py_INCREF(pool);
+    buf->pool = pool;
+    buf->region = *region;
+    buf->size = (Py_ssize_t)size;
+    buf->exports = 0;
+    return (PyObject*)buf;
+}
+
+static PyObject* BufferPool_new(PyTypeObject* type, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"max_buffers", "huge_pages", "prefault", NULL};
+    Py_ssize_t max_buffers = POOL_DEFAULT_BUFFERS;
+    int huge_pages = 1, prefault = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|npp", kwlist, &max_buffers, &huge_pages, &prefault)) return NULL;
+    if (max_buffers < 0) {
+        PyErr_SetString(PyExc_ValueError, "max_buffers must be non-negative");
+        return NULL;
+    }
+
+    BufferPoolObject* self = (BufferPoolObject*)type->tp_alloc(type, 0);
+    if (!self) return NULL;
+    self->free_regions = PyMem_Calloc(max_buffers ? max_buffers : 1, sizeof(PoolRegion));
+    if (!self->free_regions) {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+    self->max_buffers = max_buffers;
+    self->huge_pages = huge_pages;
+    self->prefault = prefault;
+    return (PyObject*)self;
+}
+
+static void pool_clear(BufferPoolObject* pool) {
+    while (pool->num_free > 0) region_unmap(&pool->free_regions[--pool->num_free]);
+}
+
+/* Swap in an empty free list under the lock, then unmap the old one's
+   regions outside it. */
+static PyObject* BufferPool_clear(BufferPoolObject* self, PyObject* Py_UNUSED(ignored)) {
+    PoolRegion* regions = PyMem_Calloc(self->max_buffers ? self->max_buffers : 1, sizeof(PoolRegion));
+    if (!regions) return PyErr_NoMemory();
+    Py_ssize_t count;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    PoolRegion* cached = self->free_regions;
+    self->free_regions = regions;
+    regions = cached;
+    count = self->num_free;
+    self->num_free = 0;
+    Py_END_CRITICAL_SECTION();
+    while (count > 0) region_unmap(&regions[--count]);
+    PyMem_Free(regions);
+    Py_RETURN_NONE;
+}
+
+static void BufferPool_dealloc(BufferPoolObject* self) {
+    if (self->free_regions) pool_clear(self);
+    PyMem_Free(self->free_regions);
+    PyTypeObject* type = Py_TYPE(self);
+    type->tp_free((PyObject*)self);
+    Py_DECREF(type);
+}
+
+static PyObject* BufferPool_acquire(BufferPoolObject* self, PyObject* args) {
+    Py_ssize_t size;
+    if (!PyArg_ParseTuple(args, "n", &size)) return NULL;
+    if (size < 0) {
+        PyErr_SetString(PyExc_ValueError, "size must be non-negative");
+        return NULL;
+    }
+    PoolRegion region;
+    if (pool_take(self, (size_t)size, &region)) return PyErr_NoMemory();
+    return pooled_buffer_new(self, &region, (size_t)size);
+}
+
+/* decompress_hybrid() into a pooled buffer of exactly the output size. */
+static PyObject* BufferPool_decompress(BufferPoolObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"data", "threads", "dictionary", NULL};
+    Py_buffer input;
+    int threads = 0;
+    PyObject* dictionary = NULL;
+    const WarpDict* dict;
+    CallStats stats;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*|iO", kwlist, &input, &threads, &dictionary)) return NULL;
+    stats_begin(&stats, 0);
+    if (check_threads(threads) < 0 || get_dictionary(type_state(Py_TYPE(self)), dictionary, &dict) < 0) {
+        PyBuffer_Release(&input);
+        return NULL;
+    }
+
+    BlockTable table;
+    int err;
+    Py_BEGIN_ALLOW_THREADS
+    err = load_block_table(input.buf, input.len, SIZE_MAX, dict, &table);
+    Py_END_ALLOW_THREADS
+    if (err) {
+        PyBuffer_Release(&input);
+        return raise_error(err);
+    }
+
+    PoolRegion region;
+    err = pool_take(self, table.total_size, &region);
+    if (!err) {
+        Py_BEGIN_ALLOW_THREADS
+        threads = acquire_threads(threads, table_tasks(&table));
+        err = decode_table(&table, region.data, threads);
+        release_threads(threads);
+        Py_END_ALLOW_THREADS
+        if (err) pool_give(self, &region);
+    }
+    size_t total_size = table.total_size;
+    stats.bytes_in = input.len;
+    stats.bytes_out = total_size;
+    free_block_table(&table);
+    PyBuffer_Release(&input);
+
+    if (err) return raise_error(err);
+    return finish_call(pooled_buffer_new(self, &region, total_size), &stats, 0);
+}
+
+static PyObject* BufferPool_get_cached(BufferPoolObject* self, void* Py_UNUSED(closure)) {
+    size_t total = 0;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    for (Py_ssize_t i = 0; i < self->num_free; ++i) total += self->free_regions[i].capacity;
+    Py_END_CRITICAL_SECTION();
+    return PyLong_FromSize_t(total);
+}
+
+static PyMethodDef BufferPool_methods[] = {
+    {"acquire", (PyCFunction)BufferPool_acquire, METH_VARARGS, "acquire(size) -> PooledBuffer\nA writable buffer of `size` bytes (contents undefined), e.g. for compress_into() / decompress_into()."},
+    {"decompress", (PyCFunction)(void(*)(void))BufferPool_decompress, METH_VARARGS | METH_KEYWORDS, "decompress(data, threads=0, dictionary=None) -> PooledBuffer\ndecompress_hybrid() into a pooled buffer holding exactly the decompressed data."},
+    {"clear", (PyCFunction)BufferPool_clear, METH_NOARGS, "Unmap every cached region."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef BufferPool_getset[] = {
+    {"cached_bytes", (getter)BufferPool_get_cached, NULL, "Bytes mapped by regions waiting for reuse", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyType_Slot BufferPool_slots[] = {
+    {Py_tp_dealloc, BufferPool_dealloc},
+    {Py_tp_doc, "BufferPool(max_buffers=4, huge_pages=True, prefault=True)\n\nReuses large output buffers across calls. Regions are rounded up to 2 MB huge pages,\nadvised for transparent huge pages (huge_pages) and faulted in by the thread team when first mapped\n(prefault). Released buffers are kept for reuse, at most max_buffers of them."},
+    {Py_tp_methods, BufferPool_methods},
+    {Py_tp_getset, BufferPool_getset},
+    {Py_tp_new, BufferPool_new},
+    {0, NULL}
+};
+
+static PyType_Spec BufferPool_spec = {
+    .name = "warphybrid.BufferPool",
+    .basicsize = sizeof(BufferPoolObject),
+    .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE,
+    .slots = BufferPool_slots,
+};
+
+/* Give the region back to the pool. Fails while views are still exported. */
+static PyObject* PooledBuffer_release(PooledBufferObject* self, PyObject* Py_UNUSED(ignored)) {
+    Py_ssize_t exports;
+    PoolRegion region = {0};
+    Py_BEGIN_CRITICAL_SECTION(self);
+    exports = self->exports;
+    if (exports == 0) {
+        region = self->region;
+        self->region.data = NULL;
+        self->size = 0;
+    }
+    Py_END_CRITICAL_SECTION();
+    if (exports > 0) {
+        PyErr_Format(PyExc_BufferError, "buffer is still in use by %zd view(s)", exports);
+        return NULL;
+    }
+    if (region.data) pool_give(self->pool, &region);
+    Py_RETURN_NONE;
+}
+
+static PyObject* PooledBuffer_enter(PyObject* self, PyObject* Py_UNUSED(ignored)) {
+    Py_INCREF(self);
+    return self;
+}
+
+static PyObject* PooledBuffer_exit(PooledBufferObject* self, PyObject* Py_UNUSED(args)) {
+    return PooledBuffer_release(self, NULL);
+}
+
+static void PooledBuffer_dealloc(PooledBufferObject* self) {
+    if (self->region.data) pool_give(self->pool, &self->region);
+    Py_XDECREF(self->pool);
+    PyTypeObject* type = Py_TYPE(self);
+    PyObject_Free(self);
+    Py_DECREF(type);
+}
+
+static int PooledBuffer_getbuffer(PooledBufferObject* self, Py_buffer* view, int flags) {
+    int rc = -1;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    if (!self->region.data) {
+        PyErr_SetString(PyExc_BufferError, "buffer was released");
+    } else if (PyBuffer_FillInfo(view, (PyObject*)self, self->region.data, self->size, 0, flags) == 0) {
+        self->exports++;
+        rc = 0;
+    }
+    Py_END_CRITICAL_SECTION();
+    return rc;
+}
+
+static void PooledBuffer_releasebuffer(PooledBufferObject* self, Py_buffer* Py_UNUSED(view)) {
+    Py_BEGIN_CRITICAL_SECTION(self);
+    self->exports--;
+    Py_END_CRITICAL_SECTION();
+}
+
+static Py_ssize_t PooledBuffer_length(PooledBufferObject* self) {
+    return self->size;
+}
+
+static PyMethodDef PooledBuffer_methods[] = {
+    {"release", (PyCFunction)PooledBuffer_release, METH_NOARGS, "Return the memory to the pool; raises BufferError while memoryviews of it are alive."},
+    {"__enter__", PooledBuffer_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)PooledBuffer_exit, METH_VARARGS, NULL},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyType_Slot PooledBuffer_slots[] = {
+    {Py_tp_dealloc, PooledBuffer_dealloc},
+    {Py_tp_doc, "Writable buffer handed out by a BufferPool. Use it through memoryview() or any bytes-like API;\nrelease() (or leaving a with block, or dropping it) returns the memory to the pool."},
+    {Py_tp_methods, PooledBuffer_methods},
+    {Py_bf_getbuffer, PooledBuffer_getbuffer},
+    {Py_bf_releasebuffer, PooledBuffer_releasebuffer},
+    {Py_sq_length, PooledBuffer_length},
+    {0, NULL}
+};
+
+static PyType_Spec PooledBuffer_spec = {
+    .name = "warphybrid.PooledBuffer",
+    .basicsize = sizeof(PooledBufferObject),
+    .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE | Py_TPFLAGS_DISALLOW_INSTANTIATION,
+    .slots = PooledBuffer_slots,
+};
+
+
+// --- File-to-file ---
+#ifndef _WIN32
+
+/* Raise for a failed file call: OSError for I/O, our usual errors otherwise. */
+static PyObject* raise_file_error(int err, int io_errno, PyObject* path) {
+    if (err == WH_ERR_IO) {
+        errno = io_errno;
+        return PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+    }
+    return raise_error(err);
+}
+
+
+/* Compress a file into another file. The source is mmapped and compressed
+   batch by batch; every block is pwrite()n from its slot straight to its
+   final offset in the destination, so the data never passes through Python
+   and memory stays at a few blocks per thread. */
+static PyObject* compress_file(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"src_path", "dst_path", "block_size", "seekable", "level", "adaptive",
+                             "entropy_threshold", "threads", "linked", "checksum", "acceleration", "target_mbps",
+                             "format", "stats", "typesize", NULL};
+    PyObject* src_path = NULL;
+    PyObject* dst_path = NULL;
+    Py_ssize_t block_size_arg = 0;  // None: auto
+    int threads = 0;
+    double target_mbps = 0;
+    CompressOptions opts = default_compress_options;
+    AccelTuner tuner;
+    CallStats stats;
+    int want_stats = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O&O&|O&pipdippidipi", kwlist, PyUnicode_FSConverter, &src_path,
+                                     PyUnicode_FSConverter, &dst_path, convert_block_size, &block_size_arg,
+                                     &opts.seekable,
+                                     &opts.level, &opts.adaptive, &opts.entropy_threshold, &threads, &opts.linked,
+                                     &opts.checksum, &opts.acceleration, &target_mbps, &opts.format,
+                                     &want_stats, &opts.typesize)) {
+        Py_XDECREF(src_path);
+        return NULL;
+    }
+    stats_begin(&stats, want_stats);
+    if (check_level(opts.level) < 0 || check_threads(threads) < 0 ||
+        check_format(opts.format) < 0 || use_typesize(&opts) < 0 || use_acceleration(target_mbps, &opts, &tuner) < 0) {
+        Py_DECREF(src_path);
+        Py_DECREF(dst_path);
+        return NULL;
+    }
+
+    if (opts.linked || opts.checksum) opts.seekable = 1;
+    int src_fd, dst_fd = -1;
+    unsigned char* in_data;
+    size_t in_size = 0;
+    int err = WH_OK, io_errno = 0;
+    PyObject* err_path = src_path;
+
+    io_errno = map_input_file(PyBytes_AS_STRING(src_path), &src_fd, &in_data, &in_size);
+    if (io_errno) {
+        raise_file_error(WH_ERR_IO, io_errno, src_path);
+        Py_DECREF(src_path);
+        Py_DECREF(dst_path);
+        return NULL;
+    }
+    size_t block_size = block_size_arg ? (size_t)block_size_arg : auto_block_size(in_size, threads, &opts);
+    opts.block_size = block_size;
+
+    size_t num_blocks = (in_size + block_size - 1) / block_size;
+    opts.threads = acquire_threads(threads, num_blocks);
+    size_t batch_blocks = (size_t)opts.threads * FILE_BLOCKS_PER_THREAD;
+    // Linked groups never straddle batches, so every window is in the batch
+    if (opts.linked) batch_blocks = (batch_blocks + LINKED_GROUP_BLOCKS - 1) / LINKED_GROUP_BLOCKS * LINKED_GROUP_BLOCKS;
+    if (batch_blocks > num_blocks) batch_blocks = num_blocks;
+
+    BlockResult* results = calloc(num_blocks ? num_blocks : 1, sizeof(BlockResult));
+    unsigned char* batch_buf = batch_blocks ? malloc(blocks_bound(batch_blocks * block_size, block_size, opts.format)) : NULL;
+    size_t file_offset = frame_prefix_size(opts.format);
+
+    Py_BEGIN_ALLOW_THREADS
+    if (!results || (batch_blocks && !batch_buf)) {
+        err = WH_ERR_NOMEM;
+    } else {
+        dst_fd = open(PyBytes_AS_STRING(dst_path), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (dst_fd < 0) {
+            err = WH_ERR_IO;
+            io_errno = errno;
+        }
+    }
+    if (!err) err_path = dst_path;
+    if (!err && file_offset) {
+        unsigned char prefix[FRAME_V2_MAGIC_SIZE];
+        write_frame_prefix(prefix, opts.format);
+        io_errno = pwrite_all(dst_fd, prefix, file_offset, 0);
+        if (io_errno) err = WH_ERR_IO;
+    }
+
+    for (size_t first = 0; !err && first < num_blocks; first += batch_blocks) {
+        size_t count = num_blocks - first < batch_blocks ? num_blocks - first : batch_blocks;
+        size_t batch_in = first * block_size;
+        size_t batch_len = count * block_size;
+        if (batch_len > in_size - batch_in) batch_len = in_size - batch_in;
+
+        BlockResult* batch = results + first;
+        size_t batch_out = 0;
+        double t = omp_get_wtime();
+        compress_to_slots(in_data + batch_in, batch_len, &opts, batch_buf, batch, &batch_out, NULL);
+        t = stats_lap(&stats.work_seconds, t);
+
+        // No compaction: each block goes from its slot straight to disk
+        #pragma omp parallel for if(opts.threads > 1) num_threads(opts.threads) schedule(runtime)
+        for (size_t i = 0; i < count; ++i) {
+            if (err) continue;
+            int e = pwrite_all(dst_fd, batch_buf + batch[i].slot_offset, block_span(&batch[i]),
+                               (off_t)(file_offset + batch[i].out_offset));
+            if (e) {
+                #pragma omp critical(wh_error)
+                {
+                    if (!err) {
+                        err = WH_ERR_IO;
+                        io_errno = e;
+                    }
+                }
+            }
+        }
+
+        // Rebase to whole-file offsets (the footer needs them)
+        for (size_t i = 0; i < count; ++i) {
+            batch[i].offset_in += batch_in;
+            batch[i].out_offset += file_offset;
+        }
+        file_offset += batch_out;
+        stats_lap(&stats.gather_seconds, t);
+    }
+
+    if (!err && opts.seekable) {
+        size_t footer_len = footer_size(&opts, num_blocks);
+        unsigned char* footer = malloc(footer_len);
+        if (!footer) {
+            err = WH_ERR_NOMEM;
+        } else {
+            write_footer(footer, results, num_blocks, &opts);
+            io_errno = pwrite_all(dst_fd, footer, footer_len, (off_t)file_offset);
+            if (io_errno) err = WH_ERR_IO;
+            file_offset += footer_len;
+            free(footer);
+        }
+    }
+
+    if (dst_fd >= 0 && close(dst_fd) < 0 && !err) {
+        err = WH_ERR_IO;
+        io_errno = errno;
+    }
+    release_threads(opts.threads);
+    Py_END_ALLOW_THREADS
+
+    if (!err) stats_add_results(&stats, results, num_blocks);
+    stats.threads = opts.threads;
+    stats.bytes_in = in_size;
+    stats.bytes_out = file_offset;
+    stats.bytes_allocated = num_blocks * sizeof(BlockResult) +
+                            (batch_blocks ? blocks_bound(batch_blocks * block_size, block_size, opts.format) : 0);
+    free(batch_buf);
+    free(results);
+    unmap_input_file(src_fd, in_data, in_size);
+
+    PyObject* result = err ? raise_file_error(err, io_errno, err_path)
+                           : finish_call(PyLong_FromSize_t(file_offset), &stats, 1);
+    Py_DECREF(src_path);
+    Py_DECREF(dst_path);
+    return result;
+}
+
+
+/* Decompress a file into another file. The source is mmapped, the output is
+   preallocated, and each worker decodes blocks into a private scratch buffer
+   and pwrite()s them to their final offset. Raw blocks go straight from the
+   mapping to disk. */
+static PyObject* decompress_file(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"src_path", "dst_path", "threads", "stats", NULL};
+    PyObject* src_path = NULL;
+    PyObject* dst_path = NULL;
+    int threads = 0;
+    CallStats stats;
+    int want_stats = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O&O&|ip", kwlist, PyUnicode_FSConverter, &src_path,
+                                     PyUnicode_FSConverter, &dst_path, &threads, &want_stats)) {
+        Py_XDECREF(src_path);
+        return NULL;
+    }
+    stats_begin(&stats, want_stats);
+    if (check_threads(threads) < 0) {
+        Py_DECREF(src_path);
+        Py_DECREF(dst_path);
+        return NULL;
+    }
+
+    int src_fd, dst_fd = -1;
+    unsigned char* in_data;
+    size_t in_size = 0;
+    int err = WH_OK, io_errno = 0;
+    BlockTable table;
+    memset(&table, 0, sizeof(table));
+
+    io_errno = map_input_file(PyBytes_AS_STRING(src_path), &src_fd, &in_data, &in_size);
+    if (io_errno) {
+        raise_file_error(WH_ERR_IO, io_errno, src_path);
+        Py_DECREF(src_path);
+        Py_DECREF(dst_path);
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    // mmap of an empty file gives NULL; any non-NULL pointer works for 0 bytes
+    err = load_block_table(in_data ? in_data : (const unsigned char*)"", in_size, SIZE_MAX, NULL, &table);
+    double t = stats_lap(&stats.index_seconds, stats.start);
+
+    if (!err) {
+        dst_fd = open(PyBytes_AS_STRING(dst_path), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (dst_fd < 0) {
+            err = WH_ERR_IO;
+            io_errno = errno;
+        }
+    }
+
+    // Reserve the whole output up front so the workers' writes never have
+    // to extend the file
+    if (!err && table.total_size > 0) {
+#ifdef __linux__
+        io_errno = posix_fallocate(dst_fd, 0, (off_t)table.total_size);
+        if (io_errno == EOPNOTSUPP || io_errno == EINVAL) io_errno = 0; // No fallocate here; ftruncate below
+#endif
+        if (!io_errno && ftruncate(dst_fd, (off_t)table.total_size) < 0) io_errno = errno;
+        if (io_errno) err = WH_ERR_IO;
+    }
+
+    if (!err) {
+        size_t num_blocks = table.num_blocks;
+        size_t group = table.group_blocks;
+        size_t num_groups = table_tasks(&table);
+        threads = acquire_threads(threads, num_groups);
+
+        // One task per block, or per group for linked frames (a group is
+        // decoded whole and written with one pwrite)
+        #pragma omp parallel if(threads > 1) num_threads(threads) copyin(team_slots)
+        {
+            unsigned char* scratch = NULL;
+            size_t scratch_size = 0;
+            DecodeScratch block_scratch = {0};
+
+            #pragma omp for schedule(runtime)
+            for (size_t g = 0; g < num_groups; ++g) {
+                if (err) continue;
+                place_worker();
+
+                size_t first = g * group;
+                size_t count = num_blocks - first < group ? num_blocks - first : group;
+                BlockIndex block, last;
+                int block_err = get_block(&table, first, &block);
+                if (!block_err) block_err = get_block(&table, first + count - 1, &last);
+                int e = 0;
+                if (!block_err) {
+                    const unsigned char* src = in_data + block.in_offset;
+                    size_t span = last.out_offset + last.orig_size - block.out_offset;
+                    if (count == 1 && (block.flags & BLOCK_FLAG_RAW)) {
+                        block_err = verify_block(&table, first, src, span);
+                    } else {
+                        if (scratch_size < span) {
+                            free(scratch);
+                            scratch = malloc(span);
+                            scratch_size = scratch ? span : 0;
+                        }
+                        if (!scratch) block_err = WH_ERR_NOMEM;
+                        else block_err = decode_run(&table, first, count, scratch, &block_scratch);
+                        src = scratch;
+                    }
+                    if (!block_err) {
+                        e = pwrite_all(dst_fd, src, span, (off_t)block.out_offset);
+                        if (e) block_err = WH_ERR_IO;
+                    }
+                }
+                if (block_err) {
+                    #pragma omp critical(wh_error)
+                    {
+                        if (!err) {
+                            err = block_err;
+                            io_errno = e;
+                        }
+                    }
+                }
+            }
+            free(scratch);
+            free_decode_scratch(&block_scratch);
+        }
+        release_threads(threads);
+        stats.threads = threads;
+    }
+    stats_lap(&stats.work_seconds, t);
+
+    if (dst_fd >= 0 && close(dst_fd) < 0 && !err) {
+        err = WH_ERR_IO;
+        io_errno = errno;
+    }
+    Py_END_ALLOW_THREADS
+
+    size_t total_size = table.total_size;
+    if (!err) stats_add_table(&stats, &table, 0, table.num_blocks - 1);
+    stats.bytes_in = in_size;
+    stats.bytes_out = total_size;
+    free_block_table(&table);
+    unmap_input_file(src_fd, in_data, in_size);
+
+    PyObject* result = err ? raise_file_error(err, io_errno, dst_path)
+                           : finish_call(PyLong_FromSize_t(total_size), &stats, 0);
+    Py_DECREF(src_path);
+    Py_DECREF(dst_path);
+    return result;
+}
+
+/* Open a stream argument: a path (opened with `flags`), or a descriptor or
+   file object, used as is after flushing anything it has buffered. Returns
+   -1 with an exception set. */
+static int stream_arg_fd(PyObject* obj, int flags, int* owns) {
+    *owns = 0;
+    if (!PyLong_Check(obj) && PyObject_HasAttrString(obj, "fileno")) {
+        if (PyObject_HasAttrString(obj, "flush")) {
+            PyObject* rc = PyObject_CallMethod(obj, "flush", NULL);
+            if (!rc) return -1;
+            Py_DECREF(rc);
+        }
+        return PyObject_AsFileDescriptor(obj);
+    }
+    if (PyLong_Check(obj)) return PyObject_AsFileDescriptor(obj);
+
+    PyObject* path = NULL;
+    if (!PyUnicode_FSConverter(obj, &path)) return -1;
+    int fd;
+    Py_BEGIN_ALLOW_THREADS
+    fd = open(PyBytes_AS_STRING(path), flags, 0666);
+    Py_END_ALLOW_THREADS
+    if (fd < 0) PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, obj);
+    Py_DECREF(path);
+    *owns = fd >= 0;
+    return fd;
+}
+
+/* Validate a max_memory argument. Returns -1 with an exception set. */
+static int check_max_memory(Py_ssize_t max_memory) {
+    if (max_memory < STREAM_MIN_MEMORY) {
+        PyErr_Format(PyExc_ValueError, "max_memory must be at least %d, got %zd", STREAM_MIN_MEMORY, max_memory);
+        return -1;
+    }
+    return 0;
+}
+
+
+/* Decompress from one file, pipe or file object to another in rounds of
+   about max_memory / 2 bytes of output, written in order. */
+static PyObject* decompress_stream(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"src", "dst", "threads", "dictionary", "max_memory", "stats", NULL};
+    PyObject* src;
+    PyObject* dst;
+    int threads = 0;
+    PyObject* dictionary = NULL;
+    const WarpDict* dict;
+    Py_ssize_t max_memory = STREAM_DEFAULT_MEMORY;
+    CallStats stats;
+    int want_stats = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|iOnp", kwlist, &src, &dst, &threads, &dictionary,
+                                     &max_memory, &want_stats)) {
+        return NULL;
+    }
+    stats_begin(&stats, want_stats);
+    if (check_threads(threads) < 0 || get_dictionary(module_state(self), dictionary, &dict) < 0 ||
+        check_max_memory(max_memory) < 0) {
+        return NULL;
+    }
+
+    int src_owned, dst_owned;
+    int src_fd = stream_arg_fd(src, O_RDONLY, &src_owned);
+    if (src_fd < 0) return NULL;
+    int dst_fd = stream_arg_fd(dst, O_WRONLY | O_CREAT | O_TRUNC, &dst_owned);
+    if (dst_fd < 0) {
+        if (src_owned) close(src_fd);
+        return NULL;
+    }
+
+    StreamDecoder stream;
+    unsigned char* out_data = NULL;
+    size_t out_cap = 0;
+    int err, io_errno = 0;
+    PyObject* err_path = src;
+
+    Py_BEGIN_ALLOW_THREADS
+    err = stream_open(&stream, src_fd, src_owned, dict, threads, (size_t)max_memory);
+    double t = stats_lap(&stats.index_seconds, stats.start);
+    while (!err) {
+        BlockTable table;
+        err = stream_next(&stream, &table);
+        t = stats_lap(&stats.index_seconds, t);
+        if (err || table.num_blocks == 0) {
+            free_block_table(&table);
+            break;
+        }
+
+        if (out_cap < table.total_size) {
+            free(out_data);
+            out_cap = table.total_size;
+            out_data = malloc(out_cap);
+            if (!out_data) {
+                out_cap = 0;
+                err = WH_ERR_NOMEM;
+            }
+        }
+        int used = 0;
+        if (!err) err = stream_decode(&stream, &table, out_data, &used);
+        t = stats_lap(&stats.work_seconds, t);
+        if (used > stats.threads) stats.threads = used;
+        if (!err) stats_add_table(&stats, &table, 0, table.num_blocks - 1);
+        if (!err) {
+            io_errno = write_all(dst_fd, out_data, table.total_size);
+            if (io_errno) {
+                err = WH_ERR_IO;
+                err_path = dst;
+            }
+        }
+        t = stats_lap(&stats.gather_seconds, t);
+        free_block_table(&table);
+    }
+    if (err == WH_ERR_IO && err_path == src) io_errno = stream.io_errno;
+    stats.bytes_in = stream.regular ? stream.file_size : stream.in_base + stream.in_pos;
+    stats.bytes_out = stream.bytes_out;
+    stats.bytes_allocated = stream.in_cap + out_cap;
+    free(out_data);
+    stream_close(&stream);
+    if (dst_owned && close(dst_fd) < 0 && !err) {
+        err = WH_ERR_IO;
+        io_errno = errno;
+        err_path = dst;
+    }
+    Py_END_ALLOW_THREADS
+
+    if (err) return raise_file_error(err, io_errno, err_path);
+    return finish_call(PyLong_FromSize_t(stats.bytes_out), &stats, 0);
+}
+
+
+/* Iterator over the decoded output of a file, one round at a time. */
+typedef struct {
+    PyObject_HEAD
+    StreamDecoder stream;
+    PyObject* src;         // For error messages
+    PyObject* dictionary;  // Keeps stream.dict alive
+    int done;
+    PyThread_type_lock lock;
+} DecompressIterObject;
+
+static void DecompressIter_dealloc(DecompressIterObject* self) {
+    stream_close(&self->stream);
+    Py_XDECREF(self->src);
+    Py_XDECREF(self->dictionary);
+    if (self->lock) PyThread_free_lock(self->lock);
+    PyTypeObject* type = Py_TYPE(self);
+    type->tp_free((PyObject*)self);
+    Py_DECREF(type);
+}
+
+static PyObject* DecompressIter_next(DecompressIterObject* self) {
+    ENTER_STREAM(self);
+    PyObject* out = NULL;
+    BlockTable table;
+    memset(&table, 0, sizeof(table));
+    int err = WH_OK;
+
+    if (!self->done) {
+        Py_BEGIN_ALLOW_THREADS
+        err = stream_next(&self->stream, &table);
+        Py_END_ALLOW_THREADS
+    }
+    if (!self->done && !err && table.num_blocks) {
+        out = PyBytes_FromStringAndSize(NULL, table.total_size);
+        if (out) {
+            int used;
+            Py_BEGIN_ALLOW_THREADS
+            err = stream_decode(&self->stream, &table, (unsigned char*)PyBytes_AS_STRING(out), &used);
+            Py_END_ALLOW_THREADS
+        }
+    }
+    free_block_table(&table);
+
+    // Done, failed or not: the descriptor is let go as soon as nothing more can come
+    if (err || !out) {
+        self->done = 1;
+        Py_CLEAR(out);
+        if (!PyErr_Occurred() && err) raise_file_error(err, self->stream.io_errno, self->src);
+        stream_close(&self->stream);
+    }
+    LEAVE_STREAM(self);
+    return out;
+}
+
+static PyType_Slot DecompressIter_slots[] = {
+    {Py_tp_dealloc, DecompressIter_dealloc},
+    {Py_tp_doc, "Iterator returned by iter_decompress(): yields the decoded frame in order, a window at a time."},
+    {Py_tp_iter, PyObject_SelfIter},
+    {Py_tp_iternext, DecompressIter_next},
+    {0, NULL}
+};
+
+static PyType_Spec DecompressIter_spec = {
+    .name = "warphybrid.DecompressIterator",
+    .basicsize = sizeof(DecompressIterObject),
+    .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE | Py_TPFLAGS_DISALLOW_INSTANTIATION,
+    .slots = DecompressIter_slots,
+};
+
+static PyObject* iter_decompress(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"src", "threads", "dictionary", "max_memory", NULL};
+    PyObject* src;
+    int threads = 0;
+    PyObject* dictionary = NULL;
+    const WarpDict* dict;
+    Py_ssize_t max_memory = STREAM_DEFAULT_MEMORY;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|iOn", kwlist, &src, &threads, &dictionary, &max_memory)) {
+        return NULL;
+    }
+    if (check_threads(threads) < 0 || get_dictionary(module_state(self), dictionary, &dict) < 0 ||
+        check_max_memory(max_memory) < 0) {
+        return NULL;
+    }
+
+    DecompressIterObject* it = PyObject_New(DecompressIterObject, module_state(self)->decompress_iter_type);
+    if (!it) return NULL;
+    memset(&it->stream, 0, sizeof(it->stream));
+    it->stream.fd = -1;
+    Py_INCREF(src);
+    it->src = src;
+    it->dictionary = dict ? dictionary : NULL;
+    Py_XINCREF(it->dictionary);
+    it->done = 0;
+    it->lock = PyThread_allocate_lock();
+    if (!it->lock) {
+        Py_DECREF(it);
+        return PyErr_NoMemory();
+    }
+
+    int owned;
+    int fd = stream_arg_fd(src, O_RDONLY, &owned);
+    if (fd < 0) {
+        Py_DECREF(it);
+        return NULL;
+    }
+    int err;
+    Py_BEGIN_ALLOW_THREADS
+    err = stream_open(&it->stream, fd, owned, dict, threads, (size_t)max_memory);
+    Py_END_ALLOW_THREADS
+    if (err) {
+        raise_file_error(err, it->stream.io_errno, src);
+        Py_DECREF(it);
+        return NULL;
+    }
+    return (PyObject*)it;
+}
+
+#endif /* !_WIN32 */
+
+
+// --- asyncio ---
+#ifndef _WIN32
+#include <pthread.h>  // pthread_atfork
+
+/* compress_async() / decompress_async(): requests are queued to one
+   persistent dispatcher thread. Each round it takes every request queued so
+   far and runs them as one compress_batch() / decode_batch() pass per group
+   of compatible options, so the blocks of many small in-flight requests
+   share one parallel loop on the team instead of each paying for its own
+   fork-join. Finished requests go back to their event loop through a wakeup
+   pipe the loop watches with add_reader(). Neither the dispatcher nor the
+   team ever takes the GIL. */
+
+typedef struct {
+    unsigned char* data;  // Frames of one compressed group, back to back
+    int refs;             // Jobs still to copy their frame out
+} AsyncBlob;
+
+typedef struct AsyncLoop {
+    int wake_fd[2];              // Read end is watched by the loop
+    PyThread_type_lock lock;     // Guards done / signaled
+    struct AsyncJob* done;       // Finished jobs, newest first
+    int signaled;                // A wakeup byte is in the pipe
+    Py_ssize_t in_flight;        // Submitted and not yet resolved (GIL)
+} AsyncLoop;
+
+typedef struct AsyncJob {
+    struct AsyncJob* next;
+    int compressing;
+    CompressOptions opts;        // Compression settings
+    const WarpDict* dict;        // Decompression dictionary, or NULL
+    Py_buffer input;
+    PyObject* dictionary;        // Keeps the Dictionary alive, or NULL
+    PyObject* future;
+    AsyncLoop* loop;
+    size_t num_blocks;           // Decompression: counted when submitted
+    PyObject* output;            // Decompression: exact-size bytes decoded into
+    unsigned char* output_data;
+    AsyncBlob* blob;             // Compression: holds this job's frame
+    size_t frame_offset, frame_len;
+    CallStats stats;
+    int err;
+} AsyncJob;
+
+static PyThread_type_lock async_lock = NULL;  // Guards the queue
+static PyThread_type_lock async_wake = NULL;  // Released to wake the dispatcher
+static AsyncJob* async_queue = NULL;
+static AsyncJob* async_queue_tail = NULL;
+static int async_signaled = 0;
+static int async_running = 0;
+static int async_atfork = 0;
+
+/* A forked child has no dispatcher thread, and the parent's may have held
+   these locks at the fork: forget them all (jobs queued by the parent stay
+   the parent's) so the child's first submit starts afresh. */
+static void async_after_fork(void) {
+    async_lock = async_wake = NULL;
+    async_queue = async_queue_tail = NULL;
+    async_signaled = 0;
+    async_running = 0;
+}
+
+static void async_release_blob(AsyncBlob* blob) {
+    int refs;
+    #pragma omp atomic capture
+    refs = --blob->refs;
+    if (refs == 0) {
+        free(blob->data);
+        free(blob);
+    }
+}
+
+/* Jobs of one round are batched together when this holds. */
+static int async_same_options(const AsyncJob* a, const AsyncJob* b) {
+    if (a->compressing != b->compressing) return 0;
+    if (!a->compressing) return a->dict == b->dict;
+    return a->opts.block_size == b->opts.block_size && a->opts.level == b->opts.level &&
+           a->opts.adaptive == b->opts.adaptive && a->opts.entropy_threshold == b->opts.entropy_threshold &&
+           a->opts.acceleration == b->opts.acceleration && a->opts.format == b->opts.format &&
+           a->opts.dict == b->opts.dict;
+}
+
+static void async_batch_of(AsyncJob** group, size_t n, PayloadBatch* batch) {
+    memset(batch, 0, sizeof(*batch));
+    batch->count = n;
+    batch->data = malloc((n + 1) * sizeof(*batch->data));
+    batch->sizes = malloc((n + 1) * sizeof(*batch->sizes));
+    if (!batch->data || !batch->sizes) return;
+    for (size_t i = 0; i < n; ++i) {
+        batch->data[i] = group[i]->input.buf;
+        batch->sizes[i] = (size_t)group[i]->input.len;
+    }
+}
+
+static void async_compress_group(AsyncJob** group, size_t n) {
+    CompressOptions opts = group[0]->opts;
+    size_t prefix = frame_prefix_size(opts.format);
+    PayloadBatch batch;
+    async_batch_of(group, n, &batch);
+
+    size_t bound = 0, total_blocks = 0;
+    for (size_t i = 0; i < n; ++i) {
+        bound += prefix + blocks_bound((size_t)group[i]->input.len, opts.block_size, opts.format);
+        total_blocks += ((size_t)group[i]->input.len + opts.block_size - 1) / opts.block_size;
+    }
+    size_t* frame_offsets = malloc((n + 1) * sizeof(size_t));
+    AsyncBlob* blob = malloc(sizeof(AsyncBlob));
+    unsigned char* data = malloc(bound ? bound : 1);
+
+    int err = WH_ERR_NOMEM;
+    if (batch.data && batch.sizes && frame_offsets && blob && data) {
+        double t = omp_get_wtime();
+        opts.threads = acquire_threads(0, total_blocks);
+        err = compress_batch(&batch, &opts, data, frame_offsets);
+        release_threads(opts.threads);
+        t = omp_get_wtime() - t;
+        for (size_t i = 0; i < n; ++i) {
+            group[i]->stats.work_seconds = t;
+            group[i]->stats.threads = opts.threads;
+        }
+    }
+    if (err) {
+        free(data);
+        free(blob);
+    } else {
+        blob->data = data;
+        blob->refs = (int)n;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        group[i]->err = err;
+        if (err) continue;
+        group[i]->blob = blob;
+        group[i]->frame_offset = frame_offsets[i];
+        group[i]->frame_len = frame_offsets[i + 1] - frame_offsets[i];
+        group[i]->stats.bytes_out = group[i]->frame_len;
+    }
+    free(frame_offsets);
+    free(batch.data);
+    free(batch.sizes);
+}
+
+static void async_decompress_group(AsyncJob** group, size_t n) {
+    PayloadBatch batch;
+    async_batch_of(group, n, &batch);
+    size_t* first_block = malloc((n + 1) * sizeof(size_t));
+    unsigned char** outputs = malloc((n + 1) * sizeof(unsigned char*));
+
+    int err = WH_ERR_NOMEM;
+    if (batch.data && batch.sizes && first_block && outputs) {
+        size_t total_blocks = 0;
+        for (size_t i = 0; i < n; ++i) {
+            first_block[i] = total_blocks;
+            total_blocks += group[i]->num_blocks;
+            outputs[i] = group[i]->output_data;
+        }
+        first_block[n] = total_blocks;
+
+        CallStats stats;
+        stats_begin(&stats, 0);
+        int threads = acquire_threads(0, total_blocks);
+        err = decode_batch(&batch, first_block, total_blocks, group[0]->dict, outputs, threads, &stats);
+        release_threads(threads);
+        double t = omp_get_wtime() - stats.start;
+        for (size_t i = 0; i < n; ++i) {
+            group[i]->stats.work_seconds = t;
+            group[i]->stats.threads = threads;
+        }
+    }
+    free(batch.data);
+    free(batch.sizes);
+    free(first_block);
+    free(outputs);
+
+    if (err && n > 1) {
+        // Only the failing requests should fail: decode them one by one
+        for (size_t i = 0; i < n; ++i) async_decompress_group(&group[i], 1);
+        return;
+    }
+    for (size_t i = 0; i < n; ++i) group[i]->err = err;
+}
+
+/* Hand a finished job back to its loop, waking the loop if it isn't
+   already due to wake. */
+static void async_deliver(AsyncJob* job) {
+    AsyncLoop* loop = job->loop;
+    PyThread_acquire_lock(loop->lock, WAIT_LOCK);
+    job->next = loop->done;
+    loop->done = job;
+    if (!loop->signaled) {
+        loop->signaled = 1;
+        // A full pipe already means a pending wakeup
+        ssize_t rc = write(loop->wake_fd[1], "", 1);
+        (void)rc;
+    }
+    PyThread_release_lock(loop->lock);
+}
+
+/* Run every job of a round (in submission order), one batch per group of
+   compatible jobs. */
+static void async_run_round(AsyncJob* jobs) {
+    size_t n = 0;
+    for (AsyncJob* job = jobs; job; job = job->next) n++;
+    AsyncJob** all = malloc(n * sizeof(AsyncJob*));
+    AsyncJob** group = malloc(n * sizeof(AsyncJob*));
+    if (!all || !group) {
+        free(all);
+        free(group);
+        while (jobs) {
+            AsyncJob* next = jobs->next;
+            jobs->err = WH_ERR_NOMEM;
+            async_deliver(jobs);
+            jobs = next;
+        }
+        return;
+    }
+    n = 0;
+    for (AsyncJob* job = jobs; job; job = job->next) all[n++] = job;
+
+    for (size_t first = 0; first < n; ++first) {
+        if (!all[first]) continue;
+        size_t count = 0;
+        for (size_t i = first; i < n; ++i) {
+            if (all[i] && async_same_options(all[first], all[i])) {
+                group[count++] = all[i];
+                if (i != first) all[i] = NULL;
+            }
+        }
+        all[first] = NULL;
+        if (group[0]->compressing) async_compress_group(group, count);
+        else async_decompress_group(group, count);
+        for (size_t i = 0; i < count; ++i) async_deliver(group[i]);
+    }
+    free(all);
+    free(group);
+}
+
+/* Dispatcher thread: sleep until jobs are queued, then run them all. Never
+   touches Python objects. */
+static void async_thread(void* arg) {
+    for (;;) {
+        PyThread_acquire_lock(async_wake, WAIT_LOCK);
+        PyThread_acquire_lock(async_lock, WAIT_LOCK);
+        AsyncJob* jobs = async_queue;
+        async_queue = async_queue_tail = NULL;
+        async_signaled = 0;
+        PyThread_release_lock(async_lock);
+        async_run_round(jobs);
+    }
+}
+
+static void async_free_job(AsyncJob* job) {
+    if (job->input.obj) PyBuffer_Release(&job->input);
+    Py_XDECREF(job->dictionary);
+    Py_XDECREF(job->future);
+    Py_XDECREF(job->output);
+    if (job->blob) async_release_blob(job->blob);
+    free(job);
+}
+
+// The exception currently set, normalized; clears it.
+static PyObject* fetch_exception(void) {
+#if PY_VERSION_HEX >= 0x030C0000
+    return PyErr_GetRaisedException();
+#else
+    PyObject *type, *value, *traceback;
+    PyErr_Fetch(&type, &value, &traceback);
+    PyErr_NormalizeException(&type, &value, &traceback);
+    if (value && traceback) PyException_SetTraceback(value, traceback);
+    Py_XDECREF(type);
+    Py_XDECREF(traceback);
+    return value;
+#endif
+}
+
+/* Resolve a finished job's future (unless it was cancelled) and free it. */
+static void async_complete(AsyncJob* job) {
+    PyObject* result = NULL;
+    if (job->err) {
+        raise_error(job->err);
+    } else if (job->compressing) {
+        result = PyBytes_FromStringAndSize((const char*)job->blob->data + job->frame_offset, job->frame_len);
+    } else {
+        result = job->output;
+        job->output = NULL;
+    }
+    result = finish_call(result, &job->stats, job->compressing);
+    PyObject* exc = result ? NULL : fetch_exception();
+
+    PyObject* cancelled = PyObject_CallMethod(job->future, "cancelled", NULL);
+    PyObject* rc = NULL;
+    if (cancelled && !PyObject_IsTrue(cancelled)) {
+        rc = result ? PyObject_CallMethod(job->future, "set_result", "O", result)
+                    : PyObject_CallMethod(job->future, "set_exception", "O", exc);
+    }
+    if (PyErr_Occurred()) PyErr_WriteUnraisable(job->future);
+    Py_XDECREF(rc);
+    Py_XDECREF(cancelled);
+    Py_XDECREF(result);
+    Py_XDECREF(exc);
+    job->loop->in_flight--;
+    async_free_job(job);
+}
+
+/* add_reader() callback: resolve everything that finished for this loop. */
+static PyObject* async_drain(PyObject* capsule, PyObject* Py_UNUSED(ignored)) {
+    AsyncLoop* loop = PyCapsule_GetPointer(capsule, "warphybrid.AsyncLoop");
+    if (!loop) return NULL;
+
+    char buf[64];
+    while (read(loop->wake_fd[0], buf, sizeof(buf)) > 0) {}
+    PyThread_acquire_lock(loop->lock, WAIT_LOCK);
+    AsyncJob* jobs = loop->done;
+    loop->done = NULL;
+    loop->signaled = 0;
+    PyThread_release_lock(loop->lock);
+
+    // Newest first on the list; resolve in completion order
+    AsyncJob* ordered = NULL;
+    while (jobs) {
+        AsyncJob* next = jobs->next;
+        jobs->next = ordered;
+        ordered = jobs;
+        jobs = next;
+    }
+    while (ordered) {
+        AsyncJob* next = ordered->next;
+        async_complete(ordered);
+        ordered = next;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef async_drain_def = {"_async_drain", async_drain, METH_NOARGS, NULL};
+
+static void async_loop_free(PyObject* capsule) {
+    AsyncLoop* loop = PyCapsule_GetPointer(capsule, "warphybrid.AsyncLoop");
+    if (!loop) return;
+    close(loop->wake_fd[0]);
+    close(loop->wake_fd[1]);
+    if (loop->lock) PyThread_free_lock(loop->lock);
+    free(loop);
+}
+
+/* The wakeup pipe for `event_loop`, created and registered with
+   add_reader() the first time this loop submits. Entries of loops that have
+   since been closed (with nothing left in flight) are dropped on the way. */
+static AsyncLoop* async_loop_for(ModuleState* state, PyObject* event_loop) {
+    if (!state->async_loops && !(state->async_loops = PyDict_New())) return NULL;
+    PyObject* capsule = PyDict_GetItemWithError(state->async_loops, event_loop);
+    if (capsule) return PyCapsule_GetPointer(capsule, "warphybrid.AsyncLoop");
+    if (PyErr_Occurred()) return NULL;
+
+    PyObject* known = PyDict_Items(state->async_loops);
+    if (!known) return NULL;
+    for (Py_ssize_t i = 0; i < PyList_GET_SIZE(known); ++i) {
+        PyObject* item = PyList_GET_ITEM(known, i);
+        AsyncLoop* old = PyCapsule_GetPointer(PyTuple_GET_ITEM(item, 1), "warphybrid.AsyncLoop");
+        PyObject* closed = PyObject_CallMethod(PyTuple_GET_ITEM(item, 0), "is_closed", NULL);
+        int drop = closed && PyObject_IsTrue(closed) && old && old->in_flight == 0;
+        Py_XDECREF(closed);
+        if (PyErr_Occurred() || (drop && PyDict_DelItem(state->async_loops, PyTuple_GET_ITEM(item, 0)) < 0)) {
+            Py_DECREF(known);
+            return NULL;
+        }
+    }
+    Py_DECREF(known);
+
+    AsyncLoop* loop = calloc(1, sizeof(AsyncLoop));
+    if (!loop) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    if (pipe(loop->wake_fd) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        free(loop);
+        return NULL;
+    }
+    for (int i = 0; i < 2; ++i) {
+        fcntl(loop->wake_fd[i], F_SETFL, fcntl(loop->wake_fd[i], F_GETFL) | O_NONBLOCK);
+        fcntl(loop->wake_fd[i], F_SETFD, FD_CLOEXEC);
+    }
+    loop->lock = PyThread_allocate_lock();
+    capsule = PyCapsule_New(loop, "warphybrid.AsyncLoop", async_loop_free);
+    if (!capsule) {
+        close(loop->wake_fd[0]);
+        close(loop->wake_fd[1]);
+        if (loop->lock) PyThread_free_lock(loop->lock);
+        free(loop);
+        return NULL;
+    }
+    if (!loop->lock) {
+        Py_DECREF(capsule);
+        PyErr_NoMemory();
+        return NULL;
+    }
+
+    PyObject* callback = PyCFunction_New(&async_drain_def, capsule);
+    PyObject* rc = callback ? PyObject_CallMethod(event_loop, "add_reader", "iO", loop->wake_fd[0], callback) : NULL;
+    Py_XDECREF(callback);
+    if (!rc || PyDict_SetItem(state->async_loops, event_loop, capsule) < 0) {
+        Py_XDECREF(rc);
+        Py_DECREF(capsule);
+        return NULL;
+    }
+    Py_DECREF(rc);
+    Py_DECREF(capsule);
+    return loop;
+}
+
+/* Queue `job` (input and options filled in) and return the future it will
+   resolve. Frees the job on failure. The loop table belongs to the module
+   (one per interpreter); the dispatcher is shared by all of them, since it
+   never touches Python objects. */
+static PyObject* async_submit(PyObject* module, AsyncJob* job) {
+    ModuleState* state = module_state(module);
+    PyObject* event_loop = NULL;
+    Py_BEGIN_CRITICAL_SECTION(module);
+    if (!state->asyncio_module) state->asyncio_module = PyImport_ImportModule("asyncio");
+    if (state->asyncio_module) event_loop = PyObject_CallMethod(state->asyncio_module, "get_running_loop", NULL);
+    if (event_loop) job->loop = async_loop_for(state, event_loop);
+    Py_END_CRITICAL_SECTION();
+    if (!job->loop) goto fail;
+    job->future = PyObject_CallMethod(event_loop, "create_future", NULL);
+    if (!job->future) goto fail;
+
+    int started = 1;
+    #pragma omp critical(wh_async)
+    {
+        if (!async_atfork) async_atfork = pthread_atfork(NULL, NULL, async_after_fork) == 0;
+        if (!async_lock) {
+            async_lock = PyThread_allocate_lock();
+            async_wake = PyThread_allocate_lock();
+            if (async_lock && async_wake) {
+                PyThread_acquire_lock(async_wake, WAIT_LOCK);  // Held until there is work
+            } else {
+                if (async_lock) PyThread_free_lock(async_lock);
+                if (async_wake) PyThread_free_lock(async_wake);
+                async_lock = async_wake = NULL;
+                started = -1;
+            }
+        }
+        if (started > 0 && !async_running) {
+            if (PyThread_start_new_thread(async_thread, NULL) == PYTHREAD_INVALID_THREAD_ID) started = 0;
+            else async_running = 1;
+        }
+    }
+    if (started < 0) {
+        PyErr_NoMemory();
+        goto fail;
+    }
+    if (!started) {
+        PyErr_SetString(PyExc_RuntimeError, "can't start the async dispatcher thread");
+        goto fail;
+    }
+    Py_DECREF(event_loop);
+
+    PyObject* future = job->future;
+    Py_INCREF(future);
+    job->loop->in_flight++;
+    PyThread_acquire_lock(async_lock, WAIT_LOCK);
+    if (async_queue_tail) async_queue_tail->next = job;
+    else async_queue = job;
+    async_queue_tail = job;
+    if (!async_signaled) {
+        async_signaled = 1;
+        PyThread_release_lock(async_wake);
+    }
+    PyThread_release_lock(async_lock);
+    return future;
+
+fail:
+    Py_XDECREF(event_loop);
+    async_free_job(job);
+    return NULL;
+}
+
+/* Awaitable compress_many()-style compression of one payload. */
+static PyObject* compress_async(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"data", "block_size", "level", "adaptive", "entropy_threshold", "dictionary",
+                             "acceleration", "format", NULL};
+    AsyncJob* job = calloc(1, sizeof(AsyncJob));
+    if (!job) return PyErr_NoMemory();
+    Py_ssize_t block_size_arg = DEFAULT_BLOCK_SIZE;
+    job->compressing = 1;
+    job->opts = default_compress_options;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*|nipdOii", kwlist, &job->input, &block_size_arg,
+                                     &job->opts.level, &job->opts.adaptive, &job->opts.entropy_threshold,
+                                     &job->dictionary, &job->opts.acceleration, &job->opts.format)) {
+        job->dictionary = NULL;  // Borrowed until here
+        async_free_job(job);
+        return NULL;
+    }
+    stats_begin(&job->stats, 0);
+    job->stats.bytes_in = (size_t)job->input.len;
+    Py_XINCREF(job->dictionary);
+    if (check_block_size(block_size_arg) < 0 || check_level(job->opts.level) < 0 ||
+        check_format(job->opts.format) < 0 || use_acceleration(0, &job->opts, NULL) < 0 ||
+        use_dictionary(module_state(self), job->dictionary, &job->opts) < 0) {
+        async_free_job(job);
+        return NULL;
+    }
+    job->opts.block_size = (size_t)block_size_arg;
+    return async_submit(self, job);
+}
+
+/* Awaitable decompress_hybrid(). The frame's headers are read (and checked)
+   right away, so its output can be sized before it is queued. */
+static PyObject* decompress_async(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"data", "dictionary", NULL};
+    AsyncJob* job = calloc(1, sizeof(AsyncJob));
+    if (!job) return PyErr_NoMemory();
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*|O", kwlist, &job->input, &job->dictionary)) {
+        job->dictionary = NULL;
+        async_free_job(job);
+        return NULL;
+    }
+    stats_begin(&job->stats, 0);
+    job->stats.bytes_in = (size_t)job->input.len;
+    Py_XINCREF(job->dictionary);
+    if (get_dictionary(module_state(self), job->dictionary, &job->dict) < 0) {
+        async_free_job(job);
+        return NULL;
+    }
+
+    size_t total_size, group;
+    const unsigned char* checksums;
+    int err = scan_frame(job->input.buf, (size_t)job->input.len, job->dict, NULL, &job->num_blocks, &total_size,
+                         &group, &checksums);
+    if (err) {
+        async_free_job(job);
+        return raise_error(err);
+    }
+    job->output = PyBytes_FromStringAndSize(NULL, total_size);
+    if (!job->output) {
+        async_free_job(job);
+        return NULL;
+    }
+    job->output_data = (unsigned char*)PyBytes_AS_STRING(job->output);
+    job->stats.bytes_out = total_size;
+    return async_submit(self, job);
+}
+
+#endif /* !_WIN32 */
+
+
+/* Cap the process-wide thread budget shared by all calls */
+static PyObject* set_max_threads(PyObject* self, PyObject* args) {
+    int n;
+    if (!PyArg_ParseTuple(args, "i", &n)) return NULL;
+    if (n < 0) {
+        PyErr_Format(PyExc_ValueError, "set_max_threads() needs a non-negative count (0 = default), got %d", n);
+        return NULL;
+    }
+
+    int previous;
+    wh_set_max_threads(n, &previous);
+    return PyLong_FromLong(previous);
+}
+
+static PyObject* set_numa_placement(PyObject* self, PyObject* args) {
+    int enabled;
+    if (!PyArg_ParseTuple(args, "p", &enabled)) return NULL;
+
+    int previous;
+    wh_set_numa_placement(enabled, &previous);
+    return PyBool_FromLong(previous);
+}
+
+
+/* Module-wide counters, cumulative since import */
+static PyObject* counters(PyObject* self, PyObject* Py_UNUSED(ignored)) {
+    unsigned long long compressed, raw, skipped, deduplicated;
+    unsigned long long c_calls, c_in, c_out, d_calls, d_in, d_out;
+    double c_seconds, d_seconds;
+    #pragma omp atomic read
+    compressed = blocks_compressed_total;
+    #pragma omp atomic read
+    raw = blocks_raw_total;
+    #pragma omp atomic read
+    skipped = blocks_skipped_total;
+    #pragma omp atomic read
+    deduplicated = blocks_deduplicated_total;
+    #pragma omp atomic read
+    c_calls = compress_calls_total;
+    #pragma omp atomic read
+    c_in = compress_bytes_in_total;
+    #pragma omp atomic read
+    c_out = compress_bytes_out_total;
+    #pragma omp atomic read
+    c_seconds = compress_seconds_total;
+    #pragma omp atomic read
+    d_calls = decompress_calls_total;
+    #pragma omp atomic read
+    d_in = decompress_bytes_in_total;
+    #pragma omp atomic read
+    d_out = decompress_bytes_out_total;
+    #pragma omp atomic read
+    d_seconds = decompress_seconds_total;
+
+    return Py_BuildValue("{s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:d,s:K,s:K,s:K,s:d}",
+                         "blocks_compressed", compressed,
+                         "blocks_stored_raw", raw,
+                         "blocks_precheck_skipped", skipped,
+                         "blocks_deduplicated", deduplicated,
+                         "compress_calls", c_calls,
+                         "compress_bytes_in", c_in,
+                         "compress_bytes_out", c_out,
+                         "compress_seconds", c_seconds,
+                         "decompress_calls", d_calls,
+                         "decompress_bytes_in", d_in,
+                         "decompress_bytes_out", d_out,
+                         "decompress_seconds", d_seconds);
+}
+
+
+/* Python Module Definitions */
+static PyMethodDef WarpHybridMethods[] = {
+    {"compress_hybrid", (PyCFunction)(void(*)(void))compress_hybrid, METH_VARARGS | METH_KEYWORDS, "Compress using Blocked LZ4 (multithreaded).\nArgs: (data_bytes, block_size=None, seekable=False, level=0, adaptive=False, entropy_threshold=7.8, threads=0, dictionary=None, linked=False, checksum=False, acceleration=1, target_mbps=0, format=1, stats=False, dedup=False, typesize=1)\nblock_size=None sizes blocks for the call: about 4 per thread (or per linked group), 64 KB to 4 MB.\nseekable=True appends a block index footer for fast and random-access decompression.\nlinked=True primes each block with the 64 KB of input before it (groups of 16 blocks stay independent); implies seekable.\nchecksum=True records an XXH3-64 of every block in the footer, checked whenever a whole block is decoded; implies seekable.\nlevel 1-12 uses LZ4HC; adaptive=True starts each block fast and escalates to HC (level, or 9) only where a trial shows a real gain.\nBlocks whose sampled byte entropy is >= entropy_threshold bits/byte (and that fail a short trial) are stored raw without running LZ4; 0 disables the check.\nacceleration > 1 trades ratio for speed at level 0; target_mbps > 0 retunes it per block to reach that many MB/s for the whole call.\nformat=2 writes compact varint block headers with per-block flags; decoders read both formats.\ndedup=True cuts content-defined chunks (block_size/4 to block_size) and stores each repeat as a reference to its first copy; implies format=2, not with linked.\ntypesize=N (2-255) byte-shuffles each block as N-byte elements before compressing, for arrays of numbers; implies format=2, not with linked.\nstats=True returns (result, stats dict) with timings, block and ratio figures for the call."},
+    {"decompress_hybrid", (PyCFunction)(void(*)(void))decompress_hybrid, METH_VARARGS | METH_KEYWORDS, "Decompress Blocked LZ4 (multithreaded)\nArgs: (data_bytes, threads=0, dictionary=None, stats=False, max_output_size=0)\nPass the Dictionary the data was compressed with, if any.\nmax_output_size > 0 raises ValueError before allocating anything if the output would be larger.\nstats=True returns (result, stats dict) with timings, block and ratio figures for the call."},
+    {"compress_into", (PyCFunction)(void(*)(void))compress_into, METH_VARARGS | METH_KEYWORDS, "compress_hybrid() into a writable buffer; returns the number of bytes written.\nArgs: (data_bytes, dst, block_size=None, seekable=False, level=0, adaptive=False, entropy_threshold=7.8, threads=0, dictionary=None, linked=False, checksum=False, acceleration=1, target_mbps=0, format=1, stats=False, dedup=False, typesize=1)\ndst must hold at least compress_bound(len(data), block_size, seekable) bytes (passing the same format, dedup and typesize).\nstats=True returns (result, stats dict) with timings, block and ratio figures for the call."},
+    {"decompress_into", (PyCFunction)(void(*)(void))decompress_into, METH_VARARGS | METH_KEYWORDS, "decompress_hybrid() into a writable buffer; returns the number of bytes written.\nArgs: (data_bytes, dst, threads=0, dictionary=None, stats=False)\nstats=True returns (result, stats dict) with timings, block and ratio figures for the call."},
+    {"compress_many", (PyCFunction)(void(*)(void))compress_many, METH_VARARGS | METH_KEYWORDS, "Compress a sequence of payloads into one frame each, in a single parallel pass over all of their blocks.\nArgs: (items, block_size=1048576, level=0, adaptive=False, entropy_threshold=7.8, concat=False, threads=0, dictionary=None, acceleration=1, target_mbps=0, format=1, stats=False)\nReturns a list of frames, or with concat=True a (blob, offsets) pair where frame i is blob[offsets[i]:offsets[i + 1]].\nstats=True returns (result, stats dict) with timings, block and ratio figures for the call."},
+    {"decompress_many", (PyCFunction)(void(*)(void))decompress_many, METH_VARARGS | METH_KEYWORDS, "Decompress many frames in a single parallel pass over all of their blocks.\nArgs: (items, offsets=None, concat=False, threads=0, dictionary=None, stats=False)\nitems is a sequence of frames, or a single blob sliced by offsets (as returned by compress_many(concat=True)).\nReturns a list, or with concat=True a (blob, offsets) pair.\nstats=True returns (result, stats dict) with timings, block and ratio figures for the call."},
+    {"compress_bound", (PyCFunction)(void(*)(void))compress_bound, METH_VARARGS | METH_KEYWORDS, "Worst-case compressed size, for sizing compress_into() buffers.\nArgs: (size, block_size=None, seekable=False, dictionary=None, linked=False, checksum=False, format=1, dedup=False, typesize=1)\nWith block_size=None the bound holds for whatever block size automatic sizing picks."},
+    {"verify", (PyCFunction)(void(*)(void))verify, METH_VARARGS | METH_KEYWORDS, "Check a frame without decompressing it into memory: headers, every block's LZ4 data and recorded checksums (multithreaded).\nArgs: (data_bytes, threads=0, dictionary=None)\nBlocks are decoded into small per-thread scratch buffers, so memory stays near threads x block_size.\nReturns None if the frame is intact, else a dict with error and the first bad block's index and output offset (block and offset are None when the frame structure itself is broken).\nRaises ValueError if the frame needs a dictionary that wasn't given."},
+    {"frame_info", frame_info, METH_VARARGS, "Describe a frame without decoding it: reads the seekable footer, or walks the block headers of a plain frame.\nArgs: (data_bytes)\nReturns a dict with total_size, num_blocks, block_size (the largest block for plain frames), format, seekable, linked, checksum, dictionary and dictionary_id (None unless the footer records one).\nPlain v1 frames don't record dictionary use, so dictionary reads False for them."},
+    {"decompress_range", (PyCFunction)(void(*)(void))decompress_range, METH_VARARGS | METH_KEYWORDS, "Decompress only bytes [offset, offset + length) (multithreaded).\nArgs: (data_bytes, offset, length, threads=0, dictionary=None, stats=False)\nFast on seekable frames; plain frames have their headers walked up to the range.\nstats=True returns (result, stats dict) with timings, block and ratio figures for the call."},
+    {"compress_frame", (PyCFunction)(void(*)(void))compress_lz4_frame, METH_VARARGS | METH_KEYWORDS, "Compress into a standard LZ4 frame (.lz4) with independent blocks (multithreaded).\nArgs: (data_bytes, block_size=1048576, level=0, content_checksum=True, block_checksum=False, threads=0, acceleration=1, target_mbps=0, stats=False)\nblock_size must be 64 KB, 256 KB, 1 MB or 4 MB. The content size is always recorded.\nstats=True returns (result, stats dict) with timings, block and ratio figures for the call."},
+    {"decompress_frame", (PyCFunction)(void(*)(void))decompress_lz4_frame, METH_VARARGS | METH_KEYWORDS, "Decompress standard LZ4 frames (.lz4), e.g. from the lz4 CLI.\nArgs: (data_bytes, threads=0, stats=False)\nIndependent blocks decode in parallel; frames with linked blocks decode on one thread.\nstats=True returns (result, stats dict) with timings, block and ratio figures for the call."},
+#ifndef _WIN32
+    {"compress_file", (PyCFunction)(void(*)(void))compress_file, METH_VARARGS | METH_KEYWORDS, "Compress a file into another file without loading it into Python (multithreaded).\nArgs: (src_path, dst_path, block_size=None, seekable=False, level=0, adaptive=False, entropy_threshold=7.8, threads=0, linked=False, checksum=False, acceleration=1, target_mbps=0, format=1, stats=False, typesize=1)\nReturns the compressed size.\nstats=True returns (result, stats dict) with timings, block and ratio figures for the call."},
+    {"decompress_file", (PyCFunction)(void(*)(void))decompress_file, METH_VARARGS | METH_KEYWORDS, "Decompress a file into another file without loading it into Python (multithreaded).\nArgs: (src_path, dst_path, threads=0, stats=False)\nReturns the decompressed size.\nstats=True returns (result, stats dict) with timings, block and ratio figures for the call."},
+    {"decompress_stream", (PyCFunction)(void(*)(void))decompress_stream, METH_VARARGS | METH_KEYWORDS, "Decompress from a file to a file in bounded memory (multithreaded).\nArgs: (src, dst, threads=0, dictionary=None, max_memory=67108864, stats=False)\nsrc and dst are paths, descriptors or file objects (pipes included); output is written in order.\nEach round reads about max_memory / 2 bytes of input and decodes up to max_memory / 2 bytes of output; a block or linked group larger than that is still done whole.\nFrom a pipe, a footer is only met at the end: checksums are then compared with hashes taken while decoding, and a mismatch raises after the output is written.\nLinked frames and dedup references to blocks that have left the window need src to be a regular file.\nReturns the decompressed size; stats=True returns (result, stats dict) with timings, block and ratio figures for the call."},
+    {"iter_decompress", (PyCFunction)(void(*)(void))iter_decompress, METH_VARARGS | METH_KEYWORDS, "Iterate over the decompressed content of a file in bounded memory (multithreaded).\nArgs: (src, threads=0, dictionary=None, max_memory=67108864)\nsrc is a path, descriptor or file object; yields bytes chunks of up to about max_memory / 2 in order, each decoded across the team.\nThe same rules as decompress_stream() apply."},
+    {"compress_async", (PyCFunction)(void(*)(void))compress_async, METH_VARARGS | METH_KEYWORDS, "Compress on the background dispatcher; returns an asyncio future for the frame (call from a running event loop).\nArgs: (data_bytes, block_size=1048576, level=0, adaptive=False, entropy_threshold=7.8, dictionary=None, acceleration=1, format=1)\nRequests queued at the same time are compressed together in one parallel pass over all of their blocks.\nThe result is the plain frame compress_hybrid() would write; data must not change until the future is done."},
+    {"decompress_async", (PyCFunction)(void(*)(void))decompress_async, METH_VARARGS | METH_KEYWORDS, "Decompress on the background dispatcher; returns an asyncio future for the data (call from a running event loop).\nArgs: (data_bytes, dictionary=None)\nThe frame's headers are checked before this returns; block errors are raised by the future."},
+#endif
+    {"set_max_threads", set_max_threads, METH_VARARGS, "Cap the number of threads all calls together may use (0 = OpenMP default); returns the previous cap.\nEvery call takes a share of this budget while it runs, so concurrent callers split the cores.\nthreads=N on a call asks for at most N; threads=0 takes whatever is free. Inputs of one block always run on the calling thread."},
+    {"set_numa_placement", set_numa_placement, METH_VARARGS, "Turn NUMA-aware placement on or off for all later calls; returns the previous setting.\nOn: blocks go to the team statically, so the same worker always writes the same part of an output (and first-touches\nits pages onto its own node), and workers other than the calling thread are pinned one per CPU, spread over the allowed CPUs.\nPinning is skipped when OMP_PROC_BIND already binds the team. Off (the default) hands blocks out dynamically and unpins."},
+    {"counters", counters, METH_NOARGS, "Cumulative counters since import: blocks_compressed, blocks_stored_raw\n(incompressible blocks) and blocks_precheck_skipped (raw blocks that never went through LZ4),\nblocks_deduplicated (repeats stored as references), plus calls, bytes in/out and seconds for all successful compress_* and decompress_* calls (one-shot and file APIs)."},
+    {NULL, NULL, 0, NULL}
+};
+
+static int module_traverse(PyObject* module, visitproc visit, void* arg) {
+    ModuleState* state = module_state(module);
+    Py_VISIT(state->dictionary_type);
+    Py_VISIT(state->compressor_type);
+    Py_VISIT(state->decompressor_type);
+    Py_VISIT(state->buffer_pool_type);
+    Py_VISIT(state->pooled_buffer_type);
+    Py_VISIT(state->decompress_iter_type);
+    Py_VISIT(state->async_loops);
+    Py_VISIT(state->asyncio_module);
+    return 0;
+}
+
+static int module_clear(PyObject* module) {
+    ModuleState* state = module_state(module);
+    Py_CLEAR(state->dictionary_type);
+    Py_CLEAR(state->compressor_type);
+    Py_CLEAR(state->decompressor_type);
+    Py_CLEAR(state->buffer_pool_type);
+    Py_CLEAR(state->pooled_buffer_type);
+    Py_CLEAR(state->decompress_iter_type);
+    Py_CLEAR(state->async_loops);
+    Py_CLEAR(state->asyncio_module);
+    return 0;
+}
+
+static void module_free(void* module) {
+    module_clear((PyObject*)module);
+}
+
+/* Create one of the module's types and store it in `*slot`; `exported`
+   types are also added to the module by name. */
+static int add_type(PyObject* module, PyType_Spec* spec, int exported, PyTypeObject** slot) {
+    *slot = (PyTypeObject*)PyType_FromModuleAndSpec(module, spec, NULL);
+    if (!*slot) return -1;
+#if PY_VERSION_HEX < 0x030A0000
+    if (!exported) (*slot)->tp_new = NULL;  // Created by the module only
+#endif
+    return exported ? PyModule_AddType(module, *slot) : 0;
+}
+
+static int module_exec(PyObject* module) {
+    ModuleState* state = module_state(module);
+    if (add_type(module, &Compressor_spec, 1, &state->compressor_type) < 0 ||
+        add_type(module, &Decompressor_spec, 1, &state->decompressor_type) < 0 ||
+        add_type(module, &Dictionary_spec, 1, &state->dictionary_type) < 0 ||
+        add_type(module, &BufferPool_spec, 1, &state->buffer_pool_type) < 0 ||
+        add_type(module, &PooledBuffer_spec, 0, &state->pooled_buffer_type) < 0) {
+        return -1;
+    }
+#ifndef _WIN32
+    if (add_type(module, &DecompressIter_spec, 0, &state->decompress_iter_type) < 0) return -1;
+#endif
+    return 0;
+}
+
+/* Every interpreter gets its own module and types. The module needs no GIL:
+   engine state is C only (OpenMP criticals and atomics), Compressor and
+   Decompressor hold their own locks, and BufferPool and PooledBuffer lock
+   themselves with critical sections. */
+static PyModuleDef_Slot WarpHybridSlots[] = {
+    {Py_mod_exec, module_exec},
+#ifdef Py_mod_multiple_interpreters
+    {Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED},
+#endif
+#ifdef Py_mod_gil
+    {Py_mod_gil, Py_MOD_GIL_NOT_USED},
+#endif
+    {0, NULL}
 };
 
 static struct PyModuleDef warphybridmodule = {
     PyModuleDef_HEAD_INIT,
-    "warphybrid",
-    NULL,
-    -1,
-    WarpHybridMethods
+    .m_name = "warphybrid",
+    .m_size = sizeof(ModuleState),
+    .m_methods = WarpHybridMethods,
+    .m_slots = WarpHybridSlots,
+    .m_traverse = module_traverse,
+    .m_clear = module_clear,
+    .m_free = module_free,
 };
 
 PyMODINIT_FUNC PyInit_warphybrid(void) {
-    return PyModule_Create(&warphybridmodule);
+    return PyModuleDef_Init(&warphybridmodule);
 }
@@ -0,0 +1,4006 @@
+/* The warphybrid engine: blocked LZ4 frames, compressed and decompressed
+   across an OpenMP team. Nothing here touches Python. Built on its own it
+   is libwarphybrid, with the C API of warphybrid.h at the end of the file
+   (warp_bench.c and test_capi.c are clients of it); warp_compress.c
+   includes it and adds the Python bindings.
+
+   The parts only the bindings call so far (the Compressor's block path,
+   per-call statistics of block tables, huge-page advice, batches, standard
+   LZ4 frames, files and streams) are compiled when WH_BINDINGS is defined,
+   as warp_compress.c does before the include. libwarphybrid leaves them
+   out. */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  // sched_setaffinity, CPU_SETSIZE
+#endif
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>     // For multithreading
+#ifdef _MSC_VER
+#include <intrin.h>  // _BitScanForward64
+#endif
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sched.h>   // sched_setaffinity, for NUMA placement
+#endif
+// Byte shuffle kernels, on the vector baseline of each target
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SHUFFLE_SSE2 1
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define SHUFFLE_NEON 1
+#endif
+#define LZ4_STATIC_LINKING_ONLY     // LZ4_compress_fast_extState_fastReset
+#define LZ4_HC_STATIC_LINKING_ONLY  // LZ4_compress_HC_extStateHC_fastReset
+#include "lz4.h"
+#include "lz4frame.h"
+#include "lz4hc.h"
+#include "xxhash.h"
+#include "warphybrid.h"
+
+// Set max to 512MB to allow for large block testing
+#define MAX_BLOCK_SIZE (512 * 1024 * 1024) 
+#define HEADER_SIZE 8  // 4 bytes original block size + 4 bytes compressed size
+#define DEFAULT_BLOCK_SIZE (1024 * 1024)
+// Automatic block size (block_size=None): about AUTO_BLOCKS_PER_THREAD
+// blocks (or linked groups) per thread, so the dynamic schedule has spare
+// blocks to even out a skewed mix. Never below AUTO_MIN_BLOCK_SIZE, one LZ4
+// window, where splitting starts to cost ratio; never above
+// AUTO_MAX_BLOCK_SIZE, where one straggler holds up the call
+#define AUTO_BLOCKS_PER_THREAD 4
+#define AUTO_MIN_BLOCK_SIZE (64 * 1024)
+#define AUTO_MAX_BLOCK_SIZE (4 * 1024 * 1024)
+#define AUTO_BLOCK_ALIGN 4096
+// Compact framing (format=2): the frame opens with FRAME_V2_MAGIC and each
+// block header is [u8 flags][u8 typesize][varint orig_size][varint comp_size],
+// with typesize only present on shuffled blocks and comp_size left out for
+// raw blocks. Read as a v1 header, the magic is a
+// block size above MAX_BLOCK_SIZE, so it never starts a valid v1 frame.
+#define FRAME_V2_MAGIC 0xB2424857u  // "WHB" + 0xB2
+#define FRAME_V2_MAGIC_SIZE 4
+#define V2_HEADER_MAX 12            // Flags and typesize bytes + two 5-byte varints
+#define BLOCK_FLAG_RAW 0x01u        // Stored as is
+#define BLOCK_FLAG_HC 0x02u         // Compressed with LZ4HC (informational)
+#define BLOCK_FLAG_DICT 0x04u       // Decodes against the dictionary
+#define BLOCK_FLAG_LINKED 0x08u     // Decodes against the window of output before it
+#define BLOCK_FLAG_REF 0x10u        // Same bytes as an earlier block; payload is its varint index
+#define BLOCK_FLAG_SHUFFLE 0x20u    // Byte-shuffled by typesize before compressing
+#define BLOCK_KNOWN_FLAGS 0x3Fu
+#define MAX_TYPESIZE 255
+// Blocks per thread that a streaming Compressor hands to the workers at once
+#define STREAM_BLOCKS_PER_THREAD 2
+// Blocks per thread compress_file() keeps in memory per batch
+#define FILE_BLOCKS_PER_THREAD 4
+// decompress_stream() / iter_decompress(): input + output window per round
+#define STREAM_DEFAULT_MEMORY (64 * 1024 * 1024)
+#define STREAM_MIN_MEMORY (1024 * 1024)
+// Adaptive level: HC is only used for a block if it beats the fast level by
+// this much on a trial compress of the block's first ADAPTIVE_SAMPLE_SIZE bytes
+#define ADAPTIVE_SAMPLE_SIZE (64 * 1024)
+#define ADAPTIVE_MIN_GAIN_PCT 10
+// Incompressibility pre-check: a block whose sampled byte entropy is at or
+// above the threshold (bits/byte) and whose first PRECHECK_TRIAL_SIZE bytes
+// don't compress by PRECHECK_MIN_GAIN_PCT is stored raw without running LZ4
+#define DEFAULT_ENTROPY_THRESHOLD 7.8
+#define PRECHECK_RUNS 64          // Sample = PRECHECK_RUNS x PRECHECK_RUN_SIZE bytes,
+#define PRECHECK_RUN_SIZE 64      // spread evenly over the block
+#define PRECHECK_TRIAL_SIZE (16 * 1024)
+#define PRECHECK_MIN_GAIN_PCT 3
+// Calls with fewer blocks than this run on the calling thread alone: one
+// block can't be split, and waking a team costs more than it saves
+#define PARALLEL_MIN_BLOCKS 2
+// Dedup (dedup=True, format 2): the input is cut into content-defined chunks
+// of block_size / CDC_MIN_DIVISOR .. block_size bytes where a gear rolling
+// hash of the last 64 bytes hits a mask, and a chunk whose XXH3-128 (and
+// bytes) match an earlier one is stored as a reference to it. Segments of
+// CDC_SEGMENT_BLOCKS blocks are cut in parallel, each from its own start
+#define CDC_MIN_DIVISOR 4
+#define CDC_MIN_CHUNK 64
+#define CDC_SEGMENT_BLOCKS 16
+#define CDC_SLOT_OVERHEAD (V2_HEADER_MAX + 16)  // Header room + LZ4_compressBound() slack
+// Scratch used to compact blocks into their final position, per round
+#define COMPACT_STAGING_SIZE (64 * 1024 * 1024)
+// Worker LZ4 states are aligned to this, so no two share a cache line
+#define CACHE_LINE_SIZE 64
+// Transparent huge page size. Outputs of at least HUGE_ADVISE_MIN bytes are
+// advised for THP, and BufferPool regions are multiples of it
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define HUGE_ADVISE_MIN (16 * HUGE_PAGE_SIZE)
+#define POOL_DEFAULT_BUFFERS 4
+
+// Optional seekable footer, appended after the last block:
+//   [blocks...][index: num_blocks x FOOTER_ENTRY_SIZE][tail: FOOTER_TAIL_SIZE]
+// Each index entry is a serialized BlockIndex (u64 in_offset, u64 out_offset,
+// u32 comp_size, u32 orig_size); in_offset is where the payload starts in v1
+// frames and where the (variable-size) header starts in v2 frames. The tail
+// is u64 num_blocks, u64 total_size, u32 block_size, u32 flags, u32 version,
+// u32 magic.
+#define FOOTER_MAGIC 0x46424857u  // "WHBF"
+#define FOOTER_VERSION 1
+#define FOOTER_ENTRY_SIZE 24
+#define FOOTER_TAIL_SIZE 32
+// Optional sections, present when their flag is set, sit between the index
+// and the tail in flag order:
+//   FOOTER_FLAG_DICT: u32 dictionary id, u32 reserved (0)
+//   FOOTER_FLAG_LINKED: u32 blocks per group, u32 reserved (0)
+//   FOOTER_FLAG_CHECKSUM: num_blocks x u64 XXH3-64 of each block's content
+#define FOOTER_FLAG_DICT 0x1u
+#define FOOTER_FLAG_LINKED 0x2u
+#define FOOTER_FLAG_CHECKSUM 0x4u
+#define FOOTER_KNOWN_FLAGS (FOOTER_FLAG_DICT | FOOTER_FLAG_LINKED | FOOTER_FLAG_CHECKSUM)
+#define FOOTER_DICT_SECTION_SIZE 8
+#define FOOTER_LINKED_SECTION_SIZE 8
+#define FOOTER_CHECKSUM_SIZE 8
+
+// Linked mode: every block but the first of each group of
+// LINKED_GROUP_BLOCKS is compressed against the LINKED_WINDOW_SIZE bytes of
+// input before it. Groups are independent, which is what decodes in parallel.
+#define LINKED_GROUP_BLOCKS 16
+#define LINKED_WINDOW_SIZE (64 * 1024)
+
+// LZ4 only ever references the last 64 KB of a dictionary
+#define DICT_MAX_SIZE (64 * 1024)
+// Dictionary trainer: candidate segments are scored by how many samples
+// share each of their DICT_TRAIN_KMER-byte substrings
+#define DICT_TRAIN_SEGMENT 64
+#define DICT_TRAIN_KMER 8
+#define DICT_TRAIN_HASH_LOG 20
+
+// Throughput target (target_mbps): LZ4 acceleration is retuned after every
+// block from a running average of per-block speed, stepping up while the
+// team is below target and back down once it is AUTOTUNE_SLACK_PCT above
+#define AUTOTUNE_MAX_ACCELERATION 128
+#define AUTOTUNE_SMOOTHING 0.25  // Weight of the newest block in the average
+#define AUTOTUNE_SLACK_PCT 20
+#define BYTES_PER_MB (1024.0 * 1024.0)
+
+// Standard LZ4 frames (lz4 CLI, lz4frame), see compress_lz4_frame(). The
+// block size is coded in the descriptor as an id: 4 = 64 KB ... 7 = 4 MB
+#define LZ4FRAME_MAGIC 0x184D2204u
+#define LZ4FRAME_SKIPPABLE_MAGIC 0x184D2A50u  // Low 4 bits are free
+#define LZ4FRAME_HEADER_MAX 15                // magic, FLG, BD, content size, HC
+#define LZ4FRAME_FLG_VERSION 0x40u
+#define LZ4FRAME_FLG_INDEPENDENT 0x20u
+#define LZ4FRAME_FLG_BLOCK_CHECKSUM 0x10u
+#define LZ4FRAME_FLG_CONTENT_SIZE 0x08u
+#define LZ4FRAME_FLG_CONTENT_CHECKSUM 0x04u
+#define LZ4FRAME_FLG_DICT_ID 0x01u
+#define LZ4FRAME_UNCOMPRESSED 0x80000000u     // Block size bit: stored as is
+// An LZ4 block never expands its input by more than this
+#define LZ4_MAX_EXPANSION 255
+
+/* We need a struct to hold block results */
+typedef struct {
+    size_t offset_in;
+    size_t orig_size;
+    int comp_size;
+    size_t slot_offset; // Where the block was compressed (its bound-sized slot)
+    size_t out_offset;  // Final, compacted position in the output
+    uint64_t checksum;  // XXH3-64 of the block's content, in checksum mode
+    int header_size;    // The block starts header_size bytes before its payload
+} BlockResult;
+
+/* A shared dictionary. `stream` has it loaded once, so every block attaches
+   to it in O(1) instead of reloading it. HC tables depend on the level and
+   are loaded the first time a level is used with this dictionary. */
+typedef struct {
+    unsigned char* data;  // Owned, at most DICT_MAX_SIZE bytes
+    size_t size;
+    uint32_t id;          // XXH32 of the content, recorded in seekable footers
+    LZ4_stream_t* stream;
+    LZ4_streamHC_t* hc_streams[LZ4HC_CLEVEL_MAX + 1];
+} WarpDict;
+
+/* Acceleration autotuner, shared by every thread of a call (or by every
+   batch of a Compressor). Updated under omp critical(wh_tune). */
+typedef struct {
+    double target;     // Bytes/s the whole team should reach
+    double rate;       // Average bytes/s of one thread at `acceleration`; 0 = no sample yet
+    int acceleration;  // Used by the next block
+} AccelTuner;
+
+/* What one call did, for stats=True and the module-wide totals. Phases are
+   wall time; the per-block fields are only filled in with stats=True, from
+   the block tables after the parallel part, so the workers never touch it. */
+typedef struct {
+    double start;            // omp_get_wtime() when the call began
+    double index_seconds;    // Serial pass: header walk, footer or frame scan
+    double work_seconds;     // Parallel compress / decompress
+    double gather_seconds;   // Compaction, copy-out or file writes
+    int threads;
+    size_t blocks;
+    size_t raw_blocks;
+    size_t bytes_in;
+    size_t bytes_out;
+    size_t bytes_allocated;  // Output buffers and block tables
+    int requested;           // stats=True
+    double min_ratio, max_ratio, ratio_sum;  // Compressed / original, per block
+} CallStats;
+
+/* Per-call compression settings */
+typedef struct {
+    size_t block_size;
+    int level;     // 0 = LZ4 fast, 1..LZ4HC_CLEVEL_MAX = LZ4HC at that level
+    int adaptive;  // Start every block fast; escalate to `level` when a trial says it pays
+    double entropy_threshold;  // Pre-check cut-off in bits/byte; 0 disables it
+    int seekable;  // Append the block index footer
+    int threads;   // Team size, from acquire_threads()
+    const WarpDict* dict;  // Shared dictionary, or NULL
+    int linked;    // Prime blocks with the previous window (implies seekable)
+    int checksum;  // Record an XXH3-64 per block (implies seekable)
+    int acceleration;     // LZ4 fast acceleration, 1 = LZ4_compress_default
+    AccelTuner* tuner;    // Retunes `acceleration` towards a throughput target, or NULL
+    int format;           // 1 = fixed 8-byte headers, 2 = compact headers with flags
+    CallStats* stats;     // Phase times and block figures for this call, or NULL
+    int dedup;            // Content-defined chunks, repeats stored as references (format 2)
+    int typesize;         // Byte-shuffle blocks as elements of this size first; 1 = off (format 2)
+} CompressOptions;
+
+static const CompressOptions default_compress_options = {
+    .block_size = DEFAULT_BLOCK_SIZE,
+    .level = 0,
+    .adaptive = 0,
+    .entropy_threshold = DEFAULT_ENTROPY_THRESHOLD,
+    .seekable = 0,
+    .threads = 1,
+    .dict = NULL,
+    .linked = 0,
+    .checksum = 0,
+    .acceleration = 1,
+    .tuner = NULL,
+    .format = 1,
+    .stats = NULL,
+    .dedup = 0,
+    .typesize = 1,
+};
+
+/* Module-wide block counters, see counters() */
+static unsigned long long blocks_compressed_total = 0;
+static unsigned long long blocks_raw_total = 0;
+static unsigned long long blocks_skipped_total = 0;
+static unsigned long long blocks_deduplicated_total = 0;
+
+/* Module-wide call totals, see counters() */
+static unsigned long long compress_calls_total = 0;
+static unsigned long long compress_bytes_in_total = 0;
+static unsigned long long compress_bytes_out_total = 0;
+static double compress_seconds_total = 0;
+static unsigned long long decompress_calls_total = 0;
+static unsigned long long decompress_bytes_in_total = 0;
+static unsigned long long decompress_bytes_out_total = 0;
+static double decompress_seconds_total = 0;
+
+static void stats_begin(CallStats* stats, int requested) {
+    memset(stats, 0, sizeof(*stats));
+    stats->start = omp_get_wtime();
+    stats->requested = requested;
+}
+
+static inline void stats_add_block(CallStats* stats, size_t comp_size, size_t orig_size, int raw) {
+    double ratio = orig_size ? (double)comp_size / orig_size : 1.0;
+    if (stats->blocks == 0 || ratio < stats->min_ratio) stats->min_ratio = ratio;
+    if (stats->blocks == 0 || ratio > stats->max_ratio) stats->max_ratio = ratio;
+    stats->ratio_sum += ratio;
+    stats->raw_blocks += raw;
+    stats->blocks++;
+}
+
+/* Per-block figures from a compressor's results (stats=True only). */
+static void stats_add_results(CallStats* stats, const BlockResult* results, size_t num_blocks) {
+    if (!stats->requested) {
+        stats->blocks += num_blocks;
+        return;
+    }
+    for (size_t i = 0; i < num_blocks; ++i) {
+        stats_add_block(stats, (size_t)results[i].comp_size, results[i].orig_size,
+                        (size_t)results[i].comp_size == results[i].orig_size);
+    }
+}
+
+/* Fold a finished call into the module totals; returns its wall time. */
+static double stats_end(const CallStats* stats, int compressing) {
+    double seconds = omp_get_wtime() - stats->start;
+    if (compressing) {
+        #pragma omp atomic
+        compress_calls_total++;
+        #pragma omp atomic
+        compress_bytes_in_total += stats->bytes_in;
+        #pragma omp atomic
+        compress_bytes_out_total += stats->bytes_out;
+        #pragma omp atomic
+        compress_seconds_total += seconds;
+    } else {
+        #pragma omp atomic
+        decompress_calls_total++;
+        #pragma omp atomic
+        decompress_bytes_in_total += stats->bytes_in;
+        #pragma omp atomic
+        decompress_bytes_out_total += stats->bytes_out;
+        #pragma omp atomic
+        decompress_seconds_total += seconds;
+    }
+    return seconds;
+}
+
+/* Add the wall time since `since` to a phase; returns the current time so
+   phases can be chained. */
+static inline double stats_lap(double* phase, double since) {
+    double now = omp_get_wtime();
+    *phase += now - since;
+    return now;
+}
+
+/* Process-wide thread budget. Each call takes a share for the length of its
+   parallel work and hands it back, so concurrent callers (several Python
+   threads releasing the GIL at once) split the cores instead of each
+   starting a full team. See set_max_threads(). */
+static int thread_budget = 0;  // 0 = not set yet: omp_get_max_threads()
+static int threads_in_use = 0;
+
+static int max_threads_now(void) {
+    int budget;
+    #pragma omp critical(wh_threads)
+    {
+        if (thread_budget == 0) thread_budget = omp_get_max_threads();
+        budget = thread_budget;
+    }
+    return budget;
+}
+
+/* NUMA placement, see set_numa_placement(). When it is on, the block loops
+   (schedule(runtime)) hand out blocks statically, so a call always gives
+   the same range of blocks to the same team member, and every worker but
+   the calling thread is pinned to one CPU, spread evenly over the CPUs the
+   process was allowed at the time. Large outputs are fresh, untouched
+   pages, so the worker that writes a block's range is the one that faults
+   it in: on its own node.
+
+   CPUs go by slot in the thread budget, not by place in the team: each
+   call takes a run of free slots with its threads, so concurrent teams pin
+   to different CPUs instead of all starting from the first one. */
+static int numa_placement = 0;  // Written in omp critical(wh_threads)
+
+#define THREAD_SLOTS 1024  // Budget slots tracked for placement; beyond this, slots are shared
+static unsigned char slot_taken[THREAD_SLOTS];  // Guarded by omp critical(wh_threads)
+
+/* The budget slots of the calling thread's current team: member t has slot
+   first + t. The caller sets it in acquire_threads(); the parallel regions
+   that place workers pass it on with copyin(team_slots). */
+typedef struct {
+    int first;   // -1 = no slots taken (placement was off)
+    int budget;  // Budget the slots are out of
+} TeamSlots;
+static TeamSlots team_slots = {-1, 0};
+#pragma omp threadprivate(team_slots)
+
+#ifdef __linux__
+static cpu_set_t placement_allowed;  // Affinity to restore when placement is turned off
+static int placement_cpus[CPU_SETSIZE];
+static int placement_num_cpus = 0;   // 0 = don't pin (OMP_PROC_BIND already does)
+static _Thread_local int pinned_cpu = -1;
+#endif
+
+/* First slot of the lowest run of `count` free budget slots, or of the
+   longest free run when none is that long. Call in omp critical(wh_threads). */
+static int take_slots(int count, int budget) {
+    int slots = budget < THREAD_SLOTS ? budget : THREAD_SLOTS;
+    int best = 0, best_len = 0, run = 0;
+    for (int s = 0; s < slots && best_len < count; ++s) {
+        run = slot_taken[s] ? 0 : run + 1;
+        if (run > best_len) {
+            best_len = run;
+            best = s - run + 1;
+        }
+    }
+    for (int s = best; s < best + count && s < slots; ++s) slot_taken[s]++;
+    return best;
+}
+
+/* Set the calling thread's block schedule for the parallel loops it is
+   about to start. */
+static void use_block_schedule(void) {
+    int placement;
+    #pragma omp atomic read
+    placement = numa_placement;
+    if (placement) omp_set_schedule(omp_sched_static, 0);
+    else omp_set_schedule(omp_sched_dynamic, 1);
+}
+
+/* Pin the current worker to its CPU, or undo that once placement is off.
+   Called from the block loops; costs a flag read when nothing changes. */
+static inline void place_worker(void) {
+#ifdef __linux__
+    int placement;
+    #pragma omp atomic read
+    placement = numa_placement;
+    int thread = omp_get_thread_num();
+    if (thread == 0) return;  // The caller's own thread is left alone
+
+    int cpu = -1;
+    if (placement && placement_num_cpus && team_slots.first >= 0) {
+        size_t slot = (size_t)(team_slots.first + thread) % team_slots.budget;
+        cpu = placement_cpus[slot * placement_num_cpus / team_slots.budget];
+    }
+    if (cpu == pinned_cpu) return;
+
+    cpu_set_t set;
+    if (cpu >= 0) {
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+    } else {
+        set = placement_allowed;
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) == 0) pinned_cpu = cpu;
+#endif
+}
+
+/* Take up to `requested` threads (0 = as many as are free) for a call with
+   `work_items` independent blocks. Always grants at least one, so a caller
+   never waits; give the result back with release_threads() on the same
+   thread. With placement on, the team's budget slots go in team_slots.
+   Safe without the GIL. */
+static int acquire_threads(int requested, size_t work_items) {
+    int granted;
+    TeamSlots slots = {-1, 0};
+    #pragma omp critical(wh_threads)
+    {
+        if (thread_budget == 0) thread_budget = omp_get_max_threads();
+        int free_threads = thread_budget - threads_in_use;
+        granted = requested > 0 && requested < thread_budget ? requested : thread_budget;
+        if (granted > free_threads) granted = free_threads;
+        if (work_items < PARALLEL_MIN_BLOCKS) granted = 1;  // Serial fast path
+        else if ((size_t)granted > work_items) granted = (int)work_items;
+        if (granted < 1) granted = 1;
+        threads_in_use += granted;
+        if (numa_placement && granted > 1) {
+            slots.first = take_slots(granted, thread_budget);
+            slots.budget = thread_budget;
+        }
+    }
+    team_slots = slots;
+    use_block_schedule();
+    return granted;
+}
+
+static void release_threads(int granted) {
+    #pragma omp critical(wh_threads)
+    {
+        threads_in_use -= granted;
+        int first = team_slots.first;
+        int slots = team_slots.budget < THREAD_SLOTS ? team_slots.budget : THREAD_SLOTS;
+        for (int s = first; first >= 0 && s < first + granted && s < slots; ++s) slot_taken[s]--;
+    }
+    team_slots.first = -1;
+}
+
+/* Block size for `in_size` bytes compressed by a team of up to `requested`
+   threads (0 = the whole budget) with `opts`. The smallest it ever picks is
+   auto_block_size(0, ...), which is what bounds are sized for. */
+static size_t auto_block_size(size_t in_size, int requested, const CompressOptions* opts) {
+    int threads = max_threads_now();
+    if (requested > 0 && requested < threads) threads = requested;
+    size_t blocks = (size_t)threads * AUTO_BLOCKS_PER_THREAD;
+    if (opts->linked) blocks *= LINKED_GROUP_BLOCKS;  // Groups are what run in parallel
+
+    size_t size = (in_size / blocks + AUTO_BLOCK_ALIGN - 1) / AUTO_BLOCK_ALIGN * AUTO_BLOCK_ALIGN;
+    if (size < AUTO_MIN_BLOCK_SIZE) size = AUTO_MIN_BLOCK_SIZE;
+    if (size > AUTO_MAX_BLOCK_SIZE) size = AUTO_MAX_BLOCK_SIZE;
+    // Whole elements per block, so every block shuffles the same way
+    if (opts->typesize > 1) size += (opts->typesize - size % opts->typesize) % opts->typesize;
+    return size;
+}
+
+#ifdef WH_BINDINGS
+/* Ask for transparent huge pages over the whole huge pages inside
+   [data, data + size). Worth it on large outputs that are about to be
+   faulted in: 512x fewer faults and TLB entries. No-op where unsupported. */
+static void advise_huge_pages(void* data, size_t size) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    uintptr_t start = ((uintptr_t)data + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+    uintptr_t end = ((uintptr_t)data + size) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+    if (end > start) madvise((void*)start, end - start, MADV_HUGEPAGE);
+#else
+    (void)data;
+    (void)size;
+#endif
+}
+#endif
+
+/* LZ4 states a worker compresses with. They are initialized once and only
+   ever fast-reset afterwards, and go back to a module-wide pool at the end
+   of every call, so a new call (on any thread) picks up warm states instead
+   of clearing a 16 KB / 256 KB table per block. Each part is allocated on
+   first use. */
+typedef struct WorkerState {
+    LZ4_stream_t* stream;
+    LZ4_streamHC_t* hc;
+    unsigned char* trial;
+    unsigned char* shuffled;   // typesize > 1: the block after shuffle_bytes()
+    size_t shuffled_size;
+    struct WorkerState* next;  // In the idle pool
+} WorkerState;
+
+/* What one worker thread keeps across the blocks it compresses */
+typedef struct {
+    LZ4_streamHC_t* hc_state;  // LZ4HC state, from `state`
+    unsigned char* trial;      // Output of the adaptive trial compress
+    const WarpDict* dict;
+    LZ4_stream_t* stream;      // Fast-mode state; the dictionary attaches to it
+    unsigned char* shuffled;   // From `state`, shuffled_size bytes
+    size_t shuffled_size;
+    WorkerState* state;        // Returned to the pool by scratch_free()
+} CompressScratch;
+
+
+/* Record the first error seen by any thread; later ones are dropped. */
+static inline void set_error(int* err, int code) {
+    #pragma omp critical(wh_error)
+    {
+        if (*err == WH_OK) *err = code;
+    }
+}
+
+
+/* Bytes a compressed block takes, header included. */
+static inline size_t block_span(const BlockResult* result) {
+    return (size_t)result->header_size + (size_t)result->comp_size;
+}
+
+/* Move every block (header + payload) from its bound-sized slot down to its
+   final prefix-summed offset, in place and in parallel.
+
+   Slots and final positions are both in block order and a block only ever
+   moves left, so a block's destination can overlap the source of earlier
+   blocks but never of later ones. That lets us move a run of consecutive
+   blocks at once, as long as all their sources are read before any of their
+   destinations are written: each round copies the run out to a bounded
+   staging buffer, hits a barrier, and copies it back in. */
+static int compact_blocks(unsigned char* base, const BlockResult* results, size_t num_blocks, int threads) {
+    size_t first = 0;
+    while (first < num_blocks && results[first].slot_offset == results[first].out_offset) first++;
+    if (first == num_blocks) return WH_OK; // Nothing shrank, nothing to move
+
+    const BlockResult* last = &results[num_blocks - 1];
+    size_t to_move = last->out_offset + block_span(last) - results[first].out_offset;
+    size_t staging_size = COMPACT_STAGING_SIZE;
+    for (size_t i = first; i < num_blocks; ++i) {
+        // A round always holds at least one whole block
+        if (block_span(&results[i]) > staging_size) staging_size = block_span(&results[i]);
+    }
+    if (staging_size > to_move) staging_size = to_move;
+
+    unsigned char* staging = malloc(staging_size);
+    if (!staging) return WH_ERR_NOMEM;
+
+    #pragma omp parallel if(threads > 1) num_threads(threads)
+    {
+        size_t start = first;
+        while (start < num_blocks) {
+            // Every thread computes the same round, so the worksharing
+            // constructs below line up across the team.
+            size_t round_base = results[start].out_offset;
+            size_t end = start + 1;
+            while (end < num_blocks &&
+                   results[end].out_offset + block_span(&results[end]) - round_base <= staging_size) {
+                end++;
+            }
+
+            #pragma omp for schedule(runtime)
+            for (size_t i = start; i < end; ++i) {
+                memcpy(staging + (results[i].out_offset - round_base), base + results[i].slot_offset,
+                       block_span(&results[i]));
+            }
+            // (implicit barrier: all sources of this round are staged)
+            #pragma omp for schedule(runtime)
+            for (size_t i = start; i < end; ++i) {
+                memcpy(base + results[i].out_offset, staging + (results[i].out_offset - round_base),
+                       block_span(&results[i]));
+            }
+            start = end;
+        }
+    }
+
+    free(staging);
+    return WH_OK;
+}
+
+
+/* Flags recorded in the footer of a frame compressed with `opts`. */
+static uint32_t footer_flags(const CompressOptions* opts) {
+    uint32_t flags = 0;
+    if (opts->dict) flags |= FOOTER_FLAG_DICT;
+    if (opts->linked) flags |= FOOTER_FLAG_LINKED;
+    if (opts->checksum) flags |= FOOTER_FLAG_CHECKSUM;
+    return flags;
+}
+
+/* Bytes of optional sections for `flags`. */
+static size_t footer_sections_size(uint32_t flags, size_t num_blocks) {
+    size_t size = 0;
+    if (flags & FOOTER_FLAG_DICT) size += FOOTER_DICT_SECTION_SIZE;
+    if (flags & FOOTER_FLAG_LINKED) size += FOOTER_LINKED_SECTION_SIZE;
+    if (flags & FOOTER_FLAG_CHECKSUM) size += num_blocks * FOOTER_CHECKSUM_SIZE;
+    return size;
+}
+
+/* Size of the whole seekable footer. */
+static size_t footer_size(const CompressOptions* opts, size_t num_blocks) {
+    return num_blocks * FOOTER_ENTRY_SIZE + footer_sections_size(footer_flags(opts), num_blocks) + FOOTER_TAIL_SIZE;
+}
+
+/* Serialize the block table, sections and tail of the seekable footer at `dst`. */
+static void write_footer(unsigned char* dst, const BlockResult* results, size_t num_blocks,
+                         const CompressOptions* opts) {
+    uint64_t total_size = 0;
+    for (size_t i = 0; i < num_blocks; ++i) {
+        uint64_t in_offset = results[i].out_offset + (opts->format == 2 ? 0 : (size_t)results[i].header_size);
+        uint32_t comp_size = (uint32_t)results[i].comp_size;
+        uint32_t orig_size = (uint32_t)results[i].orig_size;
+        unsigned char* entry = dst + i * FOOTER_ENTRY_SIZE;
+
+        memcpy(entry, &in_offset, 8);
+        memcpy(entry + 8, &total_size, 8);
+        memcpy(entry + 16, &comp_size, 4);
+        memcpy(entry + 20, &orig_size, 4);
+        total_size += orig_size;
+    }
+
+    uint32_t flags = footer_flags(opts);
+    unsigned char* section = dst + num_blocks * FOOTER_ENTRY_SIZE;
+    if (flags & FOOTER_FLAG_DICT) {
+        uint32_t reserved = 0;
+        memcpy(section, &opts->dict->id, 4);
+        memcpy(section + 4, &reserved, 4);
+        section += FOOTER_DICT_SECTION_SIZE;
+    }
+    if (flags & FOOTER_FLAG_LINKED) {
+        uint32_t group_blocks = LINKED_GROUP_BLOCKS, reserved = 0;
+        memcpy(section, &group_blocks, 4);
+        memcpy(section + 4, &reserved, 4);
+        section += FOOTER_LINKED_SECTION_SIZE;
+    }
+    if (flags & FOOTER_FLAG_CHECKSUM) {
+        for (size_t i = 0; i < num_blocks; ++i) memcpy(section + i * FOOTER_CHECKSUM_SIZE, &results[i].checksum, 8);
+        section += num_blocks * FOOTER_CHECKSUM_SIZE;
+    }
+
+    unsigned char* tail = section;
+    uint64_t num_blocks_64 = num_blocks;
+    uint32_t block_size_32 = (uint32_t)opts->block_size;
+    uint32_t version = FOOTER_VERSION;
+    uint32_t magic = FOOTER_MAGIC;
+
+    memcpy(tail, &num_blocks_64, 8);
+    memcpy(tail + 8, &total_size, 8);
+    memcpy(tail + 16, &block_size_32, 4);
+    memcpy(tail + 20, &flags, 4);
+    memcpy(tail + 24, &version, 4);
+    memcpy(tail + 28, &magic, 4);
+}
+
+
+/* Room reserved in front of each block's payload for its header. v2
+   headers are written right-aligned against the payload. */
+static inline size_t slot_header_size(int format) {
+    return format == 2 ? V2_HEADER_MAX : HEADER_SIZE;
+}
+
+/* Bytes in front of the first block: the v2 magic. */
+static inline size_t frame_prefix_size(int format) {
+    return format == 2 ? FRAME_V2_MAGIC_SIZE : 0;
+}
+
+static inline size_t put_varint(unsigned char* dst, uint32_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        dst[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    dst[n++] = (unsigned char)value;
+    return n;
+}
+
+static inline size_t varint_size(uint32_t value) {
+    size_t n = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        n++;
+    }
+    return n;
+}
+
+/* Write the header for a block whose payload starts at `payload`, ending
+   right before it. `typesize` is only stored for BLOCK_FLAG_SHUFFLE.
+   Returns the header size. */
+static int write_block_header(int format, unsigned char* payload, uint32_t orig_size, uint32_t comp_size,
+                              uint32_t flags, size_t typesize) {
+    if (format != 2) {
+        memcpy(payload - HEADER_SIZE, &orig_size, 4);
+        memcpy(payload - 4, &comp_size, 4);
+        return HEADER_SIZE;
+    }
+    size_t shuffle = flags & BLOCK_FLAG_SHUFFLE ? 1 : 0;
+    size_t size = 1 + shuffle + varint_size(orig_size) + (flags & BLOCK_FLAG_RAW ? 0 : varint_size(comp_size));
+    unsigned char* dst = payload - size;
+    dst[0] = (unsigned char)flags;
+    if (shuffle) dst[1] = (unsigned char)typesize;
+    size_t n = 1 + shuffle;
+    n += put_varint(dst + n, orig_size);
+    if (!(flags & BLOCK_FLAG_RAW)) put_varint(dst + n, comp_size);
+    return (int)size;
+}
+
+/* Worst-case size of `in_size` bytes framed as `block_size` blocks
+   (headers included, frame prefix and footer not). */
+static size_t blocks_bound(size_t in_size, size_t block_size, int format) {
+    size_t num_blocks = (in_size + block_size - 1) / block_size;
+    if (num_blocks == 0) return 0;
+
+    size_t header = slot_header_size(format);
+    size_t slot_size = header + LZ4_compressBound((int)block_size);
+    size_t last_size = in_size - (num_blocks - 1) * block_size;
+    return (num_blocks - 1) * slot_size + header + LZ4_compressBound((int)last_size);
+}
+
+/* Byte shuffle (typesize=): byte j of every `typesize`-byte element goes to
+   stream j, so the high bytes of numeric data, which barely change, line up
+   into runs LZ4 can match. Bytes after the last whole element stay as they
+   are. The vector kernels take 16 elements at a time for typesizes 2, 4, 8
+   and 16: log2(typesize) rounds of splitting bytes into even and odd halves
+   leave each stream in its own register, in bit-reversed order. */
+#if defined(SHUFFLE_SSE2) || defined(SHUFFLE_NEON)
+#define SHUFFLE_LANES 16
+#ifdef SHUFFLE_SSE2
+typedef __m128i shuffle_vec;
+#define shuffle_load(p) _mm_loadu_si128((const __m128i*)(p))
+#define shuffle_store(p, v) _mm_storeu_si128((__m128i*)(p), (v))
+
+/* Even bytes of x then y, and odd bytes of x then y. */
+static inline void shuffle_split(shuffle_vec x, shuffle_vec y, shuffle_vec* even, shuffle_vec* odd) {
+    const __m128i low = _mm_set1_epi16(0x00FF);
+    *even = _mm_packus_epi16(_mm_and_si128(x, low), _mm_and_si128(y, low));
+    *odd = _mm_packus_epi16(_mm_srli_epi16(x, 8), _mm_srli_epi16(y, 8));
+}
+
+/* Undo shuffle_split(). */
+static inline void shuffle_merge(shuffle_vec even, shuffle_vec odd, shuffle_vec* x, shuffle_vec* y) {
+    *x = _mm_unpacklo_epi8(even, odd);
+    *y = _mm_unpackhi_epi8(even, odd);
+}
+#else
+typedef uint8x16_t shuffle_vec;
+#define shuffle_load(p) vld1q_u8(p)
+#define shuffle_store(p, v) vst1q_u8((p), (v))
+
+static inline void shuffle_split(shuffle_vec x, shuffle_vec y, shuffle_vec* even, shuffle_vec* odd) {
+    uint8x16x2_t r = vuzpq_u8(x, y);
+    *even = r.val[0];
+    *odd = r.val[1];
+}
+
+static inline void shuffle_merge(shuffle_vec even, shuffle_vec odd, shuffle_vec* x, shuffle_vec* y) {
+    uint8x16x2_t r = vzipq_u8(even, odd);
+    *x = r.val[0];
+    *y = r.val[1];
+}
+#endif
+
+/* Which stream register `s` holds after the split rounds. */
+static inline size_t shuffle_stream(size_t s, size_t typesize) {
+    size_t j = 0;
+    for (size_t bit = 1; bit < typesize; bit <<= 1) {
+        j = (j << 1) | (s & 1);
+        s >>= 1;
+    }
+    return j;
+}
+
+/* Shuffle the first `count` (a multiple of SHUFFLE_LANES) of `n` elements.
+   Inlined per typesize so the rounds unroll. */
+static inline void shuffle_vectors(const unsigned char* src, unsigned char* dst, size_t n, size_t count,
+                                   size_t typesize) {
+    shuffle_vec v[16], t[16];
+    size_t streams[16];
+    for (size_t s = 0; s < typesize; ++s) streams[s] = shuffle_stream(s, typesize) * n;
+    for (size_t i = 0; i < count; i += SHUFFLE_LANES) {
+        for (size_t s = 0; s < typesize; ++s) v[s] = shuffle_load(src + i * typesize + s * 16);
+        for (size_t width = typesize; width > 1; width /= 2) {
+            for (size_t g = 0; g < typesize; g += width) {
+                for (size_t p = 0; p < width / 2; ++p) {
+                    shuffle_split(v[g + 2 * p], v[g + 2 * p + 1], &t[g + p], &t[g + width / 2 + p]);
+                }
+            }
+            memcpy(v, t, typesize * sizeof(shuffle_vec));
+        }
+        for (size_t s = 0; s < typesize; ++s) shuffle_store(dst + streams[s] + i, v[s]);
+    }
+}
+
+static inline void unshuffle_vectors(const unsigned char* src, unsigned char* dst, size_t n, size_t count,
+                                     size_t typesize) {
+    shuffle_vec v[16], t[16];
+    size_t streams[16];
+    for (size_t s = 0; s < typesize; ++s) streams[s] = shuffle_stream(s, typesize) * n;
+    for (size_t i = 0; i < count; i += SHUFFLE_LANES) {
+        for (size_t s = 0; s < typesize; ++s) v[s] = shuffle_load(src + streams[s] + i);
+        for (size_t width = 2; width <= typesize; width *= 2) {
+            for (size_t g = 0; g < typesize; g += width) {
+                for (size_t p = 0; p < width / 2; ++p) {
+                    shuffle_merge(v[g + p], v[g + width / 2 + p], &t[g + 2 * p], &t[g + 2 * p + 1]);
+                }
+            }
+            memcpy(v, t, typesize * sizeof(shuffle_vec));
+        }
+        for (size_t s = 0; s < typesize; ++s) shuffle_store(dst + i * typesize + s * 16, v[s]);
+    }
+}
+#endif
+
+/* How many leading elements the vector kernels take. */
+static inline size_t shuffle_vector_count(size_t n, size_t typesize) {
+#ifdef SHUFFLE_LANES
+    if (typesize == 2 || typesize == 4 || typesize == 8 || typesize == 16) return n - n % SHUFFLE_LANES;
+#endif
+    (void)typesize;
+    return 0;
+}
+
+static void shuffle_bytes(const unsigned char* src, unsigned char* dst, size_t size, size_t typesize) {
+    size_t n = size / typesize;
+    size_t done = shuffle_vector_count(n, typesize);
+#ifdef SHUFFLE_LANES
+    switch (done ? typesize : 0) {
+        case 2: shuffle_vectors(src, dst, n, done, 2); break;
+        case 4: shuffle_vectors(src, dst, n, done, 4); break;
+        case 8: shuffle_vectors(src, dst, n, done, 8); break;
+        case 16: shuffle_vectors(src, dst, n, done, 16); break;
+    }
+#endif
+    for (size_t j = 0; j < typesize; ++j) {
+        for (size_t i = done; i < n; ++i) dst[j * n + i] = src[i * typesize + j];
+    }
+    memcpy(dst + n * typesize, src + n * typesize, size - n * typesize);
+}
+
+static void unshuffle_bytes(const unsigned char* src, unsigned char* dst, size_t size, size_t typesize) {
+    size_t n = size / typesize;
+    size_t done = shuffle_vector_count(n, typesize);
+#ifdef SHUFFLE_LANES
+    switch (done ? typesize : 0) {
+        case 2: unshuffle_vectors(src, dst, n, done, 2); break;
+        case 4: unshuffle_vectors(src, dst, n, done, 4); break;
+        case 8: unshuffle_vectors(src, dst, n, done, 8); break;
+        case 16: unshuffle_vectors(src, dst, n, done, 16); break;
+    }
+#endif
+    for (size_t i = done; i < n; ++i) {
+        for (size_t j = 0; j < typesize; ++j) dst[i * typesize + j] = src[j * n + i];
+    }
+    memcpy(dst + n * typesize, src + n * typesize, size - n * typesize);
+}
+
+/* Estimate the byte entropy (bits/byte) of a block from PRECHECK_RUNS short
+   runs spread across it. Small blocks are sampled whole. */
+static double sampled_entropy(const unsigned char* src, size_t size) {
+    uint32_t hist[256] = {0};
+    size_t total = 0;
+
+    if (size <= PRECHECK_RUNS * PRECHECK_RUN_SIZE) {
+        for (size_t i = 0; i < size; ++i) hist[src[i]]++;
+        total = size;
+    } else {
+        size_t stride = (size - PRECHECK_RUN_SIZE) / (PRECHECK_RUNS - 1);
+        for (size_t r = 0; r < PRECHECK_RUNS; ++r) {
+            const unsigned char* run = src + r * stride;
+            for (size_t i = 0; i < PRECHECK_RUN_SIZE; ++i) hist[run[i]]++;
+        }
+        total = PRECHECK_RUNS * PRECHECK_RUN_SIZE;
+    }
+    if (total == 0) return 0.0;
+
+    double sum = 0.0;
+    for (int b = 0; b < 256; ++b) {
+        if (hist[b]) sum += hist[b] * log2((double)hist[b]);
+    }
+    return log2((double)total) - sum / total;
+}
+
+/* Incompressibility pre-check. High sampled entropy alone would also flag
+   long repeats of random data, so confirm with a quick LZ4 pass over the
+   start of the block before giving up on it. */
+static int looks_incompressible(const CompressOptions* opts, const CompressScratch* scratch,
+                                const unsigned char* src, size_t size) {
+    if (opts->entropy_threshold <= 0 || !scratch->trial) return 0;
+    if (sampled_entropy(src, size) < opts->entropy_threshold) return 0;
+
+    int sample = size < PRECHECK_TRIAL_SIZE ? (int)size : PRECHECK_TRIAL_SIZE;
+    int capacity = LZ4_compressBound(sample);
+    int trial = scratch->stream ?
+        LZ4_compress_fast_extState_fastReset(scratch->stream, (const char*)src, (char*)scratch->trial, sample, capacity, 1) :
+        LZ4_compress_default((const char*)src, (char*)scratch->trial, sample, capacity);
+    return trial <= 0 || (long long)trial * 100 > (long long)sample * (100 - PRECHECK_MIN_GAIN_PCT);
+}
+
+/* Compress one block with LZ4 fast at `acceleration`. With `window_size`,
+   the block is primed with that much of the input right before `src`
+   (linked mode); otherwise with the dictionary if there is one. Without a
+   working stream (allocation failed) it is compressed standalone, which any
+   decoder still reads. */
+static int compress_fast(const CompressScratch* scratch, const char* src, char* dst, int src_size, int dst_capacity,
+                         size_t window_size, int acceleration) {
+    if (window_size && scratch->stream) {
+        LZ4_loadDict(scratch->stream, src - window_size, (int)window_size);
+        return LZ4_compress_fast_continue(scratch->stream, src, dst, src_size, dst_capacity, acceleration);
+    }
+    if (scratch->dict && scratch->stream) {
+        LZ4_resetStream_fast(scratch->stream);
+        LZ4_attach_dictionary(scratch->stream, scratch->dict->stream);
+        return LZ4_compress_fast_continue(scratch->stream, src, dst, src_size, dst_capacity, acceleration);
+    }
+    if (scratch->stream) {
+        return LZ4_compress_fast_extState_fastReset(scratch->stream, src, dst, src_size, dst_capacity, acceleration);
+    }
+    return LZ4_compress_fast(src, dst, src_size, dst_capacity, acceleration);
+}
+
+/* Compress one block with LZ4HC, using this thread's state when it has one.
+   Window and dictionary work as in compress_fast(). */
+static int compress_hc(const CompressScratch* scratch, const char* src, char* dst, int src_size, int dst_capacity,
+                       int level, size_t window_size) {
+    if (scratch->hc_state && window_size) {
+        LZ4_streamHC_t* stream = scratch->hc_state;
+        LZ4_resetStreamHC_fast(stream, level);
+        LZ4_loadDictHC(stream, src - window_size, (int)window_size);
+        return LZ4_compress_HC_continue(stream, src, dst, src_size, dst_capacity);
+    }
+    if (scratch->hc_state && scratch->dict && scratch->dict->hc_streams[level]) {
+        LZ4_streamHC_t* stream = scratch->hc_state;
+        LZ4_resetStreamHC_fast(stream, level);
+        LZ4_attach_HC_dictionary(stream, scratch->dict->hc_streams[level]);
+        return LZ4_compress_HC_continue(stream, src, dst, src_size, dst_capacity);
+    }
+    if (scratch->hc_state) {
+        return LZ4_compress_HC_extStateHC_fastReset(scratch->hc_state, src, dst, src_size, dst_capacity, level);
+    }
+    return LZ4_compress_HC(src, dst, src_size, dst_capacity, level);
+}
+
+/* Adaptive policy: trial-compress the start of the block both ways and only
+   pay for HC when it shrinks the sample by at least ADAPTIVE_MIN_GAIN_PCT. */
+static int adaptive_wants_hc(const CompressScratch* scratch, const char* src, int src_size, int level) {
+    if (!scratch->trial) return 0;
+
+    int sample = src_size < ADAPTIVE_SAMPLE_SIZE ? src_size : ADAPTIVE_SAMPLE_SIZE;
+    int capacity = LZ4_compressBound(ADAPTIVE_SAMPLE_SIZE);
+    int fast = compress_fast(scratch, src, (char*)scratch->trial, sample, capacity, 0, 1);
+    if (fast <= 0 || fast >= sample) return 0; // Looks incompressible, HC won't save it
+
+    int hc = compress_hc(scratch, src, (char*)scratch->trial, sample, capacity, level, 0);
+    return hc > 0 && (long long)hc * 100 <= (long long)fast * (100 - ADAPTIVE_MIN_GAIN_PCT);
+}
+
+/* The acceleration the next block uses. */
+static inline int block_acceleration(const CompressOptions* opts) {
+    if (!opts->tuner) return opts->acceleration;
+    int acceleration;
+    #pragma omp atomic read
+    acceleration = opts->tuner->acceleration;
+    return acceleration;
+}
+
+/* Fold one block's timing into the tuner and step the acceleration if the
+   team (`threads` blocks at a time) is off target. The average restarts
+   after every step so it only ever describes one setting. */
+static void tuner_update(AccelTuner* tuner, size_t bytes, double seconds, int threads) {
+    if (seconds <= 0) return;
+    double rate = bytes / seconds;
+    #pragma omp critical(wh_tune)
+    {
+        tuner->rate = tuner->rate > 0 ? tuner->rate + AUTOTUNE_SMOOTHING * (rate - tuner->rate) : rate;
+        double team_rate = tuner->rate * threads;
+        int acceleration = tuner->acceleration;
+        if (team_rate < tuner->target && acceleration < AUTOTUNE_MAX_ACCELERATION) {
+            acceleration += acceleration / 2 + 1;
+            if (acceleration > AUTOTUNE_MAX_ACCELERATION) acceleration = AUTOTUNE_MAX_ACCELERATION;
+        } else if (team_rate > tuner->target * (100 + AUTOTUNE_SLACK_PCT) / 100 && acceleration > 1) {
+            acceleration -= acceleration / 4 + 1;
+            if (acceleration < 1) acceleration = 1;
+        }
+        if (acceleration != tuner->acceleration) {
+            tuner->rate = 0;
+            #pragma omp atomic write
+            tuner->acceleration = acceleration;
+        }
+    }
+}
+
+/* Compress one block into `dst` (LZ4_compressBound(src_size) bytes), primed
+   with the `window_size` bytes before `src`. Returns the compressed size, or
+   0 on failure; *used_hc says whether it went through LZ4HC. */
+static int compress_block(const CompressOptions* opts, const CompressScratch* scratch,
+                          const char* src, char* dst, int src_size, size_t window_size, int* used_hc) {
+    int capacity = LZ4_compressBound(src_size);
+    int level = opts->level;
+
+    if (opts->adaptive) {
+        if (level == 0) level = LZ4HC_CLEVEL_DEFAULT;
+        if (!adaptive_wants_hc(scratch, src, src_size, level)) level = 0;
+    }
+    *used_hc = level > 0;
+    if (level > 0) return compress_hc(scratch, src, dst, src_size, capacity, level, window_size);
+    return compress_fast(scratch, src, dst, src_size, capacity, window_size, block_acceleration(opts));
+}
+
+static WorkerState* idle_states = NULL;  // Guarded by omp critical(wh_states)
+
+static void* alloc_aligned(size_t size) {
+#ifdef _WIN32
+    return _aligned_malloc(size, CACHE_LINE_SIZE);
+#else
+    void* ptr;
+    return posix_memalign(&ptr, CACHE_LINE_SIZE, size) ? NULL : ptr;
+#endif
+}
+
+/* Take a worker state from the pool (or a new, empty one). */
+static WorkerState* checkout_state(void) {
+    WorkerState* state;
+    #pragma omp critical(wh_states)
+    {
+        state = idle_states;
+        if (state) idle_states = state->next;
+    }
+    if (!state) state = calloc(1, sizeof(WorkerState));
+    return state;
+}
+
+static void return_state(WorkerState* state) {
+    #pragma omp critical(wh_states)
+    {
+        state->next = idle_states;
+        idle_states = state;
+    }
+}
+
+/* Set up / tear down a worker's scratch for the blocks it will compress.
+   If the allocations fail, LZ4 falls back to its own per-call state, the
+   adaptive policy and the pre-check are skipped, and blocks go unshuffled. */
+static void scratch_init(CompressScratch* scratch, const CompressOptions* opts) {
+    WorkerState* state = checkout_state();
+    scratch->hc_state = NULL;
+    scratch->trial = NULL;
+    scratch->dict = opts->dict;
+    scratch->stream = NULL;
+    scratch->shuffled = NULL;
+    scratch->shuffled_size = 0;
+    scratch->state = state;
+    if (!state) return;
+
+    if (!state->stream) {
+        state->stream = alloc_aligned(sizeof(LZ4_stream_t));
+        if (state->stream) LZ4_initStream(state->stream, sizeof(LZ4_stream_t));
+    }
+    scratch->stream = state->stream;
+    if (opts->level > 0 || opts->adaptive) {
+        if (!state->hc) {
+            state->hc = alloc_aligned(sizeof(LZ4_streamHC_t));
+            if (state->hc) LZ4_initStreamHC(state->hc, sizeof(LZ4_streamHC_t));
+        }
+        scratch->hc_state = state->hc;
+    }
+    if (opts->adaptive || opts->entropy_threshold > 0) {
+        if (!state->trial) {
+            state->trial = malloc(LZ4_compressBound(ADAPTIVE_SAMPLE_SIZE > PRECHECK_TRIAL_SIZE ?
+                                                    ADAPTIVE_SAMPLE_SIZE : PRECHECK_TRIAL_SIZE));
+        }
+        scratch->trial = state->trial;
+    }
+    if (opts->typesize > 1) {
+        if (state->shuffled_size < opts->block_size) {
+            free(state->shuffled);
+            state->shuffled = malloc(opts->block_size);
+            state->shuffled_size = state->shuffled ? opts->block_size : 0;
+        }
+        scratch->shuffled = state->shuffled;
+        scratch->shuffled_size = state->shuffled_size;
+    }
+}
+
+static void scratch_free(CompressScratch* scratch) {
+    if (scratch->state) return_state(scratch->state);
+    scratch->state = NULL;
+}
+
+/* Compress one block into `slot` (slot_header_size() +
+   LZ4_compressBound(orig_size) bytes), storing it raw if it doesn't shrink.
+   The payload starts slot_header_size() bytes in, with the header ending
+   right before it. The `window_size` bytes of input before `src` prime the
+   block (linked mode). With typesize > 1, an independent block is shuffled
+   first and stays shuffled unless it ends up raw. Returns the payload size,
+   sets *header_size and bumps the raw / pre-check-skipped tallies. */
+static int compress_into_slot(const CompressOptions* opts, const CompressScratch* scratch,
+                              const unsigned char* src, size_t orig_size, size_t window_size, unsigned char* slot,
+                              int* header_size, unsigned long long* raw_blocks, unsigned long long* skipped_blocks) {
+    unsigned char* payload = slot + slot_header_size(opts->format);
+    int comp_size = 0, used_hc = 0;
+    double start = opts->tuner ? omp_get_wtime() : 0;
+    const unsigned char* block = src;
+    int shuffled = opts->typesize > 1 && !window_size && orig_size <= scratch->shuffled_size &&
+                   orig_size >= (size_t)opts->typesize;
+    if (shuffled) {
+        shuffle_bytes(src, scratch->shuffled, orig_size, (size_t)opts->typesize);
+        block = scratch->shuffled;
+    }
+    if (looks_incompressible(opts, scratch, block, orig_size)) {
+        (*skipped_blocks)++;
+    } else {
+        comp_size = compress_block(opts, scratch, (const char*)block, (char*)payload, (int)orig_size, window_size,
+                                   &used_hc);
+    }
+
+    uint32_t flags;
+    if (comp_size <= 0 || (size_t)comp_size >= orig_size) {
+        // Incompressible: store the block raw
+        comp_size = (int)orig_size;
+        memcpy(payload, src, orig_size);
+        flags = BLOCK_FLAG_RAW;
+        (*raw_blocks)++;
+    } else {
+        flags = (used_hc ? BLOCK_FLAG_HC : 0) | (window_size ? BLOCK_FLAG_LINKED : 0) |
+                (scratch->dict && !window_size ? BLOCK_FLAG_DICT : 0) | (shuffled ? BLOCK_FLAG_SHUFFLE : 0);
+    }
+
+    *header_size = write_block_header(opts->format, payload, (uint32_t)orig_size, (uint32_t)comp_size, flags,
+                                      (size_t)opts->typesize);
+    if (opts->tuner) tuner_update(opts->tuner, orig_size, omp_get_wtime() - start, opts->threads);
+    return comp_size;
+}
+
+/* Fold one call's tallies into the module-wide counters. */
+static void count_blocks(size_t num_blocks, unsigned long long raw_blocks, unsigned long long skipped_blocks) {
+    #pragma omp atomic
+    blocks_compressed_total += num_blocks - raw_blocks;
+    #pragma omp atomic
+    blocks_raw_total += raw_blocks;
+    #pragma omp atomic
+    blocks_skipped_total += skipped_blocks;
+}
+
+/* How much input before block `i` (at `offset_in`) primes it: none for the
+   first block of a linked group or outside linked mode. */
+static inline size_t linked_window(const CompressOptions* opts, size_t i, size_t offset_in) {
+    if (!opts->linked || i % LINKED_GROUP_BLOCKS == 0) return 0;
+    size_t since_group = offset_in - (i - i % LINKED_GROUP_BLOCKS) * opts->block_size;
+    return since_group < LINKED_WINDOW_SIZE ? since_group : LINKED_WINDOW_SIZE;
+}
+
+/* Compress `in_data` as a run of blocks, each (header included) into its own
+   worst-case slot of `out_data`, which must hold blocks_bound() bytes.
+   `results` needs one entry per block and gets each block's slot and final
+   (prefix-summed) offset. Sets *out_size to the framed size. With
+   `content_hash`, one thread also takes an XXH32 of the whole input before
+   joining the others. Call without the GIL. */
+static void compress_to_slots(const unsigned char* in_data, size_t in_size, const CompressOptions* opts,
+                              unsigned char* out_data, BlockResult* results, size_t* out_size,
+                              uint32_t* content_hash) {
+    size_t block_size = opts->block_size;
+    size_t num_blocks = (in_size + block_size - 1) / block_size;
+
+    // Every block gets a worst-case slot in the output buffer, so workers
+    // compress straight into place with no per-block heap traffic. Pages of a
+    // slot that are never written are never faulted in.
+    size_t slot_header = slot_header_size(opts->format);
+    size_t slot_size = slot_header + LZ4_compressBound((int)block_size);
+    unsigned long long raw_blocks = 0, skipped_blocks = 0;
+
+    #pragma omp parallel if(opts->threads > 1) num_threads(opts->threads) reduction(+:raw_blocks, skipped_blocks) copyin(team_slots)
+    {
+        CompressScratch scratch;
+        scratch_init(&scratch, opts);
+
+        // Blocks are handed out dynamically, so the rest of the team covers
+        // for this thread while it hashes
+        #pragma omp single nowait
+        {
+            if (content_hash) *content_hash = XXH32(in_data, in_size, 0);
+        }
+
+        #pragma omp for schedule(runtime)
+        for (size_t i = 0; i < num_blocks; ++i) {
+            place_worker();
+            size_t offset_in = i * block_size;
+            size_t orig_size = (offset_in + block_size <= in_size) ? block_size : (in_size - offset_in);
+
+            results[i].offset_in = offset_in;
+            results[i].orig_size = orig_size;
+            results[i].comp_size = compress_into_slot(opts, &scratch, in_data + offset_in, orig_size,
+                                                      linked_window(opts, i, offset_in), out_data + i * slot_size,
+                                                      &results[i].header_size, &raw_blocks, &skipped_blocks);
+            results[i].slot_offset = i * slot_size + slot_header - results[i].header_size;
+            // Still in cache from compressing it
+            if (opts->checksum) results[i].checksum = XXH3_64bits(in_data + offset_in, orig_size);
+        }
+
+        scratch_free(&scratch);
+    }
+    count_blocks(num_blocks, raw_blocks, skipped_blocks);
+
+    // Prefix sum gives every block its final offset
+    size_t total_comp_size = 0;
+    for (size_t i = 0; i < num_blocks; ++i) {
+        results[i].out_offset = total_comp_size;
+        total_comp_size += block_span(&results[i]);
+    }
+
+    *out_size = total_comp_size;
+}
+
+/* Gear table for the content-defined chunker: one random 64-bit value per
+   byte (splitmix64), filled on first use. */
+static uint64_t cdc_gear[256];
+static int cdc_gear_ready = 0;  // Written in omp critical(wh_cdc)
+
+static void cdc_init(void) {
+    #pragma omp critical(wh_cdc)
+    {
+        if (!cdc_gear_ready) {
+            uint64_t x = 0;
+            for (int i = 0; i < 256; ++i) {
+                uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+                cdc_gear[i] = z ^ (z >> 31);
+            }
+            cdc_gear_ready = 1;
+        }
+    }
+}
+
+/* Smallest chunk for `block_size` blocks, and the mask whose top bits must
+   all be clear in the rolling hash to cut: about one cut per min_size
+   bytes past the minimum, so chunks average about block_size / 2. */
+static size_t cdc_min_chunk(size_t block_size, uint64_t* mask) {
+    size_t min_size = block_size / CDC_MIN_DIVISOR;
+    if (min_size < CDC_MIN_CHUNK) min_size = CDC_MIN_CHUNK;
+    if (min_size > block_size) min_size = block_size;
+    int bits = 1;
+    while (bits < 48 && ((size_t)2 << bits) <= min_size) bits++;
+    if (mask) *mask = ~0ULL << (64 - bits);
+    return min_size;
+}
+
+/* Most chunks `in_size` bytes can be cut into: every chunk but the last of
+   a segment is at least the minimum size. */
+static size_t dedup_max_chunks(size_t in_size, size_t block_size) {
+    if (in_size == 0) return 0;
+    size_t segment_size = block_size * CDC_SEGMENT_BLOCKS;
+    return in_size / cdc_min_chunk(block_size, NULL) + (in_size + segment_size - 1) / segment_size;
+}
+
+/* Worst-case size of dedup_to_slots() output: LZ4_compressBound() of every
+   chunk plus room for its header. */
+static size_t dedup_bound(size_t in_size, size_t block_size) {
+    return in_size + in_size / 255 + dedup_max_chunks(in_size, block_size) * CDC_SLOT_OVERHEAD;
+}
+
+/* Length of the chunk starting at `p`: up to where the gear hash of the
+   last 64 bytes hits the mask, between min_size and max_size bytes. */
+static size_t cdc_cut(const unsigned char* p, size_t avail, size_t min_size, size_t max_size, uint64_t mask) {
+    if (avail <= min_size) return avail;
+    size_t end = avail < max_size ? avail : max_size;
+    size_t i = min_size > 64 ? min_size - 64 : 0;
+    uint64_t hash = 0;
+    for (; i < min_size; ++i) hash = (hash << 1) + cdc_gear[p[i]];
+    for (; i < end; ++i) {
+        hash = (hash << 1) + cdc_gear[p[i]];
+        if (!(hash & mask)) return i + 1;
+    }
+    return end;
+}
+
+typedef struct {
+    XXH128_hash_t hash;
+    size_t chunk;  // SIZE_MAX = empty
+} DedupEntry;
+
+/* compress_to_slots() for dedup=True: cut `in_data` into content-defined
+   chunks, compress every chunk not seen before into its slot of `out_data`
+   (dedup_bound() bytes), and store repeats as BLOCK_FLAG_REF blocks naming
+   the first copy. `results` needs dedup_max_chunks() entries; *num_blocks
+   gets the number of chunks. Format 2 only. Call without the GIL. */
+static int dedup_to_slots(const unsigned char* in_data, size_t in_size, const CompressOptions* opts,
+                          unsigned char* out_data, BlockResult* results, size_t* num_blocks, size_t* out_size) {
+    size_t block_size = opts->block_size;
+    uint64_t mask;
+    size_t min_size = cdc_min_chunk(block_size, &mask);
+    size_t segment_size = block_size * CDC_SEGMENT_BLOCKS;
+    size_t num_segments = (in_size + segment_size - 1) / segment_size;
+    size_t segment_cap = segment_size / min_size + 1;
+    size_t max_chunks = dedup_max_chunks(in_size, block_size);
+    size_t table_size = 1;
+    while (table_size < 2 * max_chunks) table_size <<= 1;
+
+    uint32_t* lengths = malloc((num_segments * segment_cap + 1) * sizeof(uint32_t));
+    XXH128_hash_t* hashes = malloc((num_segments * segment_cap + 1) * sizeof(XXH128_hash_t));
+    size_t* segment_chunks = malloc((num_segments + 1) * sizeof(size_t));
+    size_t* sources = malloc((max_chunks + 1) * sizeof(size_t));  // First copy, or SIZE_MAX
+    DedupEntry* table = malloc(table_size * sizeof(DedupEntry));
+    if (!lengths || !hashes || !segment_chunks || !sources || !table) {
+        free(lengths);
+        free(hashes);
+        free(segment_chunks);
+        free(sources);
+        free(table);
+        return WH_ERR_NOMEM;
+    }
+    if (opts->stats) {
+        opts->stats->bytes_allocated += num_segments * segment_cap * (sizeof(uint32_t) + sizeof(XXH128_hash_t)) +
+                                        max_chunks * sizeof(size_t) + table_size * sizeof(DedupEntry);
+    }
+    cdc_init();
+
+    size_t chunks = 0;
+    unsigned long long raw_blocks = 0, skipped_blocks = 0, dup_blocks = 0;
+
+    #pragma omp parallel if(opts->threads > 1) num_threads(opts->threads) \
+        reduction(+:raw_blocks, skipped_blocks, dup_blocks) copyin(team_slots)
+    {
+        // Segments are cut independently, so the chunks don't depend on the
+        // team size
+        #pragma omp for schedule(runtime)
+        for (size_t seg = 0; seg < num_segments; ++seg) {
+            place_worker();
+            size_t pos = seg * segment_size;
+            size_t end = in_size - pos < segment_size ? in_size : pos + segment_size;
+            size_t n = 0;
+            while (pos < end) {
+                size_t len = cdc_cut(in_data + pos, end - pos, min_size, block_size, mask);
+                lengths[seg * segment_cap + n] = (uint32_t)len;
+                hashes[seg * segment_cap + n] = XXH3_128bits(in_data + pos, len);
+                pos += len;
+                n++;
+            }
+            segment_chunks[seg] = n;
+        }
+
+        // First copies go into the table in input order, so every repeat
+        // names the earliest copy
+        #pragma omp single
+        {
+            for (size_t i = 0; i < table_size; ++i) table[i].chunk = SIZE_MAX;
+            size_t k = 0, offset = 0;
+            for (size_t seg = 0; seg < num_segments; ++seg) {
+                for (size_t j = 0; j < segment_chunks[seg]; ++j, ++k) {
+                    size_t len = lengths[seg * segment_cap + j];
+                    XXH128_hash_t hash = hashes[seg * segment_cap + j];
+                    results[k].offset_in = offset;
+                    results[k].orig_size = len;
+                    offset += len;
+
+                    size_t slot = (size_t)hash.low64 & (table_size - 1);
+                    sources[k] = SIZE_MAX;
+                    while (table[slot].chunk != SIZE_MAX) {
+                        if (XXH128_isEqual(table[slot].hash, hash) && results[table[slot].chunk].orig_size == len) {
+                            sources[k] = table[slot].chunk;
+                            break;
+                        }
+                        slot = (slot + 1) & (table_size - 1);
+                    }
+                    if (sources[k] == SIZE_MAX) {
+                        table[slot].hash = hash;
+                        table[slot].chunk = k;
+                    }
+                }
+            }
+            chunks = k;
+        }
+
+        CompressScratch scratch;
+        scratch_init(&scratch, opts);
+
+        // Chunk k's slot leaves room for LZ4_compressBound() (1/255 + 16
+        // bytes over) of every chunk before it, plus all of their headers
+        #pragma omp for schedule(runtime)
+        for (size_t k = 0; k < chunks; ++k) {
+            place_worker();
+            size_t offset_in = results[k].offset_in;
+            size_t orig_size = results[k].orig_size;
+            size_t slot_offset = offset_in + offset_in / 255 + k * CDC_SLOT_OVERHEAD;
+            size_t source = sources[k];
+            if (source != SIZE_MAX && memcmp(in_data + offset_in, in_data + results[source].offset_in, orig_size) == 0) {
+                unsigned char* payload = out_data + slot_offset + V2_HEADER_MAX;
+                results[k].comp_size = (int)put_varint(payload, (uint32_t)source);
+                results[k].header_size = write_block_header(2, payload, (uint32_t)orig_size,
+                                                            (uint32_t)results[k].comp_size, BLOCK_FLAG_REF, 1);
+                dup_blocks++;
+            } else {
+                sources[k] = SIZE_MAX;  // A hash collision keeps its own copy
+                results[k].comp_size = compress_into_slot(opts, &scratch, in_data + offset_in, orig_size, 0,
+                                                          out_data + slot_offset, &results[k].header_size,
+                                                          &raw_blocks, &skipped_blocks);
+                if (opts->checksum) results[k].checksum = XXH3_64bits(in_data + offset_in, orig_size);
+            }
+            results[k].slot_offset = slot_offset + V2_HEADER_MAX - results[k].header_size;
+        }
+
+        scratch_free(&scratch);
+    }
+    count_blocks(chunks - dup_blocks, raw_blocks, skipped_blocks);
+    #pragma omp atomic
+    blocks_deduplicated_total += dup_blocks;
+
+    size_t total_comp_size = 0;
+    for (size_t k = 0; k < chunks; ++k) {
+        if (sources[k] != SIZE_MAX) results[k].checksum = results[sources[k]].checksum;
+        results[k].out_offset = total_comp_size;
+        total_comp_size += block_span(&results[k]);
+    }
+    *num_blocks = chunks;
+    *out_size = total_comp_size;
+
+    free(lengths);
+    free(hashes);
+    free(segment_chunks);
+    free(sources);
+    free(table);
+    return WH_OK;
+}
+
+#ifdef WH_BINDINGS
+/* Compress into `out_data` (blocks_bound() bytes) and compact the result
+   into a contiguous frame of *out_size bytes. Call without the GIL. */
+static int compress_blocks(const unsigned char* in_data, size_t in_size, const CompressOptions* opts,
+                           unsigned char* out_data, BlockResult* results, size_t* out_size) {
+    compress_to_slots(in_data, in_size, opts, out_data, results, out_size, NULL);
+    return compact_blocks(out_data, results, (in_size + opts->block_size - 1) / opts->block_size, opts->threads);
+}
+#endif
+
+
+/* Most blocks a frame of `in_size` bytes can have. */
+static size_t frame_blocks_max(size_t in_size, const CompressOptions* opts) {
+    if (opts->dedup) return dedup_max_chunks(in_size, opts->block_size);
+    return (in_size + opts->block_size - 1) / opts->block_size;
+}
+
+/* Worst-case size of a whole frame, footer included. */
+static size_t frame_bound(size_t in_size, const CompressOptions* opts) {
+    size_t num_blocks = frame_blocks_max(in_size, opts);
+    size_t blocks = opts->dedup ? dedup_bound(in_size, opts->block_size)
+                                : blocks_bound(in_size, opts->block_size, opts->format);
+    return frame_prefix_size(opts->format) + blocks + (opts->seekable ? footer_size(opts, num_blocks) : 0);
+}
+
+/* Write the frame prefix (the v2 magic) at `out_data`. Returns its size. */
+static size_t write_frame_prefix(unsigned char* out_data, int format) {
+    if (format != 2) return 0;
+    uint32_t magic = FRAME_V2_MAGIC;
+    memcpy(out_data, &magic, FRAME_V2_MAGIC_SIZE);
+    return FRAME_V2_MAGIC_SIZE;
+}
+
+/* Compress `in_data` into a complete frame at `out_data`, which must hold
+   frame_bound() bytes. Call without the GIL. */
+static int compress_frame(const unsigned char* in_data, size_t in_size, const CompressOptions* opts,
+                          unsigned char* out_data, size_t* out_size) {
+    size_t num_blocks = frame_blocks_max(in_size, opts);
+    BlockResult* results = calloc(num_blocks ? num_blocks : 1, sizeof(BlockResult));
+    if (!results) return WH_ERR_NOMEM;
+    CallStats unused;
+    CallStats* stats = opts->stats ? opts->stats : &unused;
+    stats->bytes_allocated += num_blocks * sizeof(BlockResult);
+
+    double t = omp_get_wtime();
+    size_t prefix = write_frame_prefix(out_data, opts->format);
+    int err = WH_OK;
+    if (opts->dedup) {
+        err = dedup_to_slots(in_data, in_size, opts, out_data + prefix, results, &num_blocks, out_size);
+    } else {
+        compress_to_slots(in_data, in_size, opts, out_data + prefix, results, out_size, NULL);
+    }
+    t = stats_lap(&stats->work_seconds, t);
+    if (!err) err = compact_blocks(out_data + prefix, results, num_blocks, opts->threads);
+    for (size_t i = 0; i < num_blocks; ++i) results[i].out_offset += prefix;
+    *out_size += prefix;
+    if (!err && opts->seekable) {
+        write_footer(out_data + *out_size, results, num_blocks, opts);
+        *out_size += footer_size(opts, num_blocks);
+    }
+    stats_lap(&stats->gather_seconds, t);
+    if (opts->stats) stats_add_results(stats, results, num_blocks);
+
+    free(results);
+    return err;
+}
+
+// --- Shared dictionaries ---
+
+/* Payloads as borrowed (data, size) pairs, for the batch calls and
+   dictionary training. */
+typedef struct {
+    size_t count;
+    const unsigned char** data;
+    size_t* sizes;
+} PayloadBatch;
+
+static void dict_free(WarpDict* dict) {
+    free(dict->data);
+    free(dict->stream);
+    for (int level = 0; level <= LZ4HC_CLEVEL_MAX; ++level) LZ4_freeStreamHC(dict->hc_streams[level]);
+    memset(dict, 0, sizeof(*dict));
+}
+
+/* Copy the dictionary content (only the last DICT_MAX_SIZE bytes are ever
+   referenced) and load it for the fast compressor. */
+static int dict_init(WarpDict* dict, const unsigned char* content, size_t size) {
+    memset(dict, 0, sizeof(*dict));
+    if (size > DICT_MAX_SIZE) {
+        content += size - DICT_MAX_SIZE;
+        size = DICT_MAX_SIZE;
+    }
+
+    dict->data = malloc(size ? size : 1);
+    dict->stream = malloc(sizeof(LZ4_stream_t));
+    if (!dict->data || !dict->stream) {
+        dict_free(dict);
+        return WH_ERR_NOMEM;
+    }
+    memcpy(dict->data, content, size);
+    dict->size = size;
+    dict->id = XXH32(dict->data, size, 0);
+    LZ4_initStream(dict->stream, sizeof(LZ4_stream_t));
+    LZ4_loadDictSlow(dict->stream, (const char*)dict->data, (int)size);
+    return WH_OK;
+}
+
+/* Make sure the HC table for `level` is loaded. Done before the workers
+   start, so they only ever read hc_streams. */
+static int dict_prepare_level(WarpDict* dict, int level) {
+    int err = WH_OK;
+    #pragma omp critical(wh_dict)
+    {
+        if (!dict->hc_streams[level]) {
+            LZ4_streamHC_t* stream = LZ4_createStreamHC();
+            if (stream) {
+                LZ4_resetStreamHC_fast(stream, level);
+                LZ4_loadDictHC(stream, (const char*)dict->data, (int)dict->size);
+                dict->hc_streams[level] = stream;
+            } else {
+                err = WH_ERR_NOMEM;
+            }
+        }
+    }
+    return err;
+}
+
+static inline uint32_t kmer_hash(const unsigned char* p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return (uint32_t)((v * 0x9E3779B185EBCA87ull) >> (64 - DICT_TRAIN_HASH_LOG));
+}
+
+typedef struct {
+    const unsigned char* start;
+    size_t len;
+    uint64_t score;
+} DictSegment;
+
+static int compare_segments(const void* a, const void* b) {
+    uint64_t sa = ((const DictSegment*)a)->score, sb = ((const DictSegment*)b)->score;
+    return sa < sb ? 1 : sa > sb ? -1 : 0;
+}
+
+/* Sum of (samples sharing the k-mer - 1) over the k-mers of a segment. */
+static uint64_t segment_score(const DictSegment* seg, const uint32_t* counts) {
+    uint64_t score = 0;
+    for (size_t p = 0; p + DICT_TRAIN_KMER <= seg->len; ++p) {
+        uint32_t c = counts[kmer_hash(seg->start + p)];
+        if (c > 1) score += c - 1;
+    }
+    return score;
+}
+
+/* Train a dictionary of up to `dict_size` bytes into `out`: a greedy cover
+   of the DICT_TRAIN_SEGMENT-byte segments whose k-mers recur in the most
+   samples, best segment last (it survives truncation to the LZ4 window).
+   Sets *out_size. Call without the GIL. */
+static int train_dictionary(const PayloadBatch* samples, size_t dict_size, unsigned char* out, size_t* out_size) {
+    size_t table_size = (size_t)1 << DICT_TRAIN_HASH_LOG;
+    uint32_t* counts = calloc(table_size, sizeof(uint32_t));
+    uint32_t* last_seen = calloc(table_size, sizeof(uint32_t));
+    size_t max_segments = 0;
+    for (size_t i = 0; i < samples->count; ++i) {
+        max_segments += samples->sizes[i] / (DICT_TRAIN_SEGMENT / 2) + 1;
+    }
+    DictSegment* segments = malloc(max_segments * sizeof(DictSegment));
+    if (!counts || !last_seen || !segments) {
+        free(counts);
+        free(last_seen);
+        free(segments);
+        return WH_ERR_NOMEM;
+    }
+
+    // How many samples each k-mer shows up in
+    for (size_t i = 0; i < samples->count; ++i) {
+        const unsigned char* data = samples->data[i];
+        for (size_t p = 0; p + DICT_TRAIN_KMER <= samples->sizes[i]; ++p) {
+            uint32_t h = kmer_hash(data + p);
+            if (last_seen[h] != (uint32_t)i + 1) {
+                last_seen[h] = (uint32_t)i + 1;
+                counts[h]++;
+            }
+        }
+    }
+
+    // Half-overlapping candidate segments, best first
+    size_t num_segments = 0;
+    for (size_t i = 0; i < samples->count; ++i) {
+        for (size_t off = 0; off + DICT_TRAIN_KMER <= samples->sizes[i]; off += DICT_TRAIN_SEGMENT / 2) {
+            DictSegment seg = {samples->data[i] + off, samples->sizes[i] - off, 0};
+            if (seg.len > DICT_TRAIN_SEGMENT) seg.len = DICT_TRAIN_SEGMENT;
+            seg.score = segment_score(&seg, counts);
+            if (seg.score) segments[num_segments++] = seg;
+        }
+    }
+    qsort(segments, num_segments, sizeof(DictSegment), compare_segments);
+
+    // Greedy cover: take a segment, then forget its k-mers so overlapping
+    // candidates lose their score. Ones that lost most of it are skipped.
+    size_t filled = 0;
+    for (size_t i = 0; i < num_segments && filled < dict_size; ++i) {
+        uint64_t score = segment_score(&segments[i], counts);
+        if (score == 0 || score * 2 < segments[i].score) continue;
+
+        size_t len = segments[i].len < dict_size - filled ? segments[i].len : dict_size - filled;
+        filled += len;
+        memcpy(out + dict_size - filled, segments[i].start, len);
+        for (size_t p = 0; p + DICT_TRAIN_KMER <= segments[i].len; ++p) counts[kmer_hash(segments[i].start + p)] = 0;
+    }
+
+    // Nothing recurs: fall back to the tail of the samples
+    for (size_t i = samples->count; filled == 0 && i-- > 0;) {
+        size_t len = samples->sizes[i] < dict_size ? samples->sizes[i] : dict_size;
+        memcpy(out + dict_size - len, samples->data[i] + samples->sizes[i] - len, len);
+        filled = len;
+    }
+
+    memmove(out, out + dict_size - filled, filled);
+    *out_size = filled;
+
+    free(counts);
+    free(last_seen);
+    free(segments);
+    return WH_OK;
+}
+
+
+// --- NEW: Block Index struct for parallel decompression ---
+typedef struct {
+    size_t in_offset;   // Start of compressed data
+    size_t out_offset;  // Start of decompressed data
+    uint32_t comp_size;
+    uint32_t orig_size;
+    uint32_t flags;     // BLOCK_FLAG_*; v1 only knows BLOCK_FLAG_RAW
+    uint32_t source;    // BLOCK_FLAG_REF: the earlier block holding the same bytes
+    uint32_t typesize;  // BLOCK_FLAG_SHUFFLE: element size the bytes were shuffled by
+} BlockIndex;
+
+static inline int ctz64(uint64_t x) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward64(&i, x);
+    return (int)i;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+/* Read a varint of at most 5 bytes. Returns its length, 0 if `avail` ends
+   inside it, or -1 if it is too long or overflows 32 bits. With 8 bytes to
+   hand it is one load and a few masks instead of a loop. */
+static inline int get_varint(const unsigned char* p, size_t avail, uint32_t* value) {
+    if (avail >= 8) {
+        uint64_t x;
+        memcpy(&x, p, 8);
+        uint64_t stops = ~x & 0x8080808080ULL;  // Clear high bit = last byte
+        if (!stops) return -1;
+        int len = ctz64(stops) / 8 + 1;
+        if (len == 5 && (x >> 32 & 0x70)) return -1;
+        x &= len == 8 ? ~0ULL : (1ULL << (len * 8)) - 1;
+        *value = (uint32_t)((x & 0x7f) | (x >> 1 & 0x3f80) | (x >> 2 & 0x1fc000) | (x >> 3 & 0xfe00000) |
+                            (x >> 4 & 0x7f0000000ULL));
+        return len;
+    }
+    uint32_t v = 0;
+    for (int i = 0; i < 5; ++i) {
+        if ((size_t)i >= avail) return 0;
+        if (i == 4 && (p[i] & 0xf0)) return -1;
+        v |= (uint32_t)(p[i] & 0x7f) << (7 * i);
+        if (!(p[i] & 0x80)) {
+            *value = v;
+            return i + 1;
+        }
+    }
+    return -1;
+}
+
+/* 2 for a v2 frame (starts with the magic), else 1. */
+static inline int frame_format(const unsigned char* data, size_t size) {
+    if (size < FRAME_V2_MAGIC_SIZE) return 1;
+    uint32_t magic;
+    memcpy(&magic, data, FRAME_V2_MAGIC_SIZE);
+    return magic == FRAME_V2_MAGIC ? 2 : 1;
+}
+
+/* An LZ4 payload is never empty and never more than LZ4_compressBound() of
+   what it decodes to; anything else is a damaged header. */
+static inline int block_sizes_valid(const BlockIndex* block) {
+    if (block->flags & (BLOCK_FLAG_RAW | BLOCK_FLAG_REF)) return 1;
+    return block->comp_size > 0 && block->comp_size <= (uint32_t)LZ4_COMPRESSBOUND(block->orig_size);
+}
+
+/* Parse the block header at `p`, filling every field of `block` but the
+   offsets. Returns the header size, 0 if `avail` ends inside it, or -1 if
+   it is invalid. */
+static int read_block_header(const unsigned char* p, size_t avail, int format, BlockIndex* block) {
+    if (format != 2) {
+        if (avail < HEADER_SIZE) return 0;
+        memcpy(&block->orig_size, p, 4);
+        memcpy(&block->comp_size, p + 4, 4);
+        if (block->orig_size > MAX_BLOCK_SIZE) return -1;
+        block->flags = block->comp_size == block->orig_size ? BLOCK_FLAG_RAW : 0;
+        block->typesize = 1;
+        return block_sizes_valid(block) ? HEADER_SIZE : -1;
+    }
+
+    if (avail < 1) return 0;
+    block->flags = p[0];
+    if (block->flags & ~BLOCK_KNOWN_FLAGS) return -1;
+    if ((block->flags & BLOCK_FLAG_REF) && block->flags != BLOCK_FLAG_REF) return -1;
+    size_t len = 1;
+    block->typesize = 1;
+    if (block->flags & BLOCK_FLAG_SHUFFLE) {
+        if (block->flags & (BLOCK_FLAG_RAW | BLOCK_FLAG_LINKED)) return -1;
+        if (avail < 2) return 0;
+        block->typesize = p[1];
+        if (block->typesize < 2) return -1;
+        len = 2;
+    }
+    int n = get_varint(p + len, avail - len, &block->orig_size);
+    if (n <= 0) return n;
+    len += (size_t)n;
+    if (block->flags & BLOCK_FLAG_RAW) {
+        block->comp_size = block->orig_size;
+    } else {
+        n = get_varint(p + len, avail - len, &block->comp_size);
+        if (n <= 0) return n;
+        len += (size_t)n;
+    }
+    if (block->orig_size > MAX_BLOCK_SIZE || !block_sizes_valid(block)) return -1;
+    return (int)len;
+}
+
+/* Index of the block that duplicate block `i` refers to, read from its
+   payload. It must come earlier in the frame. */
+static int ref_source(const unsigned char* in_data, const BlockIndex* block, size_t i, uint32_t* source) {
+    int n = get_varint(in_data + block->in_offset, block->comp_size, source);
+    if (n <= 0 || (uint32_t)n != block->comp_size || *source >= i) return WH_ERR_HEADER;
+    return WH_OK;
+}
+
+/* Point duplicate `block` at the payload of `original` (block `source`),
+   keeping its own place in the output, so every decoder handles it like the
+   original; decode_table() copies the output instead. The original can't
+   be a duplicate itself, so references never chain. */
+static int point_at_source(BlockIndex* block, uint32_t source, const BlockIndex* original) {
+    if ((original->flags & (BLOCK_FLAG_REF | BLOCK_FLAG_LINKED)) || original->orig_size != block->orig_size) {
+        return WH_ERR_HEADER;
+    }
+    block->in_offset = original->in_offset;
+    block->comp_size = original->comp_size;
+    block->flags = original->flags | BLOCK_FLAG_REF;
+    block->typesize = original->typesize;
+    block->source = source;
+    return WH_OK;
+}
+
+/* Parsed seekable footer. `entries` points into the caller's input buffer. */
+typedef struct {
+    const unsigned char* entries;
+    size_t num_blocks;
+    size_t total_size;
+    size_t blocks_end;   // Where block data stops and the footer begins
+    uint32_t block_size;
+    uint32_t flags;
+    uint32_t dict_id;    // With FOOTER_FLAG_DICT
+    uint32_t group_blocks;  // Linked group size; 1 when blocks are independent
+    const unsigned char* checksums;  // With FOOTER_FLAG_CHECKSUM, else NULL
+    int format;          // Block header format of the frame
+} FrameFooter;
+
+/* Where the block table for one call comes from: either straight out of the
+   seekable footer, or the array built by walking the headers (PASS 1). */
+typedef struct {
+    const unsigned char* in_data;
+    FrameFooter footer;
+    int seekable;
+    BlockIndex* index;  // Owned; NULL for seekable frames
+    size_t num_blocks;
+    size_t total_size;
+    const WarpDict* dict;  // Decodes blocks that reference a dictionary
+    size_t group_blocks;   // Blocks that must be decoded in order; 1 = independent
+    const unsigned char* checksums;  // Per-block XXH3-64s to verify against, or NULL
+    unsigned char* hashes;  // Receives each decoded block's XXH3-64 instead, or NULL
+    int has_refs;          // May hold BLOCK_FLAG_REF blocks (v2 frames)
+} BlockTable;
+
+
+/* Where the header of footer entry `i` starts, checked against the entry
+   after it (or the end of the blocks). Sets *next_in to where the block
+   has to end. */
+static int footer_entry_header(const FrameFooter* footer, size_t i, uint64_t* header_at, uint64_t* next_in) {
+    const unsigned char* entry = footer->entries + i * FOOTER_ENTRY_SIZE;
+    uint64_t in_offset;
+    memcpy(&in_offset, entry, 8);
+
+    // v1 entries point past the header, v2 ones at it; work in header starts
+    uint64_t skip = footer->format == 2 ? 0 : HEADER_SIZE;
+    if (i + 1 < footer->num_blocks) memcpy(next_in, entry + FOOTER_ENTRY_SIZE, 8);
+    else *next_in = footer->blocks_end + skip;
+    if (in_offset < skip || *next_in < skip) return WH_ERR_HEADER;
+    *header_at = in_offset - skip;
+    *next_in -= skip;
+    if (*header_at >= footer->blocks_end) return WH_ERR_HEADER;
+    return WH_OK;
+}
+
+/* Check footer entry `i` against the block header found where it points
+   (`avail` bytes of it at `header`) and against its neighbours, so a
+   damaged footer can never send a worker outside the input or output. */
+static int check_footer_entry(const FrameFooter* footer, size_t i, uint64_t header_at, uint64_t next_in,
+                              const unsigned char* header, size_t avail, BlockIndex* block) {
+    const unsigned char* entry = footer->entries + i * FOOTER_ENTRY_SIZE;
+    uint64_t out_offset, next_out;
+    uint32_t comp_size, orig_size;
+    memcpy(&out_offset, entry + 8, 8);
+    memcpy(&comp_size, entry + 16, 4);
+    memcpy(&orig_size, entry + 20, 4);
+    if (i + 1 < footer->num_blocks) memcpy(&next_out, entry + FOOTER_ENTRY_SIZE + 8, 8);
+    else next_out = footer->total_size;
+
+    int len = read_block_header(header, avail, footer->format, block);
+    if (len <= 0) return WH_ERR_HEADER;
+    uint64_t in_offset = header_at + (uint64_t)len;
+
+    if (block->orig_size != orig_size || block->comp_size != comp_size ||
+        in_offset > footer->blocks_end ||
+        comp_size > footer->blocks_end - in_offset ||
+        in_offset + comp_size != next_in ||
+        out_offset > footer->total_size ||
+        orig_size > footer->total_size - out_offset ||
+        out_offset + orig_size != next_out) {
+        return WH_ERR_HEADER;
+    }
+
+    block->in_offset = in_offset;
+    block->out_offset = out_offset;
+    return WH_OK;
+}
+
+/* Read footer entry `i` and check it against its own header, its
+   neighbours and the buffer bounds. Safe to call from worker threads. */
+static int read_footer_entry(const unsigned char* in_data, const FrameFooter* footer, size_t i, BlockIndex* block) {
+    uint64_t header_at, next_in;
+    int err = footer_entry_header(footer, i, &header_at, &next_in);
+    if (err) return err;
+    return check_footer_entry(footer, i, header_at, next_in, in_data + header_at,
+                              footer->blocks_end - header_at, block);
+}
+
+/* Recognise a seekable footer at the end of the input. Returns 1 if the tail
+   is well formed and the first and last index entries match the block
+   headers they point at, 0 for a plain frame (which then gets walked as
+   before). A plain frame can end in footer-shaped bytes, for one when its
+   payload is itself a seekable frame, and only the headers tell the two
+   apart; the last entry has to end exactly where the footer starts, which
+   such a payload's doesn't. The entries in between are checked by
+   whichever task reads them (read_footer_entry()), so this stays O(1). */
+static int find_footer(const unsigned char* in_data, size_t in_size, FrameFooter* footer) {
+    if (in_size < FOOTER_TAIL_SIZE) return 0;
+
+    const unsigned char* tail = in_data + in_size - FOOTER_TAIL_SIZE;
+    uint64_t num_blocks, total_size;
+    uint32_t block_size, flags, version, magic;
+    memcpy(&num_blocks, tail, 8);
+    memcpy(&total_size, tail + 8, 8);
+    memcpy(&block_size, tail + 16, 4);
+    memcpy(&flags, tail + 20, 4);
+    memcpy(&version, tail + 24, 4);
+    memcpy(&magic, tail + 28, 4);
+
+    if (magic != FOOTER_MAGIC || version != FOOTER_VERSION || (flags & ~FOOTER_KNOWN_FLAGS)) return 0;
+
+    // Fixed-size sections, then what every block adds (entry + checksum)
+    size_t fixed_size = footer_sections_size(flags, 0);
+    size_t per_block = FOOTER_ENTRY_SIZE + footer_sections_size(flags, 1) - fixed_size;
+    if (in_size - FOOTER_TAIL_SIZE < fixed_size) return 0;
+    size_t avail = in_size - FOOTER_TAIL_SIZE - fixed_size;
+    if (num_blocks > avail / per_block) return 0;
+    if (total_size > num_blocks * (uint64_t)MAX_BLOCK_SIZE) return 0;
+    size_t blocks_end = avail - num_blocks * per_block;
+
+    const unsigned char* section = in_data + blocks_end + num_blocks * FOOTER_ENTRY_SIZE;
+    footer->dict_id = 0;
+    footer->group_blocks = 1;
+    footer->checksums = NULL;
+    if (flags & FOOTER_FLAG_DICT) {
+        memcpy(&footer->dict_id, section, 4);
+        section += FOOTER_DICT_SECTION_SIZE;
+    }
+    if (flags & FOOTER_FLAG_LINKED) {
+        memcpy(&footer->group_blocks, section, 4);
+        if (footer->group_blocks == 0) return 0;
+        section += FOOTER_LINKED_SECTION_SIZE;
+    }
+    if (flags & FOOTER_FLAG_CHECKSUM) {
+        footer->checksums = section;
+        section += num_blocks * FOOTER_CHECKSUM_SIZE;
+    }
+
+    // The table has to start right after the first v1 header, or at the
+    // first v2 header
+    int format = frame_format(in_data, blocks_end);
+    size_t prefix = frame_prefix_size(format);
+    if (num_blocks == 0) {
+        if (blocks_end != prefix || total_size != 0) return 0;
+    } else {
+        uint64_t first_in, first_out;
+        memcpy(&first_in, in_data + blocks_end, 8);
+        memcpy(&first_out, in_data + blocks_end + 8, 8);
+        if (first_in != (format == 2 ? prefix : HEADER_SIZE) || first_out != 0) return 0;
+    }
+
+    footer->entries = in_data + blocks_end;
+    footer->num_blocks = num_blocks;
+    footer->total_size = total_size;
+    footer->blocks_end = blocks_end;
+    footer->block_size = block_size;
+    footer->flags = flags;
+    footer->format = format;
+    BlockIndex block;
+    if (num_blocks && (read_footer_entry(in_data, footer, 0, &block) ||
+                       read_footer_entry(in_data, footer, num_blocks - 1, &block))) {
+        return 0;
+    }
+    return 1;
+}
+
+/* read_footer_entry(), with duplicates pointed at their original. */
+static int load_footer_entry(const unsigned char* in_data, const FrameFooter* footer, size_t i, BlockIndex* block) {
+    int err = read_footer_entry(in_data, footer, i, block);
+    if (err || !(block->flags & BLOCK_FLAG_REF)) return err;
+
+    uint32_t source;
+    BlockIndex original;
+    err = ref_source(in_data, block, i, &source);
+    if (!err) err = read_footer_entry(in_data, footer, source, &original);
+    if (!err) err = point_at_source(block, source, &original);
+    return err;
+}
+
+/* PASS 1: walk the block headers and build the index (single-threaded).
+   Stops early once the blocks cover `stop_out` bytes of output, which is
+   all decompress_range() needs. With `consumed` set, an incomplete last
+   block is left for later instead of being an error, and *consumed says
+   where it starts (streaming, v1 only). Call without the GIL. */
+static int build_index(const unsigned char* in_data, size_t in_size, size_t stop_out,
+                       BlockTable* table, size_t* consumed) {
+    int format = consumed ? 1 : frame_format(in_data, in_size);
+    size_t in_offset = frame_prefix_size(format);
+    size_t num_blocks = 0;
+    size_t total_uncompressed_size = 0;
+    size_t index_capacity = 1024; // Start with capacity for 1024 blocks
+
+    BlockIndex* index = malloc(index_capacity * sizeof(BlockIndex));
+    if (!index) return WH_ERR_NOMEM;
+
+    while (total_uncompressed_size < stop_out) {
+        BlockIndex block;
+        int len = read_block_header(in_data + in_offset, in_size - in_offset, format, &block);
+        if (len == 0) break;  // Ran out inside a header
+        if (len < 0) {
+            free(index);
+            return WH_ERR_HEADER;
+        }
+        if (block.comp_size > in_size - (in_offset + len)) {
+            if (consumed) break; // The rest of this block hasn't arrived yet
+            free(index);
+            return WH_ERR_HEADER;
+        }
+
+        // Grow index array if needed
+        if (num_blocks >= index_capacity) {
+            index_capacity *= 2;
+            BlockIndex* new_index = realloc(index, index_capacity * sizeof(BlockIndex));
+            if (!new_index) {
+                free(index);
+                return WH_ERR_NOMEM;
+            }
+            index = new_index;
+        }
+
+        // Store block info
+        size_t next_offset = in_offset + len + block.comp_size;
+        block.in_offset = in_offset + len;
+        block.out_offset = total_uncompressed_size;
+        if (block.flags & BLOCK_FLAG_REF) {
+            uint32_t source;
+            int err = ref_source(in_data, &block, num_blocks, &source);
+            if (!err) err = point_at_source(&block, source, &index[source]);
+            if (err) {
+                free(index);
+                return err;
+            }
+            table->has_refs = 1;
+        }
+        index[num_blocks] = block;
+
+        // Move to next block
+        in_offset = next_offset;
+        total_uncompressed_size += block.orig_size;
+        num_blocks++;
+    }
+
+    if (consumed) {
+        *consumed = in_offset;
+    } else if (total_uncompressed_size < stop_out && in_offset != in_size) {
+        free(index);
+        return WH_ERR_TRAILING;
+    }
+
+    table->index = index;
+    table->num_blocks = num_blocks;
+    table->total_size = total_uncompressed_size;
+    return WH_OK;
+}
+
+/* A footer that names a dictionary must get that one. Plain frames don't
+   say, so there the caller has to pass the same dictionary it compressed with. */
+static int check_footer_dict(const FrameFooter* footer, const WarpDict* dict) {
+    if (!(footer->flags & FOOTER_FLAG_DICT)) return WH_OK;
+    return dict && dict->id == footer->dict_id ? WH_OK : WH_ERR_DICT;
+}
+
+/* Set up the block table for `in_data`, from the footer when there is one.
+   Call without the GIL; release with free_block_table(). */
+static int load_block_table(const unsigned char* in_data, size_t in_size, size_t stop_out, const WarpDict* dict,
+                            BlockTable* table) {
+    memset(table, 0, sizeof(*table));
+    table->in_data = in_data;
+    table->dict = dict;
+    table->group_blocks = 1;
+    if (find_footer(in_data, in_size, &table->footer)) {
+        int err = check_footer_dict(&table->footer, dict);
+        if (err) return err;
+        table->group_blocks = table->footer.group_blocks;
+        table->checksums = table->footer.checksums;
+        table->has_refs = table->footer.format == 2;
+        table->seekable = 1;
+        table->num_blocks = table->footer.num_blocks;
+        table->total_size = table->footer.total_size;
+        return WH_OK;
+    }
+    return build_index(in_data, in_size, stop_out, table, NULL);
+}
+
+/* What frame_info() reports. */
+typedef struct {
+    size_t num_blocks;
+    size_t total_size;
+    size_t block_size;     // From the footer, else the largest block
+    int format;
+    int seekable;
+    uint32_t footer_flags;
+    uint32_t dict_id;      // With FOOTER_FLAG_DICT
+    size_t group_blocks;
+    uint32_t block_flags;  // Every v2 block flag seen (plain frames only)
+} FrameInfo;
+
+/* Describe `in_data` from its footer (the tail, plus the two entries
+   find_footer() checks: O(1) in the number of blocks), or else by walking
+   the block headers without keeping an index or decoding anything. Call
+   without the GIL. */
+static int inspect_frame(const unsigned char* in_data, size_t in_size, FrameInfo* info) {
+    FrameFooter footer;
+    memset(info, 0, sizeof(*info));
+    if (find_footer(in_data, in_size, &footer)) {
+        info->num_blocks = footer.num_blocks;
+        info->total_size = footer.total_size;
+        info->block_size = footer.block_size;
+        info->format = footer.format;
+        info->seekable = 1;
+        info->footer_flags = footer.flags;
+        info->dict_id = footer.dict_id;
+        info->group_blocks = footer.group_blocks;
+        return WH_OK;
+    }
+
+    info->format = frame_format(in_data, in_size);
+    info->group_blocks = 1;
+    size_t in_offset = frame_prefix_size(info->format);
+    for (;;) {
+        BlockIndex block;
+        int len = read_block_header(in_data + in_offset, in_size - in_offset, info->format, &block);
+        if (len == 0) break;
+        if (len < 0 || block.comp_size > in_size - (in_offset + len)) return WH_ERR_HEADER;
+        if (block.orig_size > info->block_size) info->block_size = block.orig_size;
+        info->block_flags |= block.flags;
+        in_offset += len + block.comp_size;
+        info->total_size += block.orig_size;
+        info->num_blocks++;
+    }
+    return in_offset == in_size ? WH_OK : WH_ERR_TRAILING;
+}
+
+static void free_block_table(BlockTable* table) {
+    free(table->index);
+    table->index = NULL;
+}
+
+/* Fetch block `i`. Footer entries are validated on the way out. */
+static inline int get_block(const BlockTable* table, size_t i, BlockIndex* block) {
+    if (table->seekable) return load_footer_entry(table->in_data, &table->footer, i, block);
+    *block = table->index[i];
+    return WH_OK;
+}
+
+#ifdef WH_BINDINGS
+/* Per-block figures for blocks [first, last] of a table (stats=True only). */
+static void stats_add_table(CallStats* stats, const BlockTable* table, size_t first, size_t last) {
+    if (table->index) stats->bytes_allocated += table->num_blocks * sizeof(BlockIndex);
+    if (!stats->requested) {
+        if (table->num_blocks) stats->blocks += last - first + 1;
+        return;
+    }
+    for (size_t i = first; table->num_blocks && i <= last; ++i) {
+        BlockIndex block;
+        if (get_block(table, i, &block) == WH_OK) {
+            stats_add_block(stats, block.comp_size, block.orig_size, (block.flags & BLOCK_FLAG_RAW) != 0);
+        }
+    }
+}
+#endif
+
+/* Raw out_offset of block `i`, for searching; not validated. */
+static inline size_t block_out_offset(const BlockTable* table, size_t i) {
+    if (!table->seekable) return table->index[i].out_offset;
+    uint64_t out_offset;
+    memcpy(&out_offset, table->footer.entries + i * FOOTER_ENTRY_SIZE + 8, 8);
+    return (size_t)out_offset;
+}
+
+/* Index of the block holding output byte `pos` (binary search). */
+static size_t find_block(const BlockTable* table, size_t pos) {
+    size_t lo = 0, hi = table->num_blocks;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (block_out_offset(table, mid) <= pos) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* Per-thread scratch of a decode loop, the inverse of CompressScratch's
+   shuffled buffer: shuffled blocks decode into it before being unshuffled,
+   and partial ranges decode into it before being copied out. Grown on
+   demand and kept across the thread's blocks; free with
+   free_decode_scratch() when the loop ends. */
+typedef struct {
+    unsigned char* shuffled;  // A shuffled block as LZ4 left it
+    size_t shuffled_size;
+    unsigned char* whole;     // The block (prefix) a range is copied out of
+    size_t whole_size;
+} DecodeScratch;
+
+/* Have room for `need` bytes in one of a DecodeScratch's buffers. */
+static unsigned char* scratch_reserve(unsigned char** buf, size_t* size, size_t need) {
+    if (need > *size || !*buf) {
+        unsigned char* grown = realloc(*buf, need ? need : 1);
+        if (!grown) return NULL;
+        *buf = grown;
+        *size = need;
+    }
+    return *buf;
+}
+
+static void free_decode_scratch(DecodeScratch* scratch) {
+    free(scratch->shuffled);
+    free(scratch->whole);
+    memset(scratch, 0, sizeof(*scratch));
+}
+
+static int decode_block_with(const unsigned char* in_data, const BlockIndex* block, const unsigned char* history,
+                             size_t history_size, unsigned char* out_ptr, DecodeScratch* scratch);
+
+/* Decode a shuffled block into scratch, then unshuffle it into `out_ptr`. */
+static int decode_shuffled(const unsigned char* in_data, const BlockIndex* block, const unsigned char* history,
+                           size_t history_size, unsigned char* out_ptr, DecodeScratch* scratch) {
+    BlockIndex plain = *block;
+    plain.flags &= ~BLOCK_FLAG_SHUFFLE;
+    unsigned char* shuffled = scratch_reserve(&scratch->shuffled, &scratch->shuffled_size, block->orig_size);
+    if (!shuffled) return WH_ERR_NOMEM;
+    int err = decode_block_with(in_data, &plain, history, history_size, shuffled, scratch);
+    if (!err) unshuffle_bytes(shuffled, out_ptr, block->orig_size, block->typesize);
+    return err;
+}
+
+/* Decode a whole block into `out_ptr`, which has room for orig_size bytes,
+   against `history` (a dictionary, or the output right before `out_ptr`). */
+static int decode_block_with(const unsigned char* in_data, const BlockIndex* block, const unsigned char* history,
+                             size_t history_size, unsigned char* out_ptr, DecodeScratch* scratch) {
+    const unsigned char* in_ptr = in_data + block->in_offset;
+
+    if (block->flags & BLOCK_FLAG_RAW) {
+        // Data was stored uncompressed, just copy it
+        memcpy(out_ptr, in_ptr, block->orig_size);
+        return WH_OK;
+    }
+    if (block->flags & BLOCK_FLAG_SHUFFLE) return decode_shuffled(in_data, block, history, history_size, out_ptr, scratch);
+
+    // Data is LZ4 compressed, decompress it
+    int decomp_size = history ? LZ4_decompress_safe_usingDict(
+        (const char*)in_ptr,
+        (char*)out_ptr,
+        (int)block->comp_size,
+        (int)block->orig_size,
+        (const char*)history,
+        (int)history_size
+    ) : LZ4_decompress_safe(
+        (const char*)in_ptr,
+        (char*)out_ptr,
+        (int)block->comp_size,
+        (int)block->orig_size
+    );
+    return decomp_size == (int)block->orig_size ? WH_OK : WH_ERR_CORRUPT;
+}
+
+/* Decode an independent block, against the dictionary if there is one. */
+static int decode_block(const unsigned char* in_data, const BlockIndex* block, const WarpDict* dict,
+                        unsigned char* out_ptr, DecodeScratch* scratch) {
+    if ((block->flags & BLOCK_FLAG_DICT) && !dict) return WH_ERR_DICT;
+    return decode_block_with(in_data, block, dict ? dict->data : NULL, dict ? dict->size : 0, out_ptr, scratch);
+}
+
+/* Check decoded block `i` against its recorded checksum, if the frame has
+   them, or record its hash for checking later. */
+static inline int verify_block(const BlockTable* table, size_t i, const unsigned char* data, size_t size) {
+    if (table->hashes) {
+        uint64_t hash = XXH3_64bits(data, size);
+        memcpy(table->hashes + i * FOOTER_CHECKSUM_SIZE, &hash, 8);
+        return WH_OK;
+    }
+    if (!table->checksums) return WH_OK;
+    uint64_t expected;
+    memcpy(&expected, table->checksums + i * FOOTER_CHECKSUM_SIZE, 8);
+    return XXH3_64bits(data, size) == expected ? WH_OK : WH_ERR_CHECKSUM;
+}
+
+/* Decode blocks [first, first + count) in order into `out_ptr`, where block
+   `first` starts. `first` must open a group: the first block of each group
+   gets the dictionary and the others the LINKED_WINDOW_SIZE bytes of output
+   before them. Safe to call from worker threads, each with its own
+   `scratch`. */
+static int decode_run(const BlockTable* table, size_t first, size_t count, unsigned char* out_ptr,
+                      DecodeScratch* scratch) {
+    size_t run_start = 0, group_start = 0;
+
+    for (size_t i = first; i < first + count; ++i) {
+        BlockIndex block;
+        int err = get_block(table, i, &block);
+        if (err) return err;
+        if (i == first) run_start = block.out_offset;
+
+        unsigned char* dst = out_ptr + (block.out_offset - run_start);
+        if ((i - first) % table->group_blocks == 0) {
+            group_start = block.out_offset;
+            err = decode_block(table->in_data, &block, table->dict, dst, scratch);
+        } else {
+            size_t window = block.out_offset - group_start;
+            if (window > LINKED_WINDOW_SIZE) window = LINKED_WINDOW_SIZE;
+            err = decode_block_with(table->in_data, &block, dst - window, window, dst, scratch);
+        }
+        if (!err) err = verify_block(table, i, dst, block.orig_size);
+        if (err) return err;
+    }
+    return WH_OK;
+}
+
+/* PASS 2: decode every block of `table` into `out_data` in parallel, one
+   group (one block unless the frame is linked) per task. Call without the
+   GIL. */
+static int decode_table(const BlockTable* table, unsigned char* out_data, int threads) {
+    size_t num_blocks = table->num_blocks;
+    size_t group = table->group_blocks;
+    size_t num_groups = (num_blocks + group - 1) / group;
+    int copy_refs = table->has_refs && group == 1;
+    int err = WH_OK;
+
+    #pragma omp parallel if(threads > 1) num_threads(threads) copyin(team_slots)
+    {
+        DecodeScratch scratch = {0};
+
+        #pragma omp for schedule(runtime)
+        for (size_t g = 0; g < num_groups; ++g) {
+            if (err) continue; // Stop if an error has occurred in another thread
+            place_worker();
+
+            size_t first = g * group;
+            size_t count = num_blocks - first < group ? num_blocks - first : group;
+            BlockIndex block;
+            int block_err = get_block(table, first, &block);
+            if (!block_err && copy_refs && (block.flags & BLOCK_FLAG_REF)) continue; // Copied below
+            if (!block_err) block_err = decode_run(table, first, count, out_data + block.out_offset, &scratch);
+            if (block_err) set_error(&err, block_err);
+        } // --- END PARALLEL LOOP ---
+        free_decode_scratch(&scratch);
+
+        // Duplicates are copied from the output their originals just decoded to
+        if (copy_refs) {
+            #pragma omp for schedule(runtime)
+            for (size_t i = 0; i < num_blocks; ++i) {
+                if (err) continue;
+                BlockIndex block, original;
+                int block_err = get_block(table, i, &block);
+                if (!block_err && (block.flags & BLOCK_FLAG_REF)) {
+                    block_err = get_block(table, block.source, &original);
+                    if (!block_err) {
+                        memcpy(out_data + block.out_offset, out_data + original.out_offset, block.orig_size);
+                        block_err = verify_block(table, i, out_data + block.out_offset, block.orig_size);
+                    }
+                }
+                if (block_err) set_error(&err, block_err);
+            }
+        }
+    }
+
+    return err;
+}
+
+/* Decode bytes [lo, hi) of a block into `out_ptr`. LZ4 can only stop early,
+   not start late, so a range that doesn't begin at the block start is
+   decoded into scratch first; so is any range of a shuffled block, which
+   has every element's bytes spread across the whole block. */
+static int decode_block_range(const unsigned char* in_data, const BlockIndex* block, const WarpDict* dict,
+                              size_t lo, size_t hi, unsigned char* out_ptr, DecodeScratch* scratch) {
+    const unsigned char* in_ptr = in_data + block->in_offset;
+
+    if (lo == 0 && hi == block->orig_size) return decode_block(in_data, block, dict, out_ptr, scratch);
+    if ((block->flags & BLOCK_FLAG_DICT) && !dict) return WH_ERR_DICT;
+    if (block->flags & BLOCK_FLAG_RAW) {
+        memcpy(out_ptr, in_ptr + lo, hi - lo);
+        return WH_OK;
+    }
+    if (block->flags & BLOCK_FLAG_SHUFFLE) {
+        unsigned char* whole = scratch_reserve(&scratch->whole, &scratch->whole_size, block->orig_size);
+        if (!whole) return WH_ERR_NOMEM;
+        int err = decode_block(in_data, block, dict, whole, scratch);
+        if (!err) memcpy(out_ptr, whole + lo, hi - lo);
+        return err;
+    }
+
+    unsigned char* dst = out_ptr;
+    if (lo != 0) {
+        dst = scratch_reserve(&scratch->whole, &scratch->whole_size, hi);
+        if (!dst) return WH_ERR_NOMEM;
+    }
+
+    int decomp_size = dict ? LZ4_decompress_safe_partial_usingDict(
+        (const char*)in_ptr,
+        (char*)dst,
+        (int)block->comp_size,
+        (int)hi,
+        (int)hi,
+        (const char*)dict->data,
+        (int)dict->size
+    ) : LZ4_decompress_safe_partial(
+        (const char*)in_ptr,
+        (char*)dst,
+        (int)block->comp_size,
+        (int)hi,
+        (int)hi
+    );
+
+    int err = decomp_size == (int)hi ? WH_OK : WH_ERR_CORRUPT;
+    if (lo != 0 && !err) memcpy(out_ptr, dst + lo, hi - lo);
+    return err;
+}
+
+/* Decode output bytes [offset, end) of independent blocks first..last into
+   `out_data`, in parallel; only the edge blocks are partially decoded. */
+static int decode_blocks_range(const BlockTable* table, size_t first, size_t last, size_t offset, size_t end,
+                               unsigned char* out_data, int threads) {
+    int err = WH_OK;
+
+    #pragma omp parallel if(threads > 1) num_threads(threads) copyin(team_slots)
+    {
+        DecodeScratch scratch = {0};
+
+        #pragma omp for schedule(runtime)
+        for (size_t i = first; i <= last; ++i) {
+            if (err) continue;
+            place_worker();
+
+            BlockIndex block;
+            int block_err = get_block(table, i, &block);
+            if (!block_err) {
+                size_t block_start = block.out_offset;
+                size_t lo = offset > block_start ? offset - block_start : 0;
+                size_t hi = end - block_start < block.orig_size ? end - block_start : block.orig_size;
+                if (block_start + lo < offset || lo > hi || block_start + hi > end) {
+                    block_err = WH_ERR_HEADER; // Table disagrees with the search
+                } else {
+                    unsigned char* dst = out_data + (block_start + lo - offset);
+                    block_err = decode_block_range(table->in_data, &block, table->dict, lo, hi, dst, &scratch);
+                    // Only whole blocks can be checked
+                    if (!block_err && lo == 0 && hi == block.orig_size) block_err = verify_block(table, i, dst, hi);
+                }
+            }
+            if (block_err) set_error(&err, block_err);
+        }
+        free_decode_scratch(&scratch);
+    }
+    return err;
+}
+
+/* Same for a linked frame: blocks can only be decoded from the start of
+   their group, so the whole groups covering the range are decoded into
+   scratch (in parallel, one group per task) and the range copied out. */
+static int decode_linked_range(const BlockTable* table, size_t first, size_t last, size_t offset, size_t end,
+                               unsigned char* out_data, int threads) {
+    size_t group = table->group_blocks;
+    size_t first_group = first / group, last_group = last / group;
+    size_t last_block = (last_group + 1) * group < table->num_blocks ? (last_group + 1) * group - 1 : table->num_blocks - 1;
+
+    BlockIndex head, tail;
+    int err = get_block(table, first_group * group, &head);
+    if (!err) err = get_block(table, last_block, &tail);
+    if (err) return err;
+
+    size_t base = head.out_offset;
+    size_t span = tail.out_offset + tail.orig_size - base;
+    if (offset < base || end > base + span) return WH_ERR_HEADER; // Table disagrees with the search
+
+    unsigned char* scratch = malloc(span);
+    if (!scratch) return WH_ERR_NOMEM;
+
+    #pragma omp parallel if(threads > 1) num_threads(threads) copyin(team_slots)
+    {
+        DecodeScratch block_scratch = {0};
+
+        #pragma omp for schedule(runtime)
+        for (size_t g = first_group; g <= last_group; ++g) {
+            if (err) continue;
+            place_worker();
+
+            size_t start = g * group;
+            size_t count = table->num_blocks - start < group ? table->num_blocks - start : group;
+            BlockIndex block;
+            int block_err = get_block(table, start, &block);
+            if (!block_err) {
+                block_err = decode_run(table, start, count, scratch + (block.out_offset - base), &block_scratch);
+            }
+            if (block_err) set_error(&err, block_err);
+        }
+        free_decode_scratch(&block_scratch);
+    }
+
+    if (!err) memcpy(out_data, scratch + (offset - base), end - offset);
+    free(scratch);
+    return err;
+}
+
+/* Independent decode tasks in `table` (groups, for linked frames). */
+static inline size_t table_tasks(const BlockTable* table) {
+    return (table->num_blocks + table->group_blocks - 1) / table->group_blocks;
+}
+
+/* verify(): PASS 2 without an output. Each task decodes its block (or
+   linked group) into per-thread scratch that holds one block plus, for
+   linked frames, the window of output before it, and checks the block's
+   checksum. A duplicate's content is its original's, so it only needs its
+   recorded checksum to match the original's. On failure *bad_block is the
+   first failing block and the result is its error; tasks past a known
+   failure are skipped. Call without the GIL. */
+static int verify_table(const BlockTable* table, int threads, size_t* bad_block) {
+    size_t num_blocks = table->num_blocks;
+    size_t group = table->group_blocks;
+    size_t num_groups = (num_blocks + group - 1) / group;
+    size_t bad = SIZE_MAX;
+    int err = WH_OK;
+
+    #pragma omp parallel if(threads > 1) num_threads(threads) copyin(team_slots)
+    {
+        unsigned char* scratch = NULL;
+        size_t scratch_size = 0;
+        DecodeScratch block_scratch = {0};
+
+        #pragma omp for schedule(runtime)
+        for (size_t g = 0; g < num_groups; ++g) {
+            size_t first = g * group;
+            size_t first_bad;
+            #pragma omp atomic read
+            first_bad = bad;
+            if (first > first_bad) continue; // An earlier block already failed
+            place_worker();
+
+            size_t count = num_blocks - first < group ? num_blocks - first : group;
+            size_t window = 0; // Output of the group kept in front of the next block
+            for (size_t i = first; i < first + count; ++i) {
+                BlockIndex block;
+                int block_err = get_block(table, i, &block);
+                if (!block_err && (block.flags & BLOCK_FLAG_REF)) {
+                    if (table->checksums &&
+                        memcmp(table->checksums + i * FOOTER_CHECKSUM_SIZE,
+                               table->checksums + (size_t)block.source * FOOTER_CHECKSUM_SIZE, 8) != 0) {
+                        block_err = WH_ERR_CHECKSUM;
+                    }
+                } else if (!block_err) {
+                    if (window + block.orig_size > scratch_size) {
+                        unsigned char* grown = realloc(scratch, window + block.orig_size);
+                        if (grown) {
+                            scratch = grown;
+                            scratch_size = window + block.orig_size;
+                        } else {
+                            block_err = WH_ERR_NOMEM;
+                        }
+                    }
+                    if (!block_err) {
+                        unsigned char* dst = scratch + window;
+                        if (i == first) {
+                            block_err = decode_block(table->in_data, &block, table->dict, dst, &block_scratch);
+                        } else {
+                            block_err = decode_block_with(table->in_data, &block, scratch, window, dst, &block_scratch);
+                        }
+                        if (!block_err) block_err = verify_block(table, i, dst, block.orig_size);
+                    }
+                    if (!block_err && group > 1) {
+                        // Slide the last LINKED_WINDOW_SIZE bytes to the front for the next block
+                        size_t kept = window + block.orig_size;
+                        if (kept > LINKED_WINDOW_SIZE) {
+                            memmove(scratch, scratch + kept - LINKED_WINDOW_SIZE, LINKED_WINDOW_SIZE);
+                            kept = LINKED_WINDOW_SIZE;
+                        }
+                        window = kept;
+                    }
+                }
+                if (block_err) {
+                    #pragma omp critical(wh_error)
+                    {
+                        if (i < bad) {
+                            #pragma omp atomic write
+                            bad = i;
+                            err = block_err;
+                        }
+                    }
+                    break;
+                }
+            }
+        } // --- END PARALLEL LOOP ---
+
+        free(scratch);
+        free_decode_scratch(&block_scratch);
+    }
+
+    *bad_block = bad;
+    return err;
+}
+
+#ifdef WH_BINDINGS
+/* Compress every payload of `batch` into its own frame, laid out back to back
+   in `out_data` (sum of blocks_bound() per item). All blocks of all items go
+   through a single parallel loop and one compaction. frame_offsets gets
+   count + 1 entries. Call without the GIL. */
+static int compress_batch(const PayloadBatch* batch, const CompressOptions* opts,
+                          unsigned char* out_data, size_t* frame_offsets) {
+    size_t block_size = opts->block_size;
+    size_t slot_header = slot_header_size(opts->format);
+    size_t slot_size = slot_header + LZ4_compressBound((int)block_size);
+    size_t prefix = frame_prefix_size(opts->format);
+    size_t count = (size_t)batch->count;
+
+    size_t* first_block = malloc((count + 1) * sizeof(size_t));
+    size_t* bound_offset = malloc((count + 1) * sizeof(size_t));
+    if (!first_block || !bound_offset) {
+        free(first_block);
+        free(bound_offset);
+        return WH_ERR_NOMEM;
+    }
+
+    size_t total_blocks = 0, total_bound = 0;
+    for (size_t i = 0; i < count; ++i) {
+        first_block[i] = total_blocks;
+        bound_offset[i] = total_bound + prefix;
+        total_blocks += (batch->sizes[i] + block_size - 1) / block_size;
+        total_bound += prefix + blocks_bound(batch->sizes[i], block_size, opts->format);
+    }
+    first_block[count] = total_blocks;
+
+    BlockResult* results = calloc(total_blocks ? total_blocks : 1, sizeof(BlockResult));
+    size_t* block_item = malloc((total_blocks ? total_blocks : 1) * sizeof(size_t));
+    if (!results || !block_item) {
+        free(first_block);
+        free(bound_offset);
+        free(results);
+        free(block_item);
+        return WH_ERR_NOMEM;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        for (size_t g = first_block[i]; g < first_block[i + 1]; ++g) block_item[g] = i;
+    }
+
+    unsigned long long raw_blocks = 0, skipped_blocks = 0;
+    double t = omp_get_wtime();
+
+    #pragma omp parallel if(opts->threads > 1) num_threads(opts->threads) reduction(+:raw_blocks, skipped_blocks) copyin(team_slots)
+    {
+        CompressScratch scratch;
+        scratch_init(&scratch, opts);
+
+        #pragma omp for schedule(runtime)
+        for (size_t g = 0; g < total_blocks; ++g) {
+            place_worker();
+            size_t item = block_item[g];
+            size_t offset_in = (g - first_block[item]) * block_size;
+            size_t item_size = batch->sizes[item];
+            size_t orig_size = (offset_in + block_size <= item_size) ? block_size : (item_size - offset_in);
+
+            results[g].offset_in = offset_in;
+            results[g].orig_size = orig_size;
+            size_t slot_offset = bound_offset[item] + (g - first_block[item]) * slot_size;
+            results[g].comp_size = compress_into_slot(opts, &scratch, batch->data[item] + offset_in, orig_size, 0,
+                                                      out_data + slot_offset, &results[g].header_size,
+                                                      &raw_blocks, &skipped_blocks);
+            results[g].slot_offset = slot_offset + slot_header - results[g].header_size;
+        }
+
+        scratch_free(&scratch);
+    }
+    count_blocks(total_blocks, raw_blocks, skipped_blocks);
+    CallStats unused;
+    CallStats* stats = opts->stats ? opts->stats : &unused;
+    t = stats_lap(&stats->work_seconds, t);
+
+    // Frames end up back to back, so one prefix sum over every block gives
+    // both block and frame offsets
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        frame_offsets[i] = total;
+        total += prefix;
+        for (size_t g = first_block[i]; g < first_block[i + 1]; ++g) {
+            results[g].out_offset = total;
+            total += block_span(&results[g]);
+        }
+    }
+    frame_offsets[count] = total;
+
+    int err = compact_blocks(out_data, results, total_blocks, opts->threads);
+    for (size_t i = 0; !err && prefix && i < count; ++i) write_frame_prefix(out_data + frame_offsets[i], opts->format);
+    stats_lap(&stats->gather_seconds, t);
+    stats->bytes_allocated += total_blocks * (sizeof(BlockResult) + sizeof(size_t));
+    if (opts->stats) stats_add_results(stats, results, total_blocks);
+
+    free(first_block);
+    free(bound_offset);
+    free(results);
+    free(block_item);
+    return err;
+}
+
+/* Walk one frame's blocks. With `index` NULL this only counts blocks and
+   output bytes; otherwise it also fills index[0 .. *num_blocks). Sets
+   *group_blocks to the frame's linked group size (1 if not linked) and
+   *checksums to its per-block checksums (NULL if it has none). Safe to call
+   from worker threads. */
+static int scan_frame(const unsigned char* data, size_t size, const WarpDict* dict, BlockIndex* index,
+                      size_t* num_blocks, size_t* total_size, size_t* group_blocks,
+                      const unsigned char** checksums) {
+    FrameFooter footer;
+    *group_blocks = 1;
+    *checksums = NULL;
+    if (find_footer(data, size, &footer)) {
+        int err = check_footer_dict(&footer, dict);
+        for (size_t i = 0; !err && index && i < footer.num_blocks; ++i) {
+            err = load_footer_entry(data, &footer, i, &index[i]);
+        }
+        if (err) return err;
+        *num_blocks = footer.num_blocks;
+        *total_size = footer.total_size;
+        *group_blocks = footer.group_blocks;
+        *checksums = footer.checksums;
+        return WH_OK;
+    }
+
+    int format = frame_format(data, size);
+    size_t in_offset = frame_prefix_size(format), n = 0, total = 0;
+    for (;;) {
+        BlockIndex block;
+        int len = read_block_header(data + in_offset, size - in_offset, format, &block);
+        if (len == 0) break;
+        if (len < 0 || block.comp_size > size - (in_offset + len)) return WH_ERR_HEADER;
+
+        size_t next_offset = in_offset + len + block.comp_size;
+        if (index) {
+            block.in_offset = in_offset + len;
+            block.out_offset = total;
+            if (block.flags & BLOCK_FLAG_REF) {
+                uint32_t source;
+                int err = ref_source(data, &block, n, &source);
+                if (!err) err = point_at_source(&block, source, &index[source]);
+                if (err) return err;
+            }
+            index[n] = block;
+        }
+        in_offset = next_offset;
+        total += block.orig_size;
+        n++;
+    }
+    if (in_offset != size) return WH_ERR_TRAILING;
+
+    *num_blocks = n;
+    *total_size = total;
+    return WH_OK;
+}
+
+/* Decompress every frame of `batch`. Frame i is decoded into outputs[i]
+   (sized by a previous scan). Works as one parallel loop over all blocks of
+   all frames; in a linked frame the first block of each group decodes the
+   whole group. Adds the block figures to `stats`. Call without the GIL. */
+static int decode_batch(const PayloadBatch* batch, const size_t* first_block, size_t total_blocks,
+                        const WarpDict* dict, unsigned char* const* outputs, int threads, CallStats* stats) {
+    size_t count = (size_t)batch->count;
+    BlockIndex* index = malloc((total_blocks ? total_blocks : 1) * sizeof(BlockIndex));
+    size_t* block_item = malloc((total_blocks ? total_blocks : 1) * sizeof(size_t));
+    size_t* frame_group = malloc((count ? count : 1) * sizeof(size_t));
+    const unsigned char** frame_checksums = malloc((count ? count : 1) * sizeof(*frame_checksums));
+    int err = WH_OK;
+
+    if (!index || !block_item || !frame_group || !frame_checksums) {
+        free(index);
+        free(block_item);
+        free(frame_group);
+        free(frame_checksums);
+        return WH_ERR_NOMEM;
+    }
+
+    #pragma omp parallel if(threads > 1) num_threads(threads) copyin(team_slots)
+    {
+        DecodeScratch scratch = {0};
+
+        #pragma omp for schedule(dynamic, 16)
+        for (size_t i = 0; i < count; ++i) {
+            if (err) continue;
+            size_t n, total;
+            int frame_err = scan_frame(batch->data[i], batch->sizes[i], dict, index + first_block[i], &n, &total,
+                                       &frame_group[i], &frame_checksums[i]);
+            if (!frame_err && n != first_block[i + 1] - first_block[i]) frame_err = WH_ERR_HEADER;
+            if (frame_err) set_error(&err, frame_err);
+            for (size_t g = first_block[i]; g < first_block[i + 1]; ++g) block_item[g] = i;
+        }
+
+        #pragma omp for schedule(runtime)
+        for (size_t g = 0; g < total_blocks; ++g) {
+            if (err) continue;
+            place_worker();
+            size_t item = block_item[g];
+            size_t local = g - first_block[item];
+            size_t group = frame_group[item];
+            if (local % group) continue; // Decoded with the start of its group
+
+            BlockTable frame;
+            memset(&frame, 0, sizeof(frame));
+            frame.in_data = batch->data[item];
+            frame.index = index + first_block[item];
+            frame.num_blocks = first_block[item + 1] - first_block[item];
+            frame.dict = dict;
+            frame.group_blocks = group;
+            frame.checksums = frame_checksums[item];
+            size_t run = frame.num_blocks - local < group ? frame.num_blocks - local : group;
+            int block_err = decode_run(&frame, local, run, outputs[item] + index[g].out_offset, &scratch);
+            if (block_err) set_error(&err, block_err);
+        }
+        free_decode_scratch(&scratch);
+    }
+
+    stats->bytes_allocated += total_blocks * (sizeof(BlockIndex) + sizeof(size_t));
+    for (size_t g = 0; g < total_blocks; ++g) {
+        if (!stats->requested) {
+            stats->blocks = total_blocks;
+            break;
+        }
+        stats_add_block(stats, index[g].comp_size, index[g].orig_size, (index[g].flags & BLOCK_FLAG_RAW) != 0);
+    }
+
+    free(index);
+    free(block_item);
+    free(frame_group);
+    free(frame_checksums);
+    return err;
+}
+
+
+// --- Standard LZ4 frames ---
+
+/* Descriptor id for an LZ4 frame block size, or 0 if the format has none. */
+static int lz4frame_block_id(size_t block_size) {
+    for (int id = 4; id <= 7; ++id) {
+        if (block_size == (size_t)1 << (8 + 2 * id)) return id;
+    }
+    return 0;
+}
+
+/* One data block of a scanned LZ4 frame. `cap` bounds what it decodes to,
+   and it is decoded at `out_offset` (a prefix sum of caps) before the
+   blocks are moved together. */
+typedef struct {
+    size_t in_offset;
+    size_t cap;
+    size_t out_offset;
+    size_t out_size;
+    uint32_t size;
+    int raw;
+    int checksum;  // Followed by an XXH32 of its stored bytes
+} Lz4FrameBlock;
+
+typedef struct {
+    size_t first_block;
+    size_t num_blocks;
+    uint64_t content_size;   // With LZ4FRAME_FLG_CONTENT_SIZE
+    size_t checksum_offset;  // Of the content checksum; 0 when there is none
+    int has_content_size;
+    int block_checksums;
+    size_t out_offset;       // Where the frame's output starts, once compacted
+    size_t out_size;
+} Lz4Frame;
+
+/* Every frame and block of an input, from scan_lz4_frames(). */
+typedef struct {
+    Lz4FrameBlock* blocks;
+    size_t num_blocks, blocks_cap;
+    Lz4Frame* frames;
+    size_t num_frames, frames_cap;
+    size_t total_cap;
+    int serial;  // A frame has linked blocks or a dictionary id: use lz4frame
+} Lz4FrameScan;
+
+static void free_lz4_scan(Lz4FrameScan* scan) {
+    free(scan->blocks);
+    free(scan->frames);
+    scan->blocks = NULL;
+    scan->frames = NULL;
+}
+
+/* Append an item to a growable array. Returns WH_ERR_NOMEM on failure. */
+static int grow_for_one(void** items, size_t* cap, size_t count, size_t item_size) {
+    if (count < *cap) return WH_OK;
+    size_t new_cap = *cap ? *cap * 2 : 64;
+    void* grown = realloc(*items, new_cap * item_size);
+    if (!grown) return WH_ERR_NOMEM;
+    *items = grown;
+    *cap = new_cap;
+    return WH_OK;
+}
+
+/* Walk every frame of `data` (skippable frames are skipped) and list their
+   blocks. Stops early with scan->serial set when a frame needs the
+   sequential decoder. Call without the GIL. */
+static int scan_lz4_frames(const unsigned char* data, size_t size, Lz4FrameScan* scan) {
+    memset(scan, 0, sizeof(*scan));
+    size_t pos = 0;
+    while (pos < size) {
+        uint32_t magic;
+        if (size - pos < 4) return WH_ERR_TRUNCATED;
+        memcpy(&magic, data + pos, 4);
+        if ((magic & 0xFFFFFFF0u) == LZ4FRAME_SKIPPABLE_MAGIC) {
+            uint32_t skip;
+            if (size - pos < 8) return WH_ERR_TRUNCATED;
+            memcpy(&skip, data + pos + 4, 4);
+            if (skip > size - pos - 8) return WH_ERR_TRUNCATED;
+            pos += 8 + (size_t)skip;
+            continue;
+        }
+        if (magic != LZ4FRAME_MAGIC) return WH_ERR_HEADER;
+
+        if (size - pos < 7) return WH_ERR_TRUNCATED;
+        unsigned flg = data[pos + 4], bd = data[pos + 5];
+        int block_id = (bd >> 4) & 7;
+        if ((flg & 0xC2u) != LZ4FRAME_FLG_VERSION || (bd & 0x8Fu) || block_id < 4) return WH_ERR_HEADER;
+        size_t header_len = 7 + (flg & LZ4FRAME_FLG_CONTENT_SIZE ? 8 : 0) + (flg & LZ4FRAME_FLG_DICT_ID ? 4 : 0);
+        if (size - pos < header_len) return WH_ERR_TRUNCATED;
+        if ((unsigned char)(XXH32(data + pos + 4, header_len - 5, 0) >> 8) != data[pos + header_len - 1]) {
+            return WH_ERR_HEADER;
+        }
+        if (!(flg & LZ4FRAME_FLG_INDEPENDENT) || (flg & LZ4FRAME_FLG_DICT_ID)) {
+            scan->serial = 1;
+            return WH_OK;
+        }
+
+        if (grow_for_one((void**)&scan->frames, &scan->frames_cap, scan->num_frames, sizeof(Lz4Frame))) {
+            return WH_ERR_NOMEM;
+        }
+        Lz4Frame* frame = &scan->frames[scan->num_frames++];
+        memset(frame, 0, sizeof(*frame));
+        frame->first_block = scan->num_blocks;
+        frame->block_checksums = (flg & LZ4FRAME_FLG_BLOCK_CHECKSUM) != 0;
+        frame->has_content_size = (flg & LZ4FRAME_FLG_CONTENT_SIZE) != 0;
+        if (frame->has_content_size) memcpy(&frame->content_size, data + pos + 6, 8);
+        size_t block_max = (size_t)1 << (8 + 2 * block_id);
+        pos += header_len;
+
+        for (;;) {
+            uint32_t block_header;
+            if (size - pos < 4) return WH_ERR_TRUNCATED;
+            memcpy(&block_header, data + pos, 4);
+            pos += 4;
+            if (block_header == 0) break; // EndMark
+
+            uint32_t block_size = block_header & ~LZ4FRAME_UNCOMPRESSED;
+            if (block_size > block_max) return WH_ERR_CORRUPT;
+            if ((size_t)block_size + (frame->block_checksums ? 4 : 0) > size - pos) return WH_ERR_TRUNCATED;
+            if (grow_for_one((void**)&scan->blocks, &scan->blocks_cap, scan->num_blocks, sizeof(Lz4FrameBlock))) {
+                return WH_ERR_NOMEM;
+            }
+            Lz4FrameBlock* block = &scan->blocks[scan->num_blocks++];
+            block->in_offset = pos;
+            block->size = block_size;
+            block->raw = (block_header & LZ4FRAME_UNCOMPRESSED) != 0;
+            block->checksum = frame->block_checksums;
+            block->cap = block_size;
+            if (!block->raw) {
+                block->cap = (size_t)block_size * LZ4_MAX_EXPANSION;
+                if (block->cap > block_max) block->cap = block_max;
+                if (frame->has_content_size && block->cap > frame->content_size) block->cap = frame->content_size;
+            }
+            block->out_offset = scan->total_cap;
+            scan->total_cap += block->cap;
+            pos += block_size + (frame->block_checksums ? 4 : 0);
+        }
+        frame->num_blocks = scan->num_blocks - frame->first_block;
+
+        if (flg & LZ4FRAME_FLG_CONTENT_CHECKSUM) {
+            if (size - pos < 4) return WH_ERR_TRUNCATED;
+            frame->checksum_offset = pos;
+            pos += 4;
+        }
+    }
+    return WH_OK;
+}
+
+/* Decode every scanned block into `out_data` (scan->total_cap bytes) across
+   the team, close the gaps that short blocks leave and check the frames'
+   sizes and checksums. Sets *out_size. Call without the GIL. */
+static int decode_lz4_frames(const unsigned char* data, Lz4FrameScan* scan, unsigned char* out_data, int threads,
+                             size_t* out_size) {
+    int err = WH_OK;
+    size_t num_frames = scan->num_frames;
+
+    #pragma omp parallel for if(threads > 1) num_threads(threads) schedule(runtime) copyin(team_slots)
+    for (size_t i = 0; i < scan->num_blocks; ++i) {
+        if (err) continue;
+        place_worker();
+        Lz4FrameBlock* block = &scan->blocks[i];
+        const unsigned char* src = data + block->in_offset;
+        int block_err = WH_OK;
+        if (block->checksum) {
+            uint32_t expected;
+            memcpy(&expected, src + block->size, 4);
+            if (XXH32(src, block->size, 0) != expected) block_err = WH_ERR_CHECKSUM;
+        }
+        if (!block_err && block->raw) {
+            memcpy(out_data + block->out_offset, src, block->size);
+            block->out_size = block->size;
+        } else if (!block_err) {
+            int n = LZ4_decompress_safe((const char*)src, (char*)(out_data + block->out_offset), (int)block->size,
+                                        (int)block->cap);
+            if (n < 0) block_err = WH_ERR_CORRUPT;
+            else block->out_size = (size_t)n;
+        }
+        if (block_err) set_error(&err, block_err);
+    }
+    if (err) return err;
+
+    // Full blocks sit exactly where they decoded, so in practice only what
+    // follows a short last block of a frame moves
+    size_t total = 0;
+    for (size_t f = 0; f < num_frames; ++f) {
+        Lz4Frame* frame = &scan->frames[f];
+        frame->out_offset = total;
+        for (size_t i = frame->first_block; i < frame->first_block + frame->num_blocks; ++i) {
+            Lz4FrameBlock* block = &scan->blocks[i];
+            if (block->out_offset != total) memmove(out_data + total, out_data + block->out_offset, block->out_size);
+            total += block->out_size;
+        }
+        frame->out_size = total - frame->out_offset;
+        if (frame->has_content_size && frame->content_size != frame->out_size) return WH_ERR_CORRUPT;
+    }
+
+    #pragma omp parallel for if(threads > 1) num_threads(threads) schedule(runtime)
+    for (size_t f = 0; f < num_frames; ++f) {
+        const Lz4Frame* frame = &scan->frames[f];
+        if (err || !frame->checksum_offset) continue;
+        uint32_t expected;
+        memcpy(&expected, data + frame->checksum_offset, 4);
+        if (XXH32(out_data + frame->out_offset, frame->out_size, 0) != expected) set_error(&err, WH_ERR_CHECKSUM);
+    }
+
+    *out_size = total;
+    return err;
+}
+
+/* Decode with lz4frame itself, one block after another, into a malloc()ed
+   buffer. For frames whose blocks depend on each other. Call without the
+   GIL. */
+static int decode_lz4_frames_serial(const unsigned char* data, size_t size, unsigned char** out_data,
+                                    size_t* out_size) {
+    LZ4F_dctx* dctx;
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION))) return WH_ERR_NOMEM;
+
+    size_t cap = size * 4 < 65536 ? 65536 : size * 4;
+    unsigned char* out = malloc(cap);
+    size_t pos = 0, in_pos = 0, hint = 1;
+    int err = out ? WH_OK : WH_ERR_NOMEM;
+    while (!err && in_pos < size) {
+        if (pos == cap) {
+            unsigned char* grown = realloc(out, cap * 2);
+            if (!grown) {
+                err = WH_ERR_NOMEM;
+                break;
+            }
+            out = grown;
+            cap *= 2;
+        }
+        size_t dst_len = cap - pos, src_len = size - in_pos;
+        hint = LZ4F_decompress(dctx, out + pos, &dst_len, data + in_pos, &src_len, NULL);
+        if (LZ4F_isError(hint)) err = WH_ERR_CORRUPT;
+        pos += dst_len;
+        in_pos += src_len;
+    }
+    // Output still buffered in the context, or a frame cut short
+    while (!err && hint != 0) {
+        if (pos == cap) {
+            unsigned char* grown = realloc(out, cap * 2);
+            if (!grown) {
+                err = WH_ERR_NOMEM;
+                break;
+            }
+            out = grown;
+            cap *= 2;
+        }
+        size_t dst_len = cap - pos, src_len = 0;
+        hint = LZ4F_decompress(dctx, out + pos, &dst_len, NULL, &src_len, NULL);
+        if (LZ4F_isError(hint)) err = WH_ERR_CORRUPT;
+        else if (dst_len == 0 && hint != 0) err = WH_ERR_TRUNCATED;
+        pos += dst_len;
+    }
+    LZ4F_freeDecompressionContext(dctx);
+
+    if (err) {
+        free(out);
+        return err;
+    }
+    *out_data = out;
+    *out_size = pos;
+    return WH_OK;
+}
+
+
+// --- File-to-file ---
+#ifndef _WIN32
+
+/* Write all of `buf` at `offset`, retrying short writes. Returns 0 or an
+   errno value. Safe to call from worker threads. */
+static int pwrite_all(int fd, const unsigned char* buf, size_t len, off_t offset) {
+    while (len > 0) {
+        ssize_t n = pwrite(fd, buf, len, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+        buf += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+/* Open and map `path` read-only. An empty file maps to NULL. Returns 0 or an
+   errno value. */
+static int map_input_file(const char* path, int* fd, unsigned char** data, size_t* size) {
+    struct stat st;
+    *data = NULL;
+    *fd = open(path, O_RDONLY);
+    if (*fd < 0) return errno;
+    if (fstat(*fd, &st) < 0) {
+        int e = errno;
+        close(*fd);
+        return e;
+    }
+
+    *size = (size_t)st.st_size;
+    if (*size == 0) return 0;
+
+    void* map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, *fd, 0);
+    if (map == MAP_FAILED) {
+        int e = errno;
+        close(*fd);
+        return e;
+    }
+    madvise(map, *size, MADV_SEQUENTIAL);
+    *data = map;
+    return 0;
+}
+
+static void unmap_input_file(int fd, unsigned char* data, size_t size) {
+    if (data) munmap(data, size);
+    close(fd);
+}
+
+
+/* Bounded-memory streaming: the frame is read window by window, each window's
+   complete blocks are decoded across the team, and the output leaves in
+   order (written to a file or yielded), so memory stays at about
+   max_memory no matter how large the frame is. Regular files are read with
+   pread() behind a POSIX_FADV_WILLNEED hint for the next window; their
+   footer (if any) is read first, for the linked group size, checksums and
+   where the blocks end. Pipes are read sequentially, and their footer is
+   only met at the end: every block is hashed as it is decoded, and the
+   hashes are compared once the footer shows checksums. A frame that needs
+   the footer earlier (linked) or needs to reread the source (far dedup
+   references) fails with WH_ERR_SEEK. */
+
+typedef struct {
+    uint64_t in_offset;  // Payload position in the file
+    uint32_t comp_size;
+    uint32_t orig_size;
+    uint32_t flags;
+    uint32_t typesize;
+} StreamBlock;
+
+typedef struct {
+    int fd;
+    int owns_fd;
+    int regular;             // Regular file: pread(), footer read first, far references fetched
+    int io_errno;
+    const WarpDict* dict;
+    int threads;             // Requested team size, 0 = automatic
+    size_t out_window;       // Output per round; a linked group is never split
+    unsigned char* in_buf;
+    size_t in_cap;
+    size_t in_len;           // Bytes read into in_buf
+    size_t in_pos;           // Where the next round's blocks start
+    uint64_t in_base;        // File offset of in_buf[0]
+    uint64_t blocks_end;     // Where the blocks stop: the footer, or UINT64_MAX
+    uint64_t file_size;      // Regular files
+    int eof;
+    int format;
+    size_t next_block;       // Frame index of the next block to decode
+    size_t group_blocks;
+    unsigned char* checksums;  // Copy of the footer's, or NULL
+    size_t num_checksums;
+    unsigned char* hashes;   // Pipes: every decoded block's XXH3-64, for a footer's checksums
+    size_t hashes_cap;
+    StreamBlock* seen;       // Every block so far (v2 frames), for BLOCK_FLAG_REF
+    size_t seen_cap;
+    uint64_t bytes_out;
+} StreamDecoder;
+
+/* Read exactly `len` bytes at `offset`. Returns 0, an errno value, or -1 if
+   the file ends first. */
+static int pread_exact(int fd, unsigned char* buf, size_t len, off_t offset) {
+    while (len > 0) {
+        ssize_t n = pread(fd, buf, len, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+        if (n == 0) return -1;
+        buf += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+/* Write all of `buf` at the descriptor's position (files and pipes alike).
+   Returns 0 or an errno value. */
+static int write_all(int fd, const unsigned char* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int stream_io_error(StreamDecoder* s, int e) {
+    if (e < 0) return WH_ERR_TRUNCATED;
+    s->io_errno = e;
+    return WH_ERR_IO;
+}
+
+/* Read the footer of a regular file the way find_footer() recognises one,
+   checking its first and last index entries against the headers they
+   point at; without one the whole file is blocks. */
+static int stream_read_footer(StreamDecoder* s, uint64_t file_size) {
+    s->blocks_end = file_size;
+    if (file_size < FOOTER_TAIL_SIZE) return WH_OK;
+
+    unsigned char tail[FOOTER_TAIL_SIZE];
+    int e = pread_exact(s->fd, tail, FOOTER_TAIL_SIZE, (off_t)(file_size - FOOTER_TAIL_SIZE));
+    if (e) return stream_io_error(s, e);
+    uint64_t num_blocks, total_size;
+    uint32_t flags, version, magic;
+    memcpy(&num_blocks, tail, 8);
+    memcpy(&total_size, tail + 8, 8);
+    memcpy(&flags, tail + 20, 4);
+    memcpy(&version, tail + 24, 4);
+    memcpy(&magic, tail + 28, 4);
+    if (magic != FOOTER_MAGIC || version != FOOTER_VERSION || (flags & ~FOOTER_KNOWN_FLAGS)) return WH_OK;
+
+    size_t fixed_size = footer_sections_size(flags, 0);
+    size_t per_block = FOOTER_ENTRY_SIZE + footer_sections_size(flags, 1) - fixed_size;
+    if (file_size - FOOTER_TAIL_SIZE < fixed_size) return WH_OK;
+    uint64_t avail = file_size - FOOTER_TAIL_SIZE - fixed_size;
+    if (num_blocks > avail / per_block || total_size > num_blocks * (uint64_t)MAX_BLOCK_SIZE) return WH_OK;
+    uint64_t blocks_end = avail - num_blocks * per_block;
+
+    // The table has to start where the first block does
+    unsigned char head[FRAME_V2_MAGIC_SIZE], entry[16];
+    size_t head_len = blocks_end < FRAME_V2_MAGIC_SIZE ? (size_t)blocks_end : FRAME_V2_MAGIC_SIZE;
+    e = pread_exact(s->fd, head, head_len, 0);
+    if (e) return stream_io_error(s, e);
+    int format = frame_format(head, head_len);
+    if (num_blocks == 0) {
+        if (blocks_end != frame_prefix_size(format) || total_size != 0) return WH_OK;
+    } else {
+        uint64_t first_in, first_out;
+        e = pread_exact(s->fd, entry, sizeof(entry), (off_t)blocks_end);
+        if (e) return stream_io_error(s, e);
+        memcpy(&first_in, entry, 8);
+        memcpy(&first_out, entry + 8, 8);
+        if (first_in != (format == 2 ? frame_prefix_size(2) : HEADER_SIZE) || first_out != 0) return WH_OK;
+    }
+
+    // Index and sections in one read
+    size_t index_size = num_blocks * FOOTER_ENTRY_SIZE;
+    size_t sections_size = footer_sections_size(flags, num_blocks);
+    unsigned char* entries = malloc(index_size + sections_size + 1);
+    if (!entries) return WH_ERR_NOMEM;
+    e = pread_exact(s->fd, entries, index_size + sections_size, (off_t)blocks_end);
+    if (e) {
+        free(entries);
+        return stream_io_error(s, e);
+    }
+
+    FrameFooter footer;
+    memset(&footer, 0, sizeof(footer));
+    footer.entries = entries;
+    footer.num_blocks = num_blocks;
+    footer.total_size = total_size;
+    footer.blocks_end = blocks_end;
+    footer.flags = flags;
+    footer.format = format;
+    footer.group_blocks = 1;
+    // Like find_footer(), only the first and last entries are read against
+    // their headers; the blocks are walked one by one anyway
+    size_t ends[2] = {0, num_blocks - 1};
+    for (size_t k = 0; k < (num_blocks < 2 ? num_blocks : 2); ++k) {
+        size_t i = ends[k];
+        uint64_t header_at, next_in;
+        unsigned char header[V2_HEADER_MAX];
+        BlockIndex block;
+        int err = footer_entry_header(&footer, i, &header_at, &next_in);
+        size_t len = format == 2 ? V2_HEADER_MAX : HEADER_SIZE;
+        if (!err && len > blocks_end - header_at) len = (size_t)(blocks_end - header_at);
+        if (!err) {
+            e = pread_exact(s->fd, header, len, (off_t)header_at);
+            if (e) {
+                free(entries);
+                return stream_io_error(s, e);
+            }
+            err = check_footer_entry(&footer, i, header_at, next_in, header, len, &block);
+        }
+        if (err) {
+            free(entries);
+            return WH_OK;
+        }
+    }
+
+    const unsigned char* section = entries + index_size;
+    if (flags & FOOTER_FLAG_DICT) {
+        memcpy(&footer.dict_id, section, 4);
+        section += FOOTER_DICT_SECTION_SIZE;
+    }
+    if (flags & FOOTER_FLAG_LINKED) {
+        memcpy(&footer.group_blocks, section, 4);
+        section += FOOTER_LINKED_SECTION_SIZE;
+    }
+    if (footer.group_blocks == 0) {
+        free(entries);
+        return WH_OK;
+    }
+    int err = check_footer_dict(&footer, s->dict);
+    if (!err && (flags & FOOTER_FLAG_CHECKSUM)) {
+        s->checksums = malloc(num_blocks * FOOTER_CHECKSUM_SIZE + 1);
+        if (!s->checksums) err = WH_ERR_NOMEM;
+        else memcpy(s->checksums, section, num_blocks * FOOTER_CHECKSUM_SIZE);
+        s->num_checksums = num_blocks;
+    }
+    free(entries);
+    if (err) return err;
+    s->group_blocks = footer.group_blocks;
+    s->blocks_end = blocks_end;
+    return WH_OK;
+}
+
+/* Set up `s` on its descriptor: a window of `max_memory` bytes, half for
+   input and half for output. Call without the GIL; release with
+   stream_close(). */
+static int stream_open(StreamDecoder* s, int fd, int owns_fd, const WarpDict* dict, int threads, size_t max_memory) {
+    memset(s, 0, sizeof(*s));
+    s->fd = fd;
+    s->owns_fd = owns_fd;
+    s->dict = dict;
+    s->threads = threads;
+    s->group_blocks = 1;
+    s->blocks_end = UINT64_MAX;
+    s->out_window = max_memory / 2;
+    s->in_cap = max_memory / 2;
+    s->in_buf = malloc(s->in_cap);
+    if (!s->in_buf) return WH_ERR_NOMEM;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) return stream_io_error(s, errno);
+    s->regular = S_ISREG(st.st_mode);
+    if (s->regular) {
+        s->file_size = (uint64_t)st.st_size;
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        int err = stream_read_footer(s, (uint64_t)st.st_size);
+        if (err) return err;
+    }
+    return WH_OK;
+}
+
+static void stream_close(StreamDecoder* s) {
+    free(s->in_buf);
+    free(s->checksums);
+    free(s->hashes);
+    free(s->seen);
+    s->in_buf = NULL;
+    s->checksums = NULL;
+    s->hashes = NULL;
+    s->seen = NULL;
+    if (s->owns_fd && s->fd >= 0) close(s->fd);
+    s->fd = -1;
+}
+
+/* Read until in_buf is full or the blocks end, then hint the kernel to
+   start on the next window while this one is decoded. */
+static int stream_fill(StreamDecoder* s) {
+    while (!s->eof && s->in_len < s->in_cap) {
+        size_t want = s->in_cap - s->in_len;
+        uint64_t at = s->in_base + s->in_len;
+        if (s->blocks_end - at < want) want = (size_t)(s->blocks_end - at);
+        if (want == 0) {
+            s->eof = 1;
+            break;
+        }
+        ssize_t n = s->regular ? pread(s->fd, s->in_buf + s->in_len, want, (off_t)at)
+                               : read(s->fd, s->in_buf + s->in_len, want);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return stream_io_error(s, errno);
+        }
+        if (n == 0) {
+            // A regular file that stops short of its own footer shrank under us
+            if (s->regular && s->blocks_end != UINT64_MAX && at < s->blocks_end) return WH_ERR_TRUNCATED;
+            s->eof = 1;
+        }
+        s->in_len += (size_t)n;
+    }
+#ifdef POSIX_FADV_WILLNEED
+    if (s->regular && !s->eof) posix_fadvise(s->fd, (off_t)(s->in_base + s->in_len), (off_t)s->in_cap, POSIX_FADV_WILLNEED);
+#endif
+    return WH_OK;
+}
+
+/* Double the input window (a block or linked group didn't fit) and read on. */
+static int stream_grow(StreamDecoder* s) {
+    unsigned char* grown = realloc(s->in_buf, s->in_cap * 2);
+    if (!grown) return WH_ERR_NOMEM;
+    s->in_buf = grown;
+    s->in_cap *= 2;
+    return stream_fill(s);
+}
+
+/* Slide the unread part of the window to the front. Returns how far it
+   moved. */
+static size_t stream_compact(StreamDecoder* s) {
+    size_t shift = s->in_pos;
+    memmove(s->in_buf, s->in_buf + shift, s->in_len - shift);
+    s->in_base += shift;
+    s->in_len -= shift;
+    s->in_pos = 0;
+    return shift;
+}
+
+/* Have room for `need` bytes of window. */
+static int stream_reserve(StreamDecoder* s, size_t need) {
+    if (need <= s->in_cap) return WH_OK;
+    size_t cap = s->in_cap;
+    while (cap < need) cap *= 2;
+    unsigned char* grown = realloc(s->in_buf, cap);
+    if (!grown) return WH_ERR_NOMEM;
+    s->in_buf = grown;
+    s->in_cap = cap;
+    return WH_OK;
+}
+
+/* Remember block `i` (v2 frames), for references made past the window. */
+static int stream_see(StreamDecoder* s, size_t i, const BlockIndex* block, uint64_t in_offset) {
+    if (i >= s->seen_cap) {
+        size_t cap = s->seen_cap ? s->seen_cap * 2 : 1024;
+        StreamBlock* grown = realloc(s->seen, cap * sizeof(StreamBlock));
+        if (!grown) return WH_ERR_NOMEM;
+        s->seen = grown;
+        s->seen_cap = cap;
+    }
+    s->seen[i].in_offset = in_offset;
+    s->seen[i].comp_size = block->comp_size;
+    s->seen[i].orig_size = block->orig_size;
+    s->seen[i].flags = block->flags;
+    s->seen[i].typesize = block->typesize;
+    return WH_OK;
+}
+
+/* Pipes: is everything from `pos` to the end of the stream the frame's
+   footer? It has to index exactly the blocks read so far, and end where
+   the stream does. A linked frame can't be decoded without its group
+   size, so finding one here is WH_ERR_SEEK. Once every block before it
+   has been decoded (`decoded`), recorded checksums are compared with the
+   blocks' hashes. */
+static int stream_pipe_footer(const StreamDecoder* s, size_t pos, uint64_t num_blocks, uint64_t total_size, int decoded,
+                              int* found) {
+    *found = 0;
+    size_t avail = s->in_len - pos;
+    if (avail < FOOTER_TAIL_SIZE) return WH_OK;
+    const unsigned char* tail = s->in_buf + s->in_len - FOOTER_TAIL_SIZE;
+    uint64_t count, total;
+    uint32_t flags, version, magic;
+    memcpy(&count, tail, 8);
+    memcpy(&total, tail + 8, 8);
+    memcpy(&flags, tail + 20, 4);
+    memcpy(&version, tail + 24, 4);
+    memcpy(&magic, tail + 28, 4);
+    if (magic != FOOTER_MAGIC || version != FOOTER_VERSION || (flags & ~FOOTER_KNOWN_FLAGS)) return WH_OK;
+    if (count != num_blocks || total != total_size) return WH_OK;
+    if (avail != num_blocks * FOOTER_ENTRY_SIZE + footer_sections_size(flags, num_blocks) + FOOTER_TAIL_SIZE) return WH_OK;
+    *found = 1;
+    if (flags & FOOTER_FLAG_LINKED) return WH_ERR_SEEK;
+    if (decoded && (flags & FOOTER_FLAG_CHECKSUM) && num_blocks &&
+        memcmp(s->hashes, tail - num_blocks * FOOTER_CHECKSUM_SIZE, num_blocks * FOOTER_CHECKSUM_SIZE) != 0) {
+        return WH_ERR_CHECKSUM;
+    }
+    return WH_OK;
+}
+
+/* The most a footer indexing `num_blocks` blocks can take. */
+static size_t footer_max_size(uint64_t num_blocks) {
+    return num_blocks * FOOTER_ENTRY_SIZE + footer_sections_size(FOOTER_KNOWN_FLAGS, num_blocks) + FOOTER_TAIL_SIZE;
+}
+
+/* Pipes: read to the end of the stream, keeping only its last bytes, and
+   tell whether they are a linked frame's footer. Only for explaining a
+   failed round; the window's contents are lost. */
+static int stream_pipe_linked(StreamDecoder* s) {
+    while (!s->eof) {
+        s->in_pos = s->in_len > FOOTER_TAIL_SIZE ? s->in_len - FOOTER_TAIL_SIZE : 0;
+        stream_compact(s);
+        if (stream_fill(s)) return 0;
+    }
+    if (s->in_len < FOOTER_TAIL_SIZE) return 0;
+    const unsigned char* tail = s->in_buf + s->in_len - FOOTER_TAIL_SIZE;
+    uint32_t flags, version, magic;
+    memcpy(&flags, tail + 20, 4);
+    memcpy(&version, tail + 24, 4);
+    memcpy(&magic, tail + 28, 4);
+    return magic == FOOTER_MAGIC && version == FOOTER_VERSION && (flags & FOOTER_FLAG_LINKED);
+}
+
+/* Index the next round: the complete blocks from in_pos that make about
+   out_window bytes of output, ending on a linked group boundary. Leaves
+   table->num_blocks at 0 once the frame is done. Duplicates of blocks
+   outside the window get their original's payload copied in after the
+   window's data. Call without the GIL; free_block_table() after use. */
+static int stream_next(StreamDecoder* s, BlockTable* table) {
+    memset(table, 0, sizeof(*table));
+    table->dict = s->dict;
+    table->group_blocks = s->group_blocks;
+
+    // Refill once most of the window has been used
+    if (s->in_len - s->in_pos < s->in_cap / 2 && !s->eof) stream_compact(s);
+    int err = stream_fill(s);
+    if (!err && s->format == 0) {
+        s->format = frame_format(s->in_buf, s->in_len);
+        s->in_pos = frame_prefix_size(s->format);
+        if (s->in_pos > s->in_len) s->in_pos = s->in_len;
+    }
+
+    size_t capacity = 64, n = 0, pos = s->in_pos, out = 0;
+    BlockIndex* index = malloc(capacity * sizeof(BlockIndex));
+    if (!index) return WH_ERR_NOMEM;
+    while (!err) {
+        BlockIndex block;
+        int at_cut = (s->next_block + n) % s->group_blocks == 0;
+        // A pipe's footer (if any) is whatever is left once the blocks end
+        if (!s->regular && s->eof) {
+            int found;
+            err = stream_pipe_footer(s, pos, s->next_block + n, s->bytes_out + out, n == 0, &found);
+            if (err) break;
+            if (found) {
+                // This round's blocks go first; the next call checks the footer against them
+                if (n == 0) s->in_len = pos;
+                break;
+            }
+        }
+        int len = read_block_header(s->in_buf + pos, s->in_len - pos, s->format, &block);
+        // On a pipe, what doesn't parse may be the start of a footer: read
+        // on, as far as a footer for these blocks could reach
+        if (len < 0 && (s->regular || s->eof || s->in_len - pos > footer_max_size(s->next_block + n))) {
+            err = WH_ERR_HEADER;
+            break;
+        }
+        if (len > 0 && (block.flags & BLOCK_FLAG_LINKED) && !s->regular) {
+            err = WH_ERR_SEEK;  // The group size is in the footer
+            break;
+        }
+        if (len > 0 && n && at_cut && out + block.orig_size > s->out_window) break;
+        if (len <= 0 || block.comp_size > s->in_len - pos - (size_t)len) {
+            if (s->eof) {
+                if (pos != s->in_len) err = WH_ERR_TRUNCATED;
+                break;
+            }
+            if (n && at_cut) break;  // The rest comes next round
+            // A block (or linked group) bigger than what is left of the
+            // window: slide it to the front, or if it is there already,
+            // double the window
+            if (s->in_pos > 0) {
+                size_t shift = stream_compact(s);
+                pos -= shift;
+                for (size_t i = 0; i < n; ++i) {
+                    if (index[i].in_offset != SIZE_MAX) index[i].in_offset -= shift;
+                }
+                err = stream_fill(s);
+            } else {
+                err = stream_grow(s);
+            }
+            continue;
+        }
+
+        if (n >= capacity) {
+            capacity *= 2;
+            BlockIndex* grown = realloc(index, capacity * sizeof(BlockIndex));
+            if (!grown) {
+                err = WH_ERR_NOMEM;
+                break;
+            }
+            index = grown;
+        }
+        size_t next_pos = pos + (size_t)len + block.comp_size;
+        block.in_offset = pos + (size_t)len;
+        block.out_offset = out;
+        if (block.flags & BLOCK_FLAG_REF) {
+            uint32_t source;
+            err = ref_source(s->in_buf, &block, s->next_block + n, &source);
+            if (!err && source >= s->next_block) {
+                err = point_at_source(&block, source, &index[source - s->next_block]);
+            } else if (!err) {
+                // Resolved to its place in the file; fetched below
+                BlockIndex original;
+                memset(&original, 0, sizeof(original));
+                original.comp_size = s->seen[source].comp_size;
+                original.orig_size = s->seen[source].orig_size;
+                original.flags = s->seen[source].flags;
+                original.typesize = s->seen[source].typesize;
+                err = point_at_source(&block, source, &original);
+                block.in_offset = SIZE_MAX;
+            }
+            if (err) break;
+        }
+        if (s->format == 2) {
+            uint64_t file_offset = block.in_offset == SIZE_MAX ? s->seen[block.source].in_offset
+                                                                : s->in_base + block.in_offset;
+            err = stream_see(s, s->next_block + n, &block, file_offset);
+            if (err) break;
+        }
+        index[n++] = block;
+        pos = next_pos;
+        out += block.orig_size;
+    }
+
+    if (!err && n == 0 && s->checksums && s->next_block != s->num_checksums) err = WH_ERR_HEADER;
+
+    // Payloads of originals that have left the window go after its data
+    size_t extra = s->in_len;
+    for (size_t i = 0; !err && i < n; ++i) {
+        if (index[i].in_offset != SIZE_MAX) continue;
+        if (!s->regular) {
+            err = WH_ERR_SEEK;
+            break;
+        }
+        err = stream_reserve(s, extra + index[i].comp_size);
+        if (err) break;
+        int e = pread_exact(s->fd, s->in_buf + extra, index[i].comp_size, (off_t)s->seen[index[i].source].in_offset);
+        if (e) {
+            err = stream_io_error(s, e);
+            break;
+        }
+        index[i].in_offset = extra;
+        extra += index[i].comp_size;
+    }
+    if (err) {
+        free(index);
+        return err;
+    }
+
+    table->in_data = s->in_buf;
+    table->index = index;
+    table->num_blocks = n;
+    table->total_size = out;
+    if (s->checksums) {
+        if (s->next_block + n > s->num_checksums) {
+            free(index);
+            table->index = NULL;
+            return WH_ERR_HEADER;
+        }
+        table->checksums = s->checksums + s->next_block * FOOTER_CHECKSUM_SIZE;
+    }
+    if (!s->regular && n) {
+        // Whether they are needed only shows at the footer
+        if (s->next_block + n > s->hashes_cap) {
+            size_t cap = s->hashes_cap ? s->hashes_cap : 1024;
+            while (cap < s->next_block + n) cap *= 2;
+            unsigned char* grown = realloc(s->hashes, cap * FOOTER_CHECKSUM_SIZE);
+            if (!grown) {
+                free(index);
+                table->index = NULL;
+                return WH_ERR_NOMEM;
+            }
+            s->hashes = grown;
+            s->hashes_cap = cap;
+        }
+        table->hashes = s->hashes + s->next_block * FOOTER_CHECKSUM_SIZE;
+    }
+    s->in_pos = pos;
+    return WH_OK;
+}
+
+/* Decode the round stream_next() indexed into `out_data`. Call without the
+   GIL. Returns the team size used in *threads_used. */
+static int stream_decode(StreamDecoder* s, const BlockTable* table, unsigned char* out_data, int* threads_used) {
+    int threads = acquire_threads(s->threads, table_tasks(table));
+    int err = decode_table(table, out_data, threads);
+    release_threads(threads);
+    // A linked v1 frame on a pipe doesn't say so before its footer
+    if (err == WH_ERR_CORRUPT && !s->regular && stream_pipe_linked(s)) err = WH_ERR_SEEK;
+    *threads_used = threads;
+    s->next_block += table->num_blocks;
+    s->bytes_out += table->total_size;
+    return err;
+}
+
+#endif /* !_WIN32 */
+#endif /* WH_BINDINGS */
+
+
+// --- C API (warphybrid.h) ---
+
+struct wh_dict {
+    WarpDict dict;
+};
+
+struct wh_cctx {
+    CompressOptions opts;  // Validated; `threads` is the requested team size, block_size 0 = auto
+    AccelTuner tuner;      // target_mbps: carries the tuned acceleration across calls
+};
+
+struct wh_dctx {
+    const WarpDict* dict;
+    int threads;
+};
+
+const char* wh_error_string(int err) {
+    switch (err) {
+        case WH_OK: return "no error";
+        case WH_ERR_NOMEM: return "out of memory";
+        case WH_ERR_HEADER: return "invalid block header";
+        case WH_ERR_TRAILING: return "trailing data";
+        case WH_ERR_CORRUPT: return "LZ4 size mismatch";
+        case WH_ERR_TRUNCATED: return "truncated stream";
+        case WH_ERR_IO: return "I/O error";
+        case WH_ERR_DICT: return "frame needs a different dictionary";
+        case WH_ERR_CHECKSUM: return "block checksum mismatch";
+        case WH_ERR_SEEK: return "frame can't be streamed from an unseekable source";
+        case WH_ERR_ARG: return "invalid argument";
+        case WH_ERR_DST_SIZE: return "destination buffer too small";
+        default: return "unknown error";
+    }
+}
+
+int wh_dict_create(const void* content, size_t size, wh_dict** dict) {
+    *dict = NULL;
+    if (!content && size) return WH_ERR_ARG;
+    wh_dict* d = malloc(sizeof(wh_dict));
+    if (!d) return WH_ERR_NOMEM;
+    int err = dict_init(&d->dict, content, size);
+    if (err) {
+        free(d);
+        return err;
+    }
+    *dict = d;
+    return WH_OK;
+}
+
+int wh_dict_train(const void* const* samples, const size_t* sizes, size_t count, size_t dict_size, wh_dict** dict) {
+    *dict = NULL;
+    if (count == 0 || !samples || !sizes || dict_size == 0 || dict_size > DICT_MAX_SIZE) return WH_ERR_ARG;
+
+    PayloadBatch batch = {count, (const unsigned char**)samples, (size_t*)sizes};
+    unsigned char* trained = malloc(dict_size);
+    if (!trained) return WH_ERR_NOMEM;
+    size_t trained_size = 0;
+    int err = train_dictionary(&batch, dict_size, trained, &trained_size);
+    if (!err) err = wh_dict_create(trained, trained_size, dict);
+    free(trained);
+    return err;
+}
+
+uint32_t wh_dict_id(const wh_dict* dict) {
+    return dict->dict.id;
+}
+
+void wh_dict_free(wh_dict* dict) {
+    if (!dict) return;
+    dict_free(&dict->dict);
+    free(dict);
+}
+
+void wh_compress_options_init(wh_compress_options* opts) {
+    memset(opts, 0, sizeof(*opts));  // block_size 0: sized per call, as with block_size=None
+    opts->entropy_threshold = DEFAULT_ENTROPY_THRESHOLD;
+    opts->acceleration = 1;
+    opts->format = 1;
+    opts->typesize = 1;
+}
+
+/* The checks the Python entry points make before a compress call. */
+static int check_compress_options(const wh_compress_options* in, CompressOptions* opts, AccelTuner* tuner) {
+    if (in->block_size > MAX_BLOCK_SIZE) return WH_ERR_ARG;
+    if (in->level < 0 || in->level > LZ4HC_CLEVEL_MAX || in->threads < 0) return WH_ERR_ARG;
+    if (in->format != 1 && in->format != 2) return WH_ERR_ARG;
+    if (in->typesize < 1 || in->typesize > MAX_TYPESIZE) return WH_ERR_ARG;
+    if ((in->dedup || in->typesize > 1) && in->linked) return WH_ERR_ARG;
+    if (in->acceleration < 1 || !isfinite(in->target_mbps) || in->target_mbps < 0) return WH_ERR_ARG;
+    if ((in->acceleration > 1 || in->target_mbps > 0) && (in->level > 0 || in->adaptive)) return WH_ERR_ARG;
+
+    *opts = default_compress_options;
+    opts->block_size = in->block_size;
+    opts->level = in->level;
+    opts->adaptive = in->adaptive != 0;
+    opts->entropy_threshold = in->entropy_threshold;
+    opts->linked = in->linked != 0;
+    opts->checksum = in->checksum != 0;
+    opts->seekable = in->seekable || opts->linked || opts->checksum;
+    opts->acceleration = in->acceleration;
+    opts->format = in->dedup || in->typesize > 1 ? 2 : in->format;
+    opts->dedup = in->dedup != 0;
+    opts->typesize = in->typesize;
+    opts->threads = in->threads;
+    if (in->target_mbps > 0) {
+        tuner->target = in->target_mbps * BYTES_PER_MB;
+        tuner->rate = 0;
+        tuner->acceleration = in->acceleration;
+        opts->tuner = tuner;
+    }
+    if (in->dict) {
+        WarpDict* dict = (WarpDict*)&in->dict->dict;
+        int level = opts->adaptive && opts->level == 0 ? LZ4HC_CLEVEL_DEFAULT : opts->level;
+        if (level > 0 && dict_prepare_level(dict, level)) return WH_ERR_NOMEM;
+        opts->dict = dict;
+    }
+    return WH_OK;
+}
+
+int wh_cctx_create(const wh_compress_options* opts, wh_cctx** cctx) {
+    *cctx = NULL;
+    wh_cctx* c = calloc(1, sizeof(wh_cctx));
+    if (!c) return WH_ERR_NOMEM;
+    int err = check_compress_options(opts, &c->opts, &c->tuner);
+    if (err) {
+        free(c);
+        return err;
+    }
+    *cctx = c;
+    return WH_OK;
+}
+
+void wh_cctx_free(wh_cctx* cctx) {
+    free(cctx);
+}
+
+size_t wh_compress_bound(const wh_cctx* cctx, size_t src_size) {
+    CompressOptions opts = cctx->opts;
+    if (opts.block_size == 0) opts.block_size = auto_block_size(0, opts.threads, &opts);
+    return frame_bound(src_size, &opts);
+}
+
+int wh_compress(wh_cctx* cctx, const void* src, size_t src_size, void* dst, size_t dst_capacity,
+                size_t* dst_size) {
+    *dst_size = 0;
+    CompressOptions opts = cctx->opts;
+    if (opts.block_size == 0) opts.block_size = auto_block_size(src_size, opts.threads, &opts);
+    if (dst_capacity < frame_bound(src_size, &opts)) return WH_ERR_DST_SIZE;
+
+    CallStats stats;
+    stats_begin(&stats, 0);
+    opts.stats = &stats;
+    opts.threads = acquire_threads(cctx->opts.threads, (src_size + opts.block_size - 1) / opts.block_size);
+    int err = compress_frame(src, src_size, &opts, dst, dst_size);
+    release_threads(opts.threads);
+    if (err) return err;
+    stats.bytes_in = src_size;
+    stats.bytes_out = *dst_size;
+    stats_end(&stats, 1);
+    return WH_OK;
+}
+
+int wh_dctx_create(const wh_dict* dict, int threads, wh_dctx** dctx) {
+    *dctx = NULL;
+    if (threads < 0) return WH_ERR_ARG;
+    wh_dctx* d = malloc(sizeof(wh_dctx));
+    if (!d) return WH_ERR_NOMEM;
+    d->dict = dict ? &dict->dict : NULL;
+    d->threads = threads;
+    *dctx = d;
+    return WH_OK;
+}
+
+void wh_dctx_free(wh_dctx* dctx) {
+    free(dctx);
+}
+
+int wh_decompressed_size(const void* src, size_t src_size, size_t* size) {
+    FrameInfo info;
+    int err = inspect_frame(src, src_size, &info);
+    *size = err ? 0 : info.total_size;
+    return err;
+}
+
+int wh_decompress(wh_dctx* dctx, const void* src, size_t src_size, void* dst, size_t dst_capacity,
+                  size_t* dst_size) {
+    *dst_size = 0;
+    CallStats stats;
+    stats_begin(&stats, 0);
+    BlockTable table;
+    int err = load_block_table(src, src_size, SIZE_MAX, dctx->dict, &table);
+    if (err) return err;
+    if (dst_capacity < table.total_size) {
+        free_block_table(&table);
+        return WH_ERR_DST_SIZE;
+    }
+
+    int threads = acquire_threads(dctx->threads, table_tasks(&table));
+    err = decode_table(&table, dst, threads);
+    release_threads(threads);
+    if (!err) *dst_size = table.total_size;
+    free_block_table(&table);
+    if (err) return err;
+    stats.bytes_in = src_size;
+    stats.bytes_out = *dst_size;
+    stats_end(&stats, 0);
+    return WH_OK;
+}
+
+int wh_decompress_range(wh_dctx* dctx, const void* src, size_t src_size, size_t offset, size_t length,
+                        void* dst, size_t* dst_size) {
+    *dst_size = 0;
+    CallStats stats;
+    stats_begin(&stats, 0);
+    size_t end = length > SIZE_MAX - offset ? SIZE_MAX : offset + length;
+    BlockTable table;
+    int err = load_block_table(src, src_size, end, dctx->dict, &table);
+    if (err) return err;
+
+    // Clamp to the data, like a file read past EOF
+    if (end > table.total_size) end = table.total_size;
+    if (offset > end) offset = end;
+    if (offset < end) {
+        size_t first = find_block(&table, offset);
+        size_t last = find_block(&table, end - 1);
+        int threads = acquire_threads(dctx->threads, (last / table.group_blocks - first / table.group_blocks) + 1);
+        if (table.group_blocks > 1) err = decode_linked_range(&table, first, last, offset, end, dst, threads);
+        else err = decode_blocks_range(&table, first, last, offset, end, dst, threads);
+        release_threads(threads);
+    }
+    free_block_table(&table);
+    if (err) return err;
+    *dst_size = end - offset;
+    stats.bytes_in = src_size;
+    stats.bytes_out = *dst_size;
+    stats_end(&stats, 0);
+    return WH_OK;
+}
+
+int wh_verify(wh_dctx* dctx, const void* src, size_t src_size, size_t* bad_block, size_t* bad_offset) {
+    *bad_block = SIZE_MAX;
+    *bad_offset = 0;
+    BlockTable table;
+    int err = load_block_table(src, src_size, SIZE_MAX, dctx->dict, &table);
+    if (err) return err;
+
+    int threads = acquire_threads(dctx->threads, table_tasks(&table));
+    err = verify_table(&table, threads, bad_block);
+    release_threads(threads);
+    if (err && *bad_block != SIZE_MAX) *bad_offset = block_out_offset(&table, *bad_block);
+    free_block_table(&table);
+    return err;
+}
+
+int wh_set_max_threads(int threads, int* previous) {
+    if (threads < 0) return WH_ERR_ARG;
+    int was;
+    #pragma omp critical(wh_threads)
+    {
+        was = thread_budget ? thread_budget : omp_get_max_threads();
+        thread_budget = threads ? threads : omp_get_max_threads();
+    }
+    if (previous) *previous = was;
+    return WH_OK;
+}
+
+int wh_set_numa_placement(int enabled, int* previous) {
+    int was;
+    #pragma omp critical(wh_threads)
+    {
+        was = numa_placement;
+#ifdef __linux__
+        // Take the CPU list when turning it on, so a later taskset or cgroup
+        // change is picked up the next time
+        if (enabled && !was) {
+            placement_num_cpus = 0;
+            if (omp_get_proc_bind() == omp_proc_bind_false &&
+                sched_getaffinity(0, sizeof(placement_allowed), &placement_allowed) == 0) {
+                for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                    if (CPU_ISSET(cpu, &placement_allowed)) placement_cpus[placement_num_cpus++] = cpu;
+                }
+            }
+        }
+#endif
+        #pragma omp atomic write
+        numa_placement = enabled != 0;
+    }
+    if (previous) *previous = was;
+    return WH_OK;
+}
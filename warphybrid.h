@@ -0,0 +1,129 @@
+/* warphybrid: multithreaded blocked LZ4, as a C library.
+
+   The engine behind the Python module, for native callers: frames are
+   compressed into and decompressed from caller-provided buffers across an
+   OpenMP team, and are byte for byte the frames the module reads and
+   writes. Build libwarphybrid with `python setup.py build_lib`, which
+   compiles warp_core.c with the bundled LZ4 and xxHash sources.
+
+   Every function returns WH_OK or a WH_ERR_* code (wh_error_string()
+   describes it). Contexts hold validated settings and may be used by one
+   call at a time; calls on different contexts can run concurrently and
+   share the process-wide thread budget (wh_set_max_threads()). */
+#ifndef WARPHYBRID_H
+#define WARPHYBRID_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef WH_API
+#if defined(_WIN32) && defined(WH_BUILD_DLL)
+#define WH_API __declspec(dllexport)
+#elif defined(_WIN32) && defined(WH_USE_DLL)
+#define WH_API __declspec(dllimport)
+#elif defined(__GNUC__)
+#define WH_API __attribute__((visibility("default")))
+#else
+#define WH_API
+#endif
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Error codes. Worker threads record one of these instead of raising, and
+   the caller (or the Python bindings, once the GIL is back) reports it. */
+enum {
+    WH_OK = 0,
+    WH_ERR_NOMEM,
+    WH_ERR_HEADER,
+    WH_ERR_TRAILING,
+    WH_ERR_CORRUPT,
+    WH_ERR_TRUNCATED,
+    WH_ERR_IO,          // errno says why
+    WH_ERR_DICT,        // Frame was compressed with another dictionary (or none given)
+    WH_ERR_CHECKSUM,    // A block decoded to something other than what was compressed
+    WH_ERR_SEEK,        // A streamed frame needs a seekable source (linked, or refers back past the window)
+    WH_ERR_ARG,         // An option or argument is out of range
+    WH_ERR_DST_SIZE     // The destination buffer is too small
+};
+
+WH_API const char* wh_error_string(int err);
+
+/* A shared dictionary, for frames of many small payloads. */
+typedef struct wh_dict wh_dict;
+
+/* Load `size` bytes of content (only the last 64 KB are used). */
+WH_API int wh_dict_create(const void* content, size_t size, wh_dict** dict);
+/* Train a dictionary of up to `dict_size` bytes (1 to 64 KB) from `count`
+   sample payloads. */
+WH_API int wh_dict_train(const void* const* samples, const size_t* sizes, size_t count, size_t dict_size,
+                         wh_dict** dict);
+/* XXH32 of the content, as recorded in seekable frames. */
+WH_API uint32_t wh_dict_id(const wh_dict* dict);
+WH_API void wh_dict_free(wh_dict* dict);
+
+/* Compression settings, as the keyword arguments of compress_hybrid().
+   Start from wh_compress_options_init(). */
+typedef struct {
+    size_t block_size;         // 1 byte to 512 MB; 0 (the default) = sized per call for the team
+    int level;                 // 0 = LZ4 fast, 1 to 12 = LZ4HC at that level
+    int adaptive;              // Start every block fast; use HC where a trial shows a real gain
+    double entropy_threshold;  // Store blocks at or above this many bits/byte raw; 0 disables the check
+    int seekable;              // Append the block index footer
+    int linked;                // Prime each block with the 64 KB before it; implies seekable
+    int checksum;              // Record an XXH3-64 per block; implies seekable
+    int acceleration;          // LZ4 fast acceleration, level 0 only
+    double target_mbps;        // Retune acceleration per block towards this rate; 0 = off
+    int format;                // 1 = fixed 8-byte headers, 2 = compact headers with flags
+    int dedup;                 // Store repeated content-defined chunks once; implies format 2
+    int typesize;              // Byte-shuffle blocks as elements of this size; 1 = off
+    int threads;               // Team size; 0 = as many as are free
+    const wh_dict* dict;       // Borrowed; must outlive the context
+} wh_compress_options;
+
+WH_API void wh_compress_options_init(wh_compress_options* opts);
+
+/* Compression context: settings checked once, plus the acceleration tuner
+   that target_mbps keeps across calls. */
+typedef struct wh_cctx wh_cctx;
+
+WH_API int wh_cctx_create(const wh_compress_options* opts, wh_cctx** cctx);
+WH_API void wh_cctx_free(wh_cctx* cctx);
+/* Worst-case frame size for `src_size` bytes; wh_compress() needs this much room. */
+WH_API size_t wh_compress_bound(const wh_cctx* cctx, size_t src_size);
+WH_API int wh_compress(wh_cctx* cctx, const void* src, size_t src_size, void* dst, size_t dst_capacity,
+                       size_t* dst_size);
+
+/* Decompression context: the dictionary (or NULL) and team size (0 = as
+   many as are free). */
+typedef struct wh_dctx wh_dctx;
+
+WH_API int wh_dctx_create(const wh_dict* dict, int threads, wh_dctx** dctx);
+WH_API void wh_dctx_free(wh_dctx* dctx);
+/* Decompressed size of a frame, from its footer or a walk of its headers. */
+WH_API int wh_decompressed_size(const void* src, size_t src_size, size_t* size);
+WH_API int wh_decompress(wh_dctx* dctx, const void* src, size_t src_size, void* dst, size_t dst_capacity,
+                         size_t* dst_size);
+/* Decompress bytes [offset, offset + length) of the data, clamped to its
+   end, into `dst` (at least `length` bytes). Only the blocks overlapping
+   the range are decoded. */
+WH_API int wh_decompress_range(wh_dctx* dctx, const void* src, size_t src_size, size_t offset, size_t length,
+                               void* dst, size_t* dst_size);
+/* Check a frame without producing its output: every block is decoded into
+   per-thread scratch and checked against its checksum, if recorded. On a
+   block failure *bad_block and *bad_offset are the index and output offset
+   of the first bad block; otherwise *bad_block is SIZE_MAX. */
+WH_API int wh_verify(wh_dctx* dctx, const void* src, size_t src_size, size_t* bad_block, size_t* bad_offset);
+
+/* Cap the process-wide thread budget (0 = the OpenMP default). */
+WH_API int wh_set_max_threads(int threads, int* previous);
+/* Pin workers to CPUs so each block range is faulted in on its node (Linux). */
+WH_API int wh_set_numa_placement(int enabled, int* previous);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WARPHYBRID_H */